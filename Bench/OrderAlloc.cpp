@@ -0,0 +1,69 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Counting replacements of the global allocation functions
+//==============================================================
+#include <cstdlib>
+#include <new>
+
+#include "OrderAlloc.hpp"
+
+std::atomic<uint64_t> g_nAllocs(0);
+
+namespace {
+
+	void* countedAlloc(size_t nSize) noexcept {
+		g_nAllocs.fetch_add(1, std::memory_order_relaxed);
+		return malloc(nSize ? nSize : 1);
+	}
+
+	void* countedAlignedAlloc(size_t nSize, std::align_val_t al) noexcept {
+		g_nAllocs.fetch_add(1, std::memory_order_relaxed);
+		size_t nAlign = static_cast<size_t>(al);
+		if (nAlign < sizeof(void*))
+			nAlign = sizeof(void*);
+
+		void* p = nullptr;
+		return (posix_memalign(&p, nAlign, nSize ? nSize : 1) == 0) ? p : nullptr;
+	}
+}
+
+void* operator new(size_t nSize) {
+	if (void* p = countedAlloc(nSize))
+		return p;
+	throw std::bad_alloc();
+}
+void* operator new[](size_t nSize) {
+	if (void* p = countedAlloc(nSize))
+		return p;
+	throw std::bad_alloc();
+}
+void* operator new(size_t nSize, const std::nothrow_t&) noexcept		{ return countedAlloc(nSize); }
+void* operator new[](size_t nSize, const std::nothrow_t&) noexcept		{ return countedAlloc(nSize); }
+
+void* operator new(size_t nSize, std::align_val_t al) {
+	if (void* p = countedAlignedAlloc(nSize, al))
+		return p;
+	throw std::bad_alloc();
+}
+void* operator new[](size_t nSize, std::align_val_t al) {
+	if (void* p = countedAlignedAlloc(nSize, al))
+		return p;
+	throw std::bad_alloc();
+}
+void* operator new(size_t nSize, std::align_val_t al, const std::nothrow_t&) noexcept		{ return countedAlignedAlloc(nSize, al); }
+void* operator new[](size_t nSize, std::align_val_t al, const std::nothrow_t&) noexcept	{ return countedAlignedAlloc(nSize, al); }
+
+void operator delete(void* p) noexcept										{ free(p); }
+void operator delete[](void* p) noexcept									{ free(p); }
+void operator delete(void* p, size_t) noexcept								{ free(p); }
+void operator delete[](void* p, size_t) noexcept							{ free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept				{ free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept				{ free(p); }
+
+void operator delete(void* p, std::align_val_t) noexcept						{ free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept					{ free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept				{ free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept			{ free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept		{ free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept	{ free(p); }
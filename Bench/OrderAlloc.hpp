@@ -0,0 +1,10 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Every heap allocation of the process, counted by the replacement allocation functions of OrderAlloc.cpp
+// linked into the benchmark and check tools, so a case can tell what its hot path allocates. The
+// replacements live in their own translation unit so that none of them is inlined next to the library
+// allocation it replaces.
+extern std::atomic<uint64_t> g_nAllocs;
@@ -0,0 +1,460 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Microbenchmarks of the feed ingestion and level diff hot paths
+//==============================================================
+#include "pch.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <set>
+#include <map>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+
+using namespace std;
+
+#include "OrderSource.hpp"
+#include "OrderScan.hpp"
+#include "OrderFeeds.hpp"
+#include "OrderPlot.hpp"
+#include "OrderAlloc.hpp"
+
+#ifndef OB_BENCH_FEED_DIR
+#define OB_BENCH_FEED_DIR "."
+#endif
+
+// Times each hot path on its own over the sample feeds, TSTJ.csv and TSTJ.log. The level handlers run
+// over the rows of the sample feeds into a warm book, the full reads over the sample feeds copied out
+// to the asked number of rows, and the level diff over the books the full reads build.
+class OBBench
+{
+public:
+	struct BenchParams {
+		string		szFeedDir;		// Directory of the sample feeds
+		string		szWorkDir;		// Where the copied out feeds are written
+		int			nRows;			// Rows of each copied out feed
+		int			nMinMs;			// Least time of each timed sample
+		int			nSamples;		// Timed samples of each case
+	};
+
+	struct BenchResult {
+		string		szName;
+		uint64_t	nRows;			// Rows handled by the fastest sample, level pairs for the diff
+		uint64_t	nBytes;			// Feed bytes those rows were read from, plot bytes for the diff
+		int			nIterations;	// Iterations of the fastest sample
+		double		dSeconds;		// Time of the fastest sample
+		double		dAllocsPerRow;
+
+		double rowsPerSec() const		{ return dSeconds > 0 ? nRows / dSeconds : 0; }
+		double bytesPerSec() const		{ return dSeconds > 0 ? nBytes / dSeconds : 0; }
+		double allocsPerRow() const		{ return dAllocsPerRow; }
+	};
+
+	explicit OBBench(const BenchParams& bp) : m_bp(bp) {}
+
+	void run(vector<BenchResult>& vResults);
+
+	static void writeJson(ostream& os, const vector<BenchResult>& vResults, const BenchParams& bp);
+
+	// Compare with the results of a baseline run, returning the number of regressed cases
+	static int compareBaseline(const string& szBaseline, const vector<BenchResult>& vResults, double dTolerance);
+
+private:
+	// Feed rows and the book fields sliced out of them
+	struct BenchFeed {
+		string						szFile;
+		string						szData;
+		vector<string_view>			vBidLevels;
+		vector<string_view>			vAskLevels;
+		uint64_t					nLevelBytes;
+	};
+
+	template <class S>
+	void loadFeed(BenchFeed& bf, const string& szFile);
+
+	string copyFeed(const BenchFeed& bf, const string& szName, int nHeaderLines, uint64_t& nRows);
+
+	template <class S>
+	BenchResult benchAddLevels(const BenchFeed& bf, const string& szName);
+
+	template <class S>
+	BenchResult benchProcessLevel(const BenchFeed& bf, const string& szName);
+
+	template <class S>
+	BenchResult benchProcessFeeds(const string& szFile, uint64_t nRows, const string& szName, boost::shared_ptr<OrderBook>& pBook);
+
+	BenchResult benchLevelsDiff(OrderBook& obCsv, OrderBook& obLog);
+
+	// Run fn once to warm up, then as many times as fit in the minimum time
+	template <typename Fn>
+	BenchResult measure(const string& szName, uint64_t nRows, uint64_t nBytes, Fn fn);
+
+private:
+	BenchParams		m_bp;
+
+	static constexpr auto SZ_OBBENCH_EXCEPTION = "OBBench Exception";
+};
+
+template <class S>
+void OBBench::loadFeed(BenchFeed& bf, const string& szFile) {
+
+	static const string SZ_OBBENCH_LOADFEED = "loadFeed";
+
+	bf.szFile = szFile;
+
+	ifstream file(szFile, ios::binary);
+	if (!file)
+		throw TracedException(SZ_OBBENCH_EXCEPTION, "Cannot open sample feed " + szFile, SZ_OBBENCH_LOADFEED);
+
+	stringstream ss;
+	ss << file.rdbuf();
+	bf.szData = ss.str();
+
+	// Only the rows carrying books reach the level handlers
+	bf.nLevelBytes = 0;
+	for (size_t nPos = 0; nPos < bf.szData.size(); ) {
+		size_t nEol = bf.szData.find('\n', nPos);
+		if (nEol == string::npos)
+			nEol = bf.szData.size();
+
+		size_t nEnd = (nEol > nPos && bf.szData[nEol - 1] == '\r') ? nEol - 1 : nEol;
+		string_view svBid, svAsk;
+		if (S::tokenizeRow(string_view(bf.szData.data() + nPos, nEnd - nPos), svBid, svAsk) == OBStream::FEED_ROW_BOOK) {
+			bf.vBidLevels.push_back(svBid);
+			bf.vAskLevels.push_back(svAsk);
+			bf.nLevelBytes += svBid.size() + svAsk.size();
+		}
+
+		nPos = nEol + 1;
+	}
+}
+
+string OBBench::copyFeed(const BenchFeed& bf, const string& szName, int nHeaderLines, uint64_t& nRows) {
+
+	static const string SZ_OBBENCH_COPYFEED = "copyFeed";
+
+	// Split the header lines from the rows that are repeated
+	size_t nBody = 0;
+	for (int i = 0; i < nHeaderLines && nBody != string::npos; ++i) {
+		nBody = bf.szData.find('\n', nBody);
+		if (nBody != string::npos)
+			++nBody;
+	}
+
+	string szBody = (nBody == string::npos) ? string() : bf.szData.substr(nBody);
+	if (!szBody.empty() && szBody.back() != '\n')
+		szBody += '\n';
+
+	uint64_t nBodyRows = std::count(szBody.begin(), szBody.end(), '\n');
+	if (nBodyRows == 0)
+		throw TracedException(SZ_OBBENCH_EXCEPTION, "Sample feed has no rows " + bf.szFile, SZ_OBBENCH_COPYFEED);
+
+	string szFile = m_bp.szWorkDir + "/" + szName;
+	ofstream file(szFile, ios::binary | ios::trunc);
+	if (!file)
+		throw TracedException(SZ_OBBENCH_EXCEPTION, "Cannot write feed " + szFile, SZ_OBBENCH_COPYFEED);
+
+	file.write(bf.szData.data(), static_cast<streamsize>(nBody == string::npos ? bf.szData.size() : nBody));
+
+	for (nRows = 0; nRows < static_cast<uint64_t>(m_bp.nRows); nRows += nBodyRows)
+		file.write(szBody.data(), static_cast<streamsize>(szBody.size()));
+
+	if (!file.flush())
+		throw TracedException(SZ_OBBENCH_EXCEPTION, "Cannot write feed " + szFile, SZ_OBBENCH_COPYFEED);
+
+	return szFile;
+}
+
+template <typename Fn>
+OBBench::BenchResult OBBench::measure(const string& szName, uint64_t nRows, uint64_t nBytes, Fn fn) {
+
+	fn();
+
+	BenchResult br{ szName, 0, 0, 0, 0.0, 0.0 };
+	uint64_t nAllocs = g_nAllocs.load();
+	uint64_t nIterations = 0;
+
+	// The fastest sample is kept, the others were slowed down by whatever else ran meanwhile
+	for (int nSample = 0; nSample < m_bp.nSamples; ++nSample) {
+
+		auto tBeg = std::chrono::steady_clock::now();
+		auto tMin = tBeg + std::chrono::milliseconds(m_bp.nMinMs);
+
+		std::chrono::steady_clock::time_point tNow;
+		int nSampleIterations = 0;
+		do {
+			fn();
+			nSampleIterations++;
+			tNow = std::chrono::steady_clock::now();
+		} while (tNow < tMin);
+
+		double dSeconds = std::chrono::duration<double>(tNow - tBeg).count();
+		if (br.nIterations == 0 || dSeconds / nSampleIterations < br.dSeconds / br.nIterations) {
+			br.nIterations = nSampleIterations;
+			br.dSeconds = dSeconds;
+		}
+		nIterations += nSampleIterations;
+	}
+
+	br.nRows = nRows * br.nIterations;
+	br.nBytes = nBytes * br.nIterations;
+
+	// Allocations are counted over every sample
+	br.dAllocsPerRow = (nRows > 0) ? static_cast<double>(g_nAllocs.load() - nAllocs) / (nRows * nIterations) : 0;
+	return br;
+}
+
+template <class S>
+OBBench::BenchResult OBBench::benchAddLevels(const BenchFeed& bf, const string& szName) {
+
+	int nLevels = MAX_BOOK_LEVELS;
+	S obs(bf.szFile, nLevels);
+
+	// The levels are read once up front so only their recording is timed
+	vector<BidAskLevels> vBal(bf.vBidLevels.size());
+	for (size_t i = 0; i < vBal.size(); ++i) {
+		obs.readLevels(bf.vBidLevels[i], vBal[i].vBidQty);
+		obs.readLevels(bf.vAskLevels[i], vBal[i].vAskQty);
+	}
+
+	OrderBook& ob = *obs.getOrderBook();
+	return measure(szName, vBal.size(), bf.nLevelBytes, [&]() {
+		for (const auto& bal : vBal) {
+			obs.addLevels(ob.vecBidLevels, bal.vBidQty);
+			obs.addLevels(ob.vecAskLevels, bal.vAskQty);
+		}
+	});
+}
+
+template <class S>
+OBBench::BenchResult OBBench::benchProcessLevel(const BenchFeed& bf, const string& szName) {
+
+	int nLevels = MAX_BOOK_LEVELS;
+	S obs(bf.szFile, nLevels);
+
+	OrderBook& ob = *obs.getOrderBook();
+	return measure(szName, bf.vBidLevels.size(), bf.nLevelBytes, [&]() {
+		for (size_t i = 0; i < bf.vBidLevels.size(); ++i)
+			obs.processLevel(ob, bf.vBidLevels[i], bf.vAskLevels[i], BookAnalytics::NO_TIME);
+	});
+}
+
+template <class S>
+OBBench::BenchResult OBBench::benchProcessFeeds(const string& szFile, uint64_t nRows, const string& szName, boost::shared_ptr<OrderBook>& pBook) {
+
+	uint64_t nBytes = 0;
+	{
+		OBMappedFile mf(szFile);
+		nBytes = mf.size();
+	}
+
+	// A new stream and book for every read, as the application makes them
+	return measure(szName, nRows, nBytes, [&]() {
+		int nLevels = MAX_BOOK_LEVELS;
+		S obs(szFile, nLevels);
+		obs.processFeeds();
+		obs.CheckNotifyException();
+		pBook = obs.getOrderBook();
+	});
+}
+
+OBBench::BenchResult OBBench::benchLevelsDiff(OrderBook& obCsv, OrderBook& obLog) {
+
+	uint64_t nPairs = 0;
+	for (const auto& ls : obCsv.vecBidLevels) nPairs += ls.size();
+	for (const auto& ls : obCsv.vecAskLevels) nPairs += ls.size();
+	for (const auto& ls : obLog.vecBidLevels) nPairs += ls.size();
+	for (const auto& ls : obLog.vecAskLevels) nPairs += ls.size();
+
+	InjectParams ijParams;
+	size_t nPlotBytes = 0;
+
+	auto plotDiff = [&]() {
+		stringstream ss;
+		ijParams.szParam = "Bid";
+		OrderPlot::plotBookLevelsDiff(obCsv.vecBidLevels, obLog.vecBidLevels, ijParams, ss);
+		ijParams.szParam = "Ask";
+		OrderPlot::plotBookLevelsDiff(obCsv.vecAskLevels, obLog.vecAskLevels, ijParams, ss);
+		nPlotBytes = static_cast<size_t>(ss.tellp());
+	};
+
+	plotDiff();
+	return measure("plotBookLevelsDiff", nPairs, nPlotBytes, plotDiff);
+}
+
+void OBBench::run(vector<BenchResult>& vResults) {
+
+	BenchFeed bfCsv, bfLog;
+	loadFeed<OBStreamCSV>(bfCsv, m_bp.szFeedDir + "/TSTJ.csv");
+	loadFeed<OBStreamLog>(bfLog, m_bp.szFeedDir + "/TSTJ.log");
+
+	vResults.push_back(benchAddLevels<OBStreamCSV>(bfCsv, "addLevels.csv"));
+	vResults.push_back(benchAddLevels<OBStreamLog>(bfLog, "addLevels.log"));
+	vResults.push_back(benchProcessLevel<OBStreamCSV>(bfCsv, "processLevel.csv"));
+	vResults.push_back(benchProcessLevel<OBStreamLog>(bfLog, "processLevel.log"));
+
+	uint64_t nCsvRows = 0, nLogRows = 0;
+	string szCsvFile = copyFeed(bfCsv, "obbench.csv", 1, nCsvRows);
+	string szLogFile = copyFeed(bfLog, "obbench.log", 0, nLogRows);
+
+	boost::shared_ptr<OrderBook> pCsvBook, pLogBook;
+	vResults.push_back(benchProcessFeeds<OBStreamCSV>(szCsvFile, nCsvRows, "processFeeds.csv", pCsvBook));
+	vResults.push_back(benchProcessFeeds<OBStreamLog>(szLogFile, nLogRows, "processFeeds.log", pLogBook));
+
+	std::remove(szCsvFile.c_str());
+	std::remove(szLogFile.c_str());
+
+	vResults.push_back(benchLevelsDiff(*pCsvBook, *pLogBook));
+}
+
+void OBBench::writeJson(ostream& os, const vector<BenchResult>& vResults, const BenchParams& bp) {
+
+	os << "{" << endl;
+	os << "\t\"isa\": \"" << OBDelimScan::getIsaName(OBDelimScan::getIsa()) << "\"," << endl;
+	os << "\t\"price_decimals\": " << OB_PRICE_DECIMALS << "," << endl;
+	os << "\t\"feed_rows\": " << bp.nRows << "," << endl;
+	os << "\t\"samples\": " << bp.nSamples << "," << endl;
+	os << "\t\"cases\": [" << endl;
+
+	for (size_t i = 0; i < vResults.size(); ++i) {
+		const BenchResult& br = vResults[i];
+		os << "\t\t{ \"name\": \"" << br.szName << "\""
+			<< ", \"iterations\": " << br.nIterations
+			<< ", \"rows\": " << br.nRows
+			<< ", \"bytes\": " << br.nBytes
+			<< ", \"seconds\": " << std::setprecision(6) << br.dSeconds
+			<< ", \"rows_per_sec\": " << std::fixed << std::setprecision(0) << br.rowsPerSec()
+			<< ", \"bytes_per_sec\": " << br.bytesPerSec()
+			<< ", \"allocs_per_row\": " << std::setprecision(4) << br.allocsPerRow() << std::defaultfloat
+			<< " }" << (i + 1 < vResults.size() ? "," : "") << endl;
+	}
+
+	os << "\t]" << endl;
+	os << "}" << endl;
+}
+
+int OBBench::compareBaseline(const string& szBaseline, const vector<BenchResult>& vResults, double dTolerance) {
+
+	using boost::property_tree::ptree;
+	ptree pt;
+	boost::property_tree::read_json(szBaseline, pt);
+
+	// Slower by more than the tolerance, or any more allocations, is a regression
+	int nRegressed = 0;
+	cout << endl << "Against baseline " << szBaseline << ":" << endl;
+
+	for (const auto& br : vResults) {
+
+		const ptree* pCase = nullptr;
+		for (const auto& c : pt.get_child("cases")) {
+			if (c.second.get<string>("name") == br.szName)
+				pCase = &c.second;
+		}
+
+		if (pCase == nullptr) {
+			cout << "  " << std::left << std::setw(20) << br.szName << "not in baseline" << endl;
+			continue;
+		}
+
+		double dBaseRate = pCase->get<double>("rows_per_sec");
+		double dBaseAllocs = pCase->get<double>("allocs_per_row");
+		double dRatio = (dBaseRate > 0) ? br.rowsPerSec() / dBaseRate : 1.0;
+
+		bool bSlower = dRatio < 1.0 - dTolerance;
+		bool bAllocs = br.allocsPerRow() > dBaseAllocs + 0.005;
+
+		cout << "  " << std::left << std::setw(20) << br.szName << std::right << std::fixed << std::setprecision(2)
+			<< std::setw(6) << dRatio << "x rows/s, " << std::setprecision(3) << br.allocsPerRow() << " allocs/row (was " << dBaseAllocs << ")"
+			<< (bSlower ? "  SLOWER" : "") << (bAllocs ? "  MORE ALLOCATIONS" : "") << std::defaultfloat << endl;
+
+		if (bSlower || bAllocs)
+			nRegressed++;
+	}
+
+	return nRegressed;
+}
+
+static void usage() {
+	cout << "Usage: obbench [--feeds dir] [--work dir] [--rows n] [--min-ms n] [--samples n]" << endl;
+	cout << "               [--isa scalar|sse2|avx2] [--json file] [--baseline file] [--tolerance percent]" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+	OBBench::BenchParams bp{ OB_BENCH_FEED_DIR, ".", 200000, 200, 5 };
+	string szJson = "obbench.json";
+	string szBaseline;
+	double dTolerance = 0.20;
+
+	for (int i = 1; i < argc; ++i) {
+
+		string szArg = argv[i];
+		if (i + 1 == argc) {
+			usage();
+			return 2;
+		}
+
+		string szValue = argv[++i];
+		if (szArg == "--feeds")				bp.szFeedDir = szValue;
+		else if (szArg == "--work")			bp.szWorkDir = szValue;
+		else if (szArg == "--rows")			bp.nRows = std::max(atoi(szValue.c_str()), 1);
+		else if (szArg == "--min-ms")		bp.nMinMs = std::max(atoi(szValue.c_str()), 1);
+		else if (szArg == "--samples")		bp.nSamples = std::max(atoi(szValue.c_str()), 1);
+		else if (szArg == "--json")			szJson = szValue;
+		else if (szArg == "--baseline")		szBaseline = szValue;
+		else if (szArg == "--tolerance")	dTolerance = atof(szValue.c_str()) / 100.0;
+		else if (szArg == "--isa") {
+			if (szValue == "scalar")		OBDelimScan::selectIsa(OBDelimScan::SCAN_SCALAR);
+			else if (szValue == "sse2")		OBDelimScan::selectIsa(OBDelimScan::SCAN_SSE2);
+			else if (szValue == "avx2")		OBDelimScan::selectIsa(OBDelimScan::SCAN_AVX2);
+			else { usage(); return 2; }
+		}
+		else {
+			usage();
+			return 2;
+		}
+	}
+
+	try {
+		vector<OBBench::BenchResult> vResults;
+		OBBench(bp).run(vResults);
+
+		cout << std::left << std::setw(20) << "case" << std::right << std::setw(14) << "rows/s" << std::setw(14) << "MB/s" << std::setw(14) << "allocs/row" << endl;
+		for (const auto& br : vResults) {
+			cout << std::left << std::setw(20) << br.szName << std::right << std::fixed
+				<< std::setw(14) << std::setprecision(0) << br.rowsPerSec()
+				<< std::setw(14) << std::setprecision(1) << br.bytesPerSec() / 1e6
+				<< std::setw(14) << std::setprecision(3) << br.allocsPerRow() << std::defaultfloat << endl;
+		}
+
+		ofstream file(szJson, ios::trunc);
+		OBBench::writeJson(file, vResults, bp);
+		if (!file.flush()) {
+			cout << "Cannot write " << szJson << endl;
+			return 2;
+		}
+
+		if (!szBaseline.empty() && OBBench::compareBaseline(szBaseline, vResults, dTolerance) > 0)
+			return 1;
+	}
+	catch (const TracedException& te) {
+		te.coutException();
+		return 2;
+	}
+	catch (const std::exception& e) {
+		cout << e.what() << endl;
+		return 2;
+	}
+
+	return 0;
+}
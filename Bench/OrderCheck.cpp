@@ -0,0 +1,1134 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Checks of the feed ingestion paths run by ctest
+//==============================================================
+#include "pch.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <set>
+#include <map>
+#include <atomic>
+#include <cstdlib>
+#include <random>
+#include <limits>
+#include <cstring>
+
+#ifdef OB_GZIP
+#include <zlib.h>
+#endif
+
+using namespace std;
+
+#include "OrderFeeds.hpp"
+#include "OrderSource.hpp"
+#include "OrderScan.hpp"
+#include "OrderReport.hpp"
+#include "OrderPlot.hpp"
+#include "OrderRecon.hpp"
+#include "OrderGen.hpp"
+#include "OrderAlloc.hpp"
+
+#ifndef OB_BENCH_FEED_DIR
+#define OB_BENCH_FEED_DIR "."
+#endif
+
+// Each check prints its outcome and returns whether it passed
+class OBCheck
+{
+public:
+	OBCheck(const string& szFeedDir, const string& szWorkDir) : m_szFeedDir(szFeedDir), m_szWorkDir(szWorkDir) {}
+
+	// Rows read again once the per-thread level storage, the side memos and the level summaries are
+	// warm allocate nothing
+	template <class S>
+	bool checkRowAllocs(const string& szFeed, int nHeaderLines);
+
+	// A quoted book read before the first time stamp of a feed holds its spread for no time
+	bool checkUntimedSpread();
+
+	// Engines applying the rows of a feed in chunks, then merged, check them as one engine applying them all
+	bool checkEngineMerge();
+
+	// Every instruction set the processor supports indexes blocks and partial tails of random rows into
+	// the bitmaps of a byte loop, and scans hand out the same delimiters
+	bool checkDelimScan();
+
+	// Prices parse exactly or not at all, whatever their decimals, sign, suffix or range, and mid points
+	// of two prices are exact
+	bool checkPriceParse();
+
+	// Malformed and bad number rows are skipped and logged by line and offset, up to the log cap, by
+	// every way of reading a feed; chunks merged in file order renumber their lines from the feed start
+	bool checkFeedErrors();
+
+	// A feed parsed in chunks on several threads, then merged, makes the book of a sequential read: the
+	// same levels, totals, best spreads, checks and analytics
+	template <class S>
+	bool checkChunkedRead(const string& szFile);
+
+	// Levels diffed in one merge of their sorted pairs give the pairs the set differences of the first
+	// plotBookLevelsDiff gave, and a level only one feed reached is diffed against an empty one
+	bool checkLevelDiff();
+
+#ifdef OB_GZIP
+	// A gzip feed of one or several members, cut anywhere, reads as the plain feed it holds, in blocks
+	// of whole rows; a truncated archive or bytes past its last member stop the read with an exception
+	bool checkCompressedFeed(const string& szPlainFile);
+#endif
+
+	// The best spreads keep the tightest spreads, each with its lowest bid and the last ladder logged at
+	// it, whether updated row by row or merged from the spreads of consecutive chunks
+	bool checkBestSpreads();
+
+	// The perfect hash finds every key it was built from at its position and nothing else, leaves empty
+	// keys out and refuses a key given twice
+	bool checkPerfectHash();
+
+	// The generated feeds reconcile to the divergences injected in them; books match within the tolerance
+	// once the log offset is added, whichever feed shows them first, and only the windows holding
+	// unmatched books are summarised
+	bool checkReconcile(const string& szCsvFile, const string& szLogFile, const OBFeedGen::GenCounts& gc);
+
+	// Csv and log feeds generated for the checks reading whole feeds
+	void generateFeeds(string& szCsvFile, string& szLogFile, OBFeedGen::GenCounts& gc) const;
+
+private:
+	void loadRows(const string& szFile, int nHeaderLines, string& szData, vector<string_view>& vRows) const;
+	string writeFeed(const string& szName, const string& szData) const;
+
+	static bool report(const string& szName, bool bPassed, const string& szDetail);
+
+	static void makeRows(uint64_t nSeed, size_t nRows, int nTick, vector<BidAskLevels>& vRows);
+	static bool sameChecks(const BookChecks& bc, const BookChecks& bcOther);
+	static bool sameLevels(const vecLevels& vl, const vecLevels& vlOther);
+	string formatBook(const OrderBook& ob) const;
+#ifdef OB_GZIP
+	static string gzipMember(const char* pData, size_t nBytes);
+	static bool inflateFeed(const string& szFile, string& szData, bool& bWholeRows);
+#endif
+	static void diffLevelSets(const LevelSummary& lsCsv, const LevelSummary& lsLog, vecPriceQty& vpiCsv, vecPriceQty& vpiLog);
+	static string formatChecks(const BookChecks& bc);
+
+private:
+	string		m_szFeedDir;
+	string		m_szWorkDir;		// Where the generated feeds are written
+
+	static constexpr int WARMUP_PASSES = 2;
+	static constexpr int CHECKED_PASSES = 3;
+	static constexpr uint64_t CHECK_SEED = 20180612;
+
+	static constexpr auto SZ_OBCHECK_EXCEPTION = "OBCheck Exception";
+};
+
+void OBCheck::loadRows(const string& szFile, int nHeaderLines, string& szData, vector<string_view>& vRows) const {
+
+	static const string SZ_OBCHECK_LOADROWS = "loadRows";
+
+	ifstream file(szFile, ios::binary);
+	if (!file)
+		throw TracedException(SZ_OBCHECK_EXCEPTION, "Cannot open sample feed " + szFile, SZ_OBCHECK_LOADROWS);
+
+	stringstream ss;
+	ss << file.rdbuf();
+	szData = ss.str();
+
+	for (size_t nPos = 0; nPos < szData.size(); ) {
+		size_t nEol = szData.find('\n', nPos);
+		if (nEol == string::npos)
+			nEol = szData.size();
+
+		size_t nEnd = (nEol > nPos && szData[nEol - 1] == '\r') ? nEol - 1 : nEol;
+		if (nHeaderLines > 0)
+			--nHeaderLines;
+		else
+			vRows.push_back(string_view(szData.data() + nPos, nEnd - nPos));
+
+		nPos = nEol + 1;
+	}
+}
+
+string OBCheck::writeFeed(const string& szName, const string& szData) const {
+
+	static const string SZ_OBCHECK_WRITEFEED = "writeFeed";
+
+	string szFile = m_szWorkDir + "/" + szName;
+	ofstream file(szFile, ios::binary | ios::trunc);
+	file.write(szData.data(), static_cast<streamsize>(szData.size()));
+
+	if (!file.flush())
+		throw TracedException(SZ_OBCHECK_EXCEPTION, "Cannot write feed " + szFile, SZ_OBCHECK_WRITEFEED);
+
+	return szFile;
+}
+
+bool OBCheck::report(const string& szName, bool bPassed, const string& szDetail) {
+
+	cout << (bPassed ? "passed  " : "FAILED  ") << szName << ": " << szDetail << endl;
+	return bPassed;
+}
+
+template <class S>
+bool OBCheck::checkRowAllocs(const string& szFeed, int nHeaderLines) {
+
+	string szData;
+	vector<string_view> vRows;
+	loadRows(m_szFeedDir + "/" + szFeed, nHeaderLines, szData, vRows);
+
+	int nLevels = MAX_BOOK_LEVELS;
+	S obsFeed(m_szFeedDir + "/" + szFeed, nLevels);
+	OrderBook& ob = *obsFeed.getOrderBook();
+
+	// The row handlers are reached through the stream they are declared in
+	OBStream& obs = obsFeed;
+
+	for (int i = 0; i < WARMUP_PASSES; ++i) {
+		for (const auto& svRow : vRows)
+			obs.processRow(ob, svRow);
+	}
+
+	uint64_t nAllocs = g_nAllocs.load();
+	for (int i = 0; i < CHECKED_PASSES; ++i) {
+		for (const auto& svRow : vRows)
+			obs.processRow(ob, svRow);
+	}
+	nAllocs = g_nAllocs.load() - nAllocs;
+
+	return report("processRow allocations " + szFeed, nAllocs == 0, to_string(nAllocs) + " allocations over " + to_string(CHECKED_PASSES * vRows.size()) + " rows after warm-up");
+}
+
+bool OBCheck::checkUntimedSpread() {
+
+	vecPriceQty vBids{ pairPriceQty(OBPrice::fromUnits(100), 10) };
+	vecPriceQty vAsks{ pairPriceQty(OBPrice::fromUnits(102), 10) };
+
+	BookAnalytics ba;
+	ba.update(BookAnalytics::NO_TIME, vBids, vAsks);
+	ba.update(1000, vBids, vAsks);
+
+	bool bPassed = ba.getSpreadMs() == 0 && ba.getTimeWeightedSpread() == ba.getMeanSpread();
+	return report("untimed spread", bPassed, to_string(ba.getSpreadMs()) + " ms of spread, time weighted spread " + to_string(ba.getTimeWeightedSpread()));
+}
+
+void OBCheck::makeRows(uint64_t nSeed, size_t nRows, int nTick, vector<BidAskLevels>& vRows) {
+
+	std::mt19937_64 rng(nSeed);
+	auto draw = [&rng](int nBound) { return static_cast<int>(rng() % static_cast<uint64_t>(nBound)); };
+
+	// A drifting book on the tick grid, with repeated, one-sided and crossed rows, prices off the grid
+	// and prices too far from their row to be laddered
+	int nMid = 100000;
+	vRows.clear();
+	for (size_t i = 0; i < nRows; ++i) {
+		if (!vRows.empty() && draw(8) == 0) {
+			vRows.push_back(vRows.back());
+			continue;
+		}
+
+		nMid += (draw(5) - 2) * nTick;
+
+		BidAskLevels bal;
+		int nBidLevels = draw(12) == 0 ? 0 : 1 + draw(5);
+		int nAskLevels = draw(12) == 0 ? 0 : 1 + draw(5);
+		int nCross = draw(20) == 0 ? 2 * nTick : 0;
+
+		for (int n = 0; n < nBidLevels; ++n)
+			bal.vBidQty.push_back(make_pair(OBPrice::fromUnits(nMid - (n + 1) * nTick + nCross), 100 * (1 + draw(4))));
+		for (int n = 0; n < nAskLevels; ++n)
+			bal.vAskQty.push_back(make_pair(OBPrice::fromUnits(nMid + (n + 1) * nTick), 100 * (1 + draw(4))));
+
+		vecPriceQty& vSide = draw(2) ? bal.vBidQty : bal.vAskQty;
+		if (!vSide.empty() && draw(15) == 0)
+			vSide.back().first = vSide.back().first + OBPrice::fromUnits(1);
+		if (!vSide.empty() && draw(25) == 0)
+			vSide.back().first = vSide.back().first + OBPrice::fromUnits(50000000 * nTick);
+
+		vRows.push_back(bal);
+	}
+}
+
+bool OBCheck::sameChecks(const BookChecks& bc, const BookChecks& bcOther) {
+
+	return bc.nSnapshots == bcOther.nSnapshots && bc.nUnchanged == bcOther.nUnchanged && bc.nCrossed == bcOther.nCrossed && bc.nLocked == bcOther.nLocked
+		&& bc.nOneSided == bcOther.nOneSided && bc.nUnordered == bcOther.nUnordered && bc.nOffLadder == bcOther.nOffLadder
+		&& bc.nBidChanges == bcOther.nBidChanges && bc.nAskChanges == bcOther.nAskChanges;
+}
+
+string OBCheck::formatChecks(const BookChecks& bc) {
+
+	return to_string(bc.nSnapshots) + " rows, " + to_string(bc.nUnchanged) + " unchanged, " + to_string(bc.nCrossed) + " crossed, " + to_string(bc.nLocked) + " locked, "
+		+ to_string(bc.nOneSided) + " one sided, " + to_string(bc.nUnordered) + " unordered, " + to_string(bc.nOffLadder) + " off ladder, "
+		+ to_string(bc.nBidChanges) + " bid and " + to_string(bc.nAskChanges) + " ask changes";
+}
+
+bool OBCheck::checkEngineMerge() {
+
+	const int nTick = 5;
+	vector<BidAskLevels> vRows;
+	makeRows(CHECK_SEED, 20000, nTick, vRows);
+
+	OBBookEngine obeSequential;
+	obeSequential.setTick(nTick);
+	for (const auto& bal : vRows)
+		obeSequential.apply(bal);
+
+	// Chunks end anywhere, a single row or an empty chunk included
+	std::mt19937_64 rng(CHECK_SEED);
+	string szDetail;
+	bool bPassed = true;
+	for (size_t nChunks : { 2, 3, 7, 64, 1000 }) {
+
+		vector<size_t> vEnds;
+		for (size_t i = 1; i < nChunks; ++i)
+			vEnds.push_back(rng() % vRows.size());
+		vEnds.push_back(vRows.size());
+		std::sort(vEnds.begin(), vEnds.end());
+
+		OBBookEngine obeMerged;
+		obeMerged.setTick(nTick);
+		size_t nBeg = 0;
+		for (size_t nEnd : vEnds) {
+			OBBookEngine obeChunk;
+			obeChunk.setTick(nTick);
+			for (size_t i = nBeg; i < nEnd; ++i)
+				obeChunk.apply(vRows[i]);
+			obeMerged.merge(std::move(obeChunk));
+			nBeg = nEnd;
+		}
+
+		bool bSame = sameChecks(obeMerged.getChecks(), obeSequential.getChecks()) && obeMerged.bestBid() == obeSequential.bestBid()
+			&& obeMerged.bestAsk() == obeSequential.bestAsk() && obeMerged.getBookBid() == obeSequential.getBookBid() && obeMerged.getBookAsk() == obeSequential.getBookAsk();
+		if (!bSame)
+			szDetail += to_string(nChunks) + " chunks: " + formatChecks(obeMerged.getChecks()) + "; ";
+		bPassed = bPassed && bSame;
+	}
+
+	return report("engine merge", bPassed, szDetail + "sequential " + formatChecks(obeSequential.getChecks()));
+}
+
+bool OBCheck::checkDelimScan() {
+
+	std::mt19937_64 rng(CHECK_SEED);
+	const char chBytes[] = { ',', ';', '|', '\t', '\n', 'a', '0', '9', ' ', '\0', '\x80', '\xff' };
+	const DelimSet vSets[] = { DelimSet(','), DelimSet(',', ';'), DelimSet(',', ';', '|'), DelimSet('\0', '\xff') };
+
+	OBDelimScan::SCAN_ISA siDetected = OBDelimScan::getIsa();
+	string szDetail;
+	bool bPassed = true;
+
+	for (auto si : { OBDelimScan::SCAN_SCALAR, OBDelimScan::SCAN_SSE2, OBDelimScan::SCAN_AVX2 }) {
+
+		// Instruction sets the processor lacks are not checked
+		if (OBDelimScan::selectIsa(si) != si)
+			continue;
+
+		size_t nMismatches = 0, nRows = 0;
+		for (const auto& ds : vSets) {
+			for (int n = 0; n < 500; ++n, ++nRows) {
+
+				// Rows of any length, so every tail length up to a block is indexed; each row is its own
+				// allocation, ending where the row does
+				vector<char> vRow(rng() % (3 * OBDelimScan::BLOCK_BYTES + 1));
+				for (auto& ch : vRow)
+					ch = chBytes[rng() % sizeof(chBytes)];
+
+				vector<size_t> vExpected;
+				for (size_t i = 0; i < vRow.size(); ++i) {
+					if (vRow[i] == ds.chDelims[0] || vRow[i] == ds.chDelims[1] || vRow[i] == ds.chDelims[2] || vRow[i] == ds.chDelims[3])
+						vExpected.push_back(i);
+				}
+
+				for (size_t nBeg = 0; nBeg < vRow.size(); nBeg += OBDelimScan::BLOCK_BYTES) {
+					size_t nBytes = std::min(OBDelimScan::BLOCK_BYTES, vRow.size() - nBeg);
+
+					uint64_t nExpected = 0;
+					for (size_t i : vExpected) {
+						if (i >= nBeg && i < nBeg + nBytes)
+							nExpected |= static_cast<uint64_t>(1) << (i - nBeg);
+					}
+					if (OBDelimScan::indexBytes(vRow.data() + nBeg, nBytes, ds, si) != nExpected)
+						++nMismatches;
+				}
+
+				const char* pBeg = vRow.data();
+				OBDelimScan scan(pBeg, pBeg + vRow.size(), ds);
+				vector<size_t> vFound;
+				for (const char* p; (p = scan.next()) != nullptr; )
+					vFound.push_back(static_cast<size_t>(p - pBeg));
+				if (vFound != vExpected)
+					++nMismatches;
+
+				// Only the asked delimiter is handed out when the set holds others
+				OBDelimScan scanOne(pBeg, pBeg + vRow.size(), ds);
+				size_t nFound = 0;
+				for (const char* p; (p = scanOne.next(ds.chDelims[1])) != nullptr; ++nFound) {
+					if (*p != ds.chDelims[1])
+						++nMismatches;
+				}
+				if (nFound != static_cast<size_t>(std::count(vRow.begin(), vRow.end(), ds.chDelims[1])))
+					++nMismatches;
+			}
+		}
+
+		szDetail += string(szDetail.empty() ? "" : ", ") + OBDelimScan::getIsaName(si) + " " + to_string(nMismatches) + " mismatches over " + to_string(nRows) + " rows";
+		bPassed = bPassed && nMismatches == 0;
+	}
+
+	OBDelimScan::selectIsa(siDetected);
+	return report("delimiter scan", bPassed, szDetail);
+}
+
+bool OBCheck::checkPriceParse() {
+
+	typedef Price<2> Price2;
+	typedef Price<2, int64_t> Price2L;
+
+	// Text, whether it parses and the units it parses to
+	const struct { const char* szText; bool bParses; int64_t nUnits; } vCases[] = {
+		{ "123", true, 12300 }, { "123.4", true, 12340 }, { "123.45", true, 12345 }, { "123.4500", true, 12345 }, { "0.01", true, 1 }, { "007", true, 700 },
+		{ "123.456", false, 0 }, { "123.451", false, 0 }, { "1.", false, 0 }, { ".5", false, 0 }, { "", false, 0 }, { "1.2.3", false, 0 },
+		{ "-1", false, 0 }, { "+1", false, 0 }, { " 1", false, 0 }, { "1 ", false, 0 }, { "12a", false, 0 }, { "1.2x", false, 0 }, { "1e3", false, 0 },
+		{ "21474836.47", true, 2147483647 }, { "21474836.48", false, 0 }, { "21474837", false, 0 }, { "99999999999999999999999", false, 0 } };
+
+	const struct { const char* szText; bool bParses; int64_t nUnits; } vLongCases[] = {
+		{ "92233720368547758.07", true, std::numeric_limits<int64_t>::max() }, { "92233720368547758.08", false, 0 },
+		{ "92233720368547759", false, 0 }, { "99999999999999999999999", false, 0 }, { "1844674407370955161.6", false, 0 } };
+
+	string szDetail;
+	bool bPassed = true;
+
+	// A failed parse leaves the price as it was
+	for (const auto& pc : vCases) {
+		Price2 pr = Price2::fromUnits(-7);
+		bool bParses = Price2::parse(pc.szText, pc.szText + strlen(pc.szText), pr);
+		if (bParses != pc.bParses || pr.units() != (pc.bParses ? pc.nUnits : -7)) {
+			szDetail += string("\"") + pc.szText + "\" read " + (bParses ? to_string(pr.units()) : string("as invalid")) + "; ";
+			bPassed = false;
+		}
+	}
+
+	for (const auto& pc : vLongCases) {
+		Price2L pr = Price2L::fromUnits(-7);
+		bool bParses = Price2L::parse(pc.szText, pc.szText + strlen(pc.szText), pr);
+		if (bParses != pc.bParses || pr.units() != (pc.bParses ? pc.nUnits : -7)) {
+			szDetail += string("\"") + pc.szText + "\" read " + (bParses ? to_string(pr.units()) : string("as invalid")) + " in 64 bits; ";
+			bPassed = false;
+		}
+	}
+
+	// Prices print back as quoted, without trailing zeros, and mid points take one more decimal
+	const string szLow = "1.01", szHigh = "1.02", szMax = "21474836.47";
+	Price2 prLow, prHigh, prMax;
+	Price2::parse(szLow.data(), szLow.data() + szLow.size(), prLow);
+	Price2::parse(szHigh.data(), szHigh.data() + szHigh.size(), prHigh);
+	Price2::parse(szMax.data(), szMax.data() + szMax.size(), prMax);
+
+	const pair<string, string> vPrinted[] = {
+		{ prLow.toString(), "1.01" }, { Price2::fromUnits(12340).toString(), "123.4" }, { Price2::fromUnits(12300).toString(), "123" },
+		{ Price2::midpoint(prLow, prHigh).toString(), "1.015" }, { Price2::midpoint(prLow, prLow).toString(), "1.01" },
+		{ Price2::midpoint(Price2::fromUnits(-3), Price2::fromUnits(2)).toString(), "-0.005" }, { Price2::midpoint(prMax, prMax).toString(), "21474836.47" },
+		{ Price2::midpoint(prMax, prMax - Price2::fromUnits(1)).toString(), "21474836.465" } };
+
+	for (const auto& pp : vPrinted) {
+		if (pp.first != pp.second) {
+			szDetail += pp.second + " printed as " + pp.first + "; ";
+			bPassed = false;
+		}
+	}
+
+	return report("price parse", bPassed, szDetail + to_string(std::size(vCases) + std::size(vLongCases)) + " prices parsed, " + to_string(std::size(vPrinted)) + " printed");
+}
+
+bool OBCheck::checkFeedErrors() {
+
+	string szData;
+	vector<string_view> vRows;
+	loadRows(m_szFeedDir + "/TSTJ.csv", 0, szData, vRows);
+
+	// The sample rows over and over, a skipped row after every few of them, more than the log holds
+	const string szMalformed = "\"TST.J\"\t\"06/12/2018 07:00:00\"\t\"01000000\"";
+	const string szBadNumber = "\"TST.J\"\t\"06/12/2018 07:00:00\"\t\"01000000\"\t\"0\"\t\"Trading\"\t\"0\"\t\"0\"\t\"1025\"\t\"1\"\t\"850\"\t\"1\"\t"
+		"\"Level: 1 Price: 99999999999999999999 Quantity: 10\"\t\"Level: 1 Price: 1025 Quantity: 10\"";
+
+	string szFeed = string(vRows.front()) + "\n";
+	FeedErrors feExpected;
+	feExpected.nLines = 1;
+
+	for (int nPass = 0; nPass < 3; ++nPass) {
+		for (size_t i = 1; i < vRows.size(); ++i) {
+			szFeed += string(vRows[i]) + "\n";
+			feExpected.nLines++;
+
+			if (i % 3 == 0) {
+				bool bMalformed = (i / 3) % 2 == 0;
+				feExpected.nLines++;
+				feExpected.add(bMalformed ? FeedErrors::FEED_ERROR_MALFORMED : FeedErrors::FEED_ERROR_BADNUMBER, szFeed.size());
+				szFeed += (bMalformed ? szMalformed : szBadNumber) + "\n";
+			}
+		}
+	}
+
+	string szFile = writeFeed("obcheck_errors.csv", szFeed);
+
+	auto sameErrors = [](const FeedErrors& fe, const FeedErrors& feOther) {
+		if (fe.nLines != feOther.nLines || fe.nMalformed != feOther.nMalformed || fe.nBadNumbers != feOther.nBadNumbers || fe.vLog.size() != feOther.vLog.size())
+			return false;
+
+		for (size_t i = 0; i < fe.vLog.size(); ++i) {
+			if (fe.vLog[i].nLine != feOther.vLog[i].nLine || fe.vLog[i].nOffset != feOther.vLog[i].nOffset || fe.vLog[i].fer != feOther.vLog[i].fer)
+				return false;
+		}
+		return true;
+	};
+
+	auto formatErrors = [](const FeedErrors& fe) {
+		return to_string(fe.nLines) + " lines, " + to_string(fe.nMalformed) + " malformed, " + to_string(fe.nBadNumbers) + " bad numbers, "
+			+ to_string(fe.vLog.size()) + " logged" + (fe.vLog.empty() ? string() : " up to line " + to_string(fe.vLog.back().nLine));
+	};
+
+	string szDetail;
+	bool bPassed = feExpected.count() > static_cast<int>(FeedErrors::MAX_FEED_ERRORS) && feExpected.vLog.size() == FeedErrors::MAX_FEED_ERRORS;
+
+	const struct { const char* szName; OBStream::FEED_INPUT_MODE fim; int nThreads; } vReads[] = {
+		{ "stream", OBStream::FEED_INPUT_STREAM, 1 }, { "mapped", OBStream::FEED_INPUT_MAPPED, 1 },
+		{ "chunks", OBStream::FEED_INPUT_MAPPED, 4 }, { "pipeline", OBStream::FEED_INPUT_PIPELINE, 1 } };
+
+	for (const auto& rd : vReads) {
+		int nLevels = MAX_BOOK_LEVELS;
+		OBStreamCSV obs(szFile, nLevels);
+		obs.setInputMode(rd.fim);
+
+		// Chunks far smaller than the feed, so skipped rows fall in most of them
+		obs.setParseThreads(rd.nThreads, 4096);
+		obs.processFeeds();
+		obs.CheckNotifyException();
+
+		if (!sameErrors(obs.getFeedErrors(), feExpected)) {
+			szDetail += string(rd.szName) + " read " + formatErrors(obs.getFeedErrors()) + "; ";
+			bPassed = false;
+		}
+	}
+
+	// Merged errors count every row, log the first ones up to the cap and number their lines from the first part
+	FeedErrors feHead, feTail;
+	feHead.nLines = 10;
+	feHead.add(FeedErrors::FEED_ERROR_MALFORMED, 40);
+	feTail.nLines = 5;
+	feTail.add(FeedErrors::FEED_ERROR_BADNUMBER, 60);
+	feHead.merge(feTail);
+
+	bool bMerged = feHead.nLines == 15 && feHead.count() == 2 && feHead.vLog.size() == 2 && feHead.vLog[0].nLine == 10 && feHead.vLog[1].nLine == 15
+		&& feHead.vLog[1].nOffset == 60 && feHead.vLog[1].fer == FeedErrors::FEED_ERROR_BADNUMBER;
+
+	FeedErrors feFull = feExpected;
+	feFull.merge(feTail);
+	bMerged = bMerged && feFull.count() == feExpected.count() + 1 && feFull.vLog.size() == FeedErrors::MAX_FEED_ERRORS && feFull.nLines == feExpected.nLines + 5;
+
+	if (!bMerged) {
+		szDetail += "merge gave " + formatErrors(feHead) + " and " + formatErrors(feFull) + "; ";
+		bPassed = false;
+	}
+
+	return report("feed errors", bPassed, szDetail + "expected " + formatErrors(feExpected));
+}
+
+void OBCheck::diffLevelSets(const LevelSummary& lsCsv, const LevelSummary& lsLog, vecPriceQty& vpiCsv, vecPriceQty& vpiLog) {
+
+	// The level diff as plotBookLevelsDiff first made it, with maps of sets and their set differences
+	mapPriceQty m1, m2;
+	for (const auto& pi : lsCsv)
+		m1[pi.first].insert(pi.second);
+	for (const auto& pi : lsLog)
+		m2[pi.first].insert(pi.second);
+
+	setPrice keys1, keys2, interKeys, diffKeys1, diffKeys2;
+	std::transform(m1.begin(), m1.end(), std::inserter(keys1, keys1.begin()), [](mapPriceQty::value_type& m) { return m.first; });
+	std::transform(m2.begin(), m2.end(), std::inserter(keys2, keys2.begin()), [](mapPriceQty::value_type& m) { return m.first; });
+
+	std::set_difference(keys1.begin(), keys1.end(), keys2.begin(), keys2.end(), std::inserter(diffKeys1, diffKeys1.begin()));
+	std::set_difference(keys2.begin(), keys2.end(), keys1.begin(), keys1.end(), std::inserter(diffKeys2, diffKeys2.begin()));
+
+	vpiCsv.clear();
+	vpiLog.clear();
+	for (auto& k1 : diffKeys1) {
+		for (int q : m1[k1])
+			vpiCsv.push_back(std::make_pair(-k1, q));
+	}
+	for (auto& k2 : diffKeys2) {
+		for (int q : m2[k2])
+			vpiLog.push_back(std::make_pair(-k2, q));
+	}
+
+	std::set_intersection(keys1.begin(), keys1.end(), keys2.begin(), keys2.end(), std::inserter(interKeys, interKeys.begin()));
+	for (auto& k : interKeys) {
+		setInt q1Diff, q2Diff;
+		std::set_difference(m1[k].begin(), m1[k].end(), m2[k].begin(), m2[k].end(), std::inserter(q1Diff, q1Diff.begin()));
+		std::set_difference(m2[k].begin(), m2[k].end(), m1[k].begin(), m1[k].end(), std::inserter(q2Diff, q2Diff.begin()));
+
+		for (int q : q1Diff)
+			vpiCsv.push_back(std::make_pair(k, q));
+		for (int q : q2Diff)
+			vpiLog.push_back(std::make_pair(k, q));
+	}
+}
+
+bool OBCheck::checkLevelDiff() {
+
+	std::mt19937_64 rng(CHECK_SEED);
+	auto draw = [&rng](int nBound) { return static_cast<int>(rng() % static_cast<uint64_t>(nBound)); };
+
+	size_t nLevels = 0, nOneSided = 0, nMismatches = 0;
+	const LevelSummary lsEmpty;
+
+	for (int nBook = 0; nBook < 500; ++nBook) {
+
+		// Few prices and quantities, so both feeds often show a pair, a price or a whole level alike
+		vecLevels vCsvLevels(draw(6)), vLogLevels(draw(6));
+		for (auto* pvl : { &vCsvLevels, &vLogLevels }) {
+			for (auto& ls : *pvl) {
+				for (int n = draw(30); n > 0; --n)
+					ls.insert(OBPrice::fromUnits(100 + draw(16)), 1 + draw(6));
+
+				// Summaries are diffed as read or as sorted once the feed is read
+				if (draw(2) == 0)
+					ls.sort();
+			}
+		}
+
+		if (draw(4) == 0 && !vCsvLevels.empty() && !vLogLevels.empty()) {
+			vLogLevels[0] = LevelSummary();
+			vLogLevels[0].merge(vCsvLevels[0]);
+		}
+
+		for (size_t i = 0; i < std::max(vCsvLevels.size(), vLogLevels.size()); ++i, ++nLevels) {
+			bool bCsvLevel = i < vCsvLevels.size(), bLogLevel = i < vLogLevels.size();
+
+			LevelDiff ld;
+			OrderPlot::diffLevel(vCsvLevels, vLogLevels, i, ld);
+
+			vecPriceQty vpiCsv, vpiLog;
+			diffLevelSets(bCsvLevel ? vCsvLevels[i] : lsEmpty, bLogLevel ? vLogLevels[i] : lsEmpty, vpiCsv, vpiLog);
+
+			if (ld.iLevel != i || ld.bCsvLevel != bCsvLevel || ld.bLogLevel != bLogLevel || ld.vpiCsv != vpiCsv || ld.vpiLog != vpiLog)
+				++nMismatches;
+
+			// Every pair of a level only one feed reached differs by price
+			if (bCsvLevel != bLogLevel) {
+				const vecPriceQty& vpiOne = bCsvLevel ? ld.vpiCsv : ld.vpiLog;
+				const LevelSummary& lsOne = bCsvLevel ? vCsvLevels[i] : vLogLevels[i];
+				bool bAllPrices = vpiOne.size() == lsOne.size() && (bCsvLevel ? ld.vpiLog : ld.vpiCsv).empty()
+					&& std::all_of(vpiOne.begin(), vpiOne.end(), [](const pairPriceQty& pi) { return pi.first < OBPrice(); });
+				if (!bAllPrices)
+					++nMismatches;
+				++nOneSided;
+			}
+		}
+	}
+
+	return report("level diff", nMismatches == 0, to_string(nMismatches) + " mismatches over " + to_string(nLevels) + " levels, " + to_string(nOneSided) + " reached by one feed");
+}
+
+#ifdef OB_GZIP
+string OBCheck::gzipMember(const char* pData, size_t nBytes) {
+
+	static const string SZ_OBCHECK_GZIPMEMBER = "gzipMember";
+
+	// Window bits plus 16 write a gzip header and trailer around the deflated bytes
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		throw TracedException(SZ_OBCHECK_EXCEPTION, "Cannot start gzip deflation", SZ_OBCHECK_GZIPMEMBER);
+
+	string szMember(deflateBound(&zs, static_cast<uLong>(nBytes)), '\0');
+	zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(pData));
+	zs.avail_in = static_cast<uInt>(nBytes);
+	zs.next_out = reinterpret_cast<Bytef*>(&szMember[0]);
+	zs.avail_out = static_cast<uInt>(szMember.size());
+
+	int nStatus = deflate(&zs, Z_FINISH);
+	szMember.resize(zs.total_out);
+	deflateEnd(&zs);
+
+	if (nStatus != Z_STREAM_END)
+		throw TracedException(SZ_OBCHECK_EXCEPTION, "Cannot deflate gzip member", SZ_OBCHECK_GZIPMEMBER);
+
+	return szMember;
+}
+
+bool OBCheck::inflateFeed(const string& szFile, string& szData, bool& bWholeRows) {
+
+	// Blocks follow each other at their offsets and each but the last ends a row
+	szData.clear();
+	bWholeRows = true;
+	try {
+		OBCompressedFile cf(szFile);
+
+		const char* pData;
+		size_t nBytes;
+		while (cf.next(pData, nBytes)) {
+			bWholeRows = bWholeRows && cf.getOffset() == szData.size() && nBytes > 0 && (szData.empty() || szData.back() == '\n');
+			szData.append(pData, nBytes);
+		}
+	}
+	catch (const TracedException&) {
+		return false;
+	}
+	return true;
+}
+
+bool OBCheck::checkCompressedFeed(const string& szPlainFile) {
+
+	string szPlain;
+	{
+		ifstream file(szPlainFile, ios::binary);
+		stringstream ss;
+		ss << file.rdbuf();
+		szPlain = ss.str();
+	}
+
+	// Members cut in the middle of rows, and a member of nothing
+	std::mt19937_64 rng(CHECK_SEED);
+	vector<size_t> vCuts{ 0, szPlain.size() };
+	for (int i = 0; i < 4; ++i)
+		vCuts.push_back(rng() % szPlain.size());
+	vCuts.push_back(vCuts.back());
+	std::sort(vCuts.begin(), vCuts.end());
+
+	string szMembers;
+	for (size_t i = 1; i < vCuts.size(); ++i)
+		szMembers += gzipMember(szPlain.data() + vCuts[i - 1], vCuts[i] - vCuts[i - 1]);
+
+	string szSingle = gzipMember(szPlain.data(), szPlain.size());
+
+	string szDetail;
+	bool bPassed = true;
+	string szData;
+	bool bWholeRows;
+
+	string szMultiFile = writeFeed("obcheck_multi.csv.gz", szMembers);
+	if (!inflateFeed(szMultiFile, szData, bWholeRows) || szData != szPlain || !bWholeRows) {
+		szDetail += to_string(vCuts.size() - 1) + " members inflated to " + to_string(szData.size()) + " bytes" + (bWholeRows ? "" : " not in whole rows") + "; ";
+		bPassed = false;
+	}
+
+	if (inflateFeed(writeFeed("obcheck_truncated.csv.gz", szSingle.substr(0, szSingle.size() / 2)), szData, bWholeRows) || !bWholeRows) {
+		szDetail += "truncated archive read; ";
+		bPassed = false;
+	}
+
+	if (inflateFeed(writeFeed("obcheck_trailing.csv.gz", szSingle + "trailing garbage\n"), szData, bWholeRows) || !bWholeRows) {
+		szDetail += "trailing garbage read; ";
+		bPassed = false;
+	}
+
+	// The archive makes the book of the plain feed, whatever the blocks it is inflated in
+	auto readFeed = [](const string& szFile) {
+		int nLevels = MAX_BOOK_LEVELS;
+		OBStreamCSV obs(szFile, nLevels);
+		obs.setTickSize(1);
+		obs.processFeeds();
+		obs.CheckNotifyException();
+		return obs.getOrderBook();
+	};
+
+	boost::shared_ptr<OrderBook> pPlain = readFeed(szPlainFile);
+	boost::shared_ptr<OrderBook> pInflated = readFeed(szMultiFile);
+	pInflated->szSourceFeed = pPlain->szSourceFeed;
+	if (!sameLevels(pInflated->vecBidLevels, pPlain->vecBidLevels) || !sameLevels(pInflated->vecAskLevels, pPlain->vecAskLevels)
+		|| pInflated->vecBidTotal != pPlain->vecBidTotal || pInflated->vecAskTotal != pPlain->vecAskTotal || pInflated->feedErrors.nLines != pPlain->feedErrors.nLines
+		|| formatBook(*pInflated) != formatBook(*pPlain)) {
+		szDetail += "archive read " + to_string(pInflated->nBookFeeds) + " rows into another book; ";
+		bPassed = false;
+	}
+
+	return report("compressed feed", bPassed, szDetail + to_string(szPlain.size()) + " bytes in " + to_string(vCuts.size() - 1) + " members of " + to_string(szMembers.size()) + " bytes");
+}
+#endif
+
+bool OBCheck::checkBestSpreads() {
+
+	std::mt19937_64 rng(CHECK_SEED);
+	auto draw = [&rng](int nBound) { return static_cast<int>(rng() % static_cast<uint64_t>(nBound)); };
+
+	// Few spreads and bids so they tie often; the quantity tells each ladder from the others
+	struct SpreadRow { OBPrice prSpread; OBPrice prBid; BidAskLevels bal; };
+	vector<SpreadRow> vRows(5000);
+	for (size_t i = 0; i < vRows.size(); ++i) {
+		SpreadRow& sr = vRows[i];
+		sr.prSpread = OBPrice::fromUnits(1 + draw(40));
+		sr.prBid = OBPrice::fromUnits(100 + draw(8));
+		sr.bal.vBidQty.push_back(make_pair(sr.prBid, static_cast<int>(i)));
+		sr.bal.vAskQty.push_back(make_pair(sr.prBid + sr.prSpread, static_cast<int>(i)));
+	}
+
+	auto sameSpreads = [](const BestSpreads& bs, const vector<BestSpread>& vExpected) {
+		return bs.size() == vExpected.size() && std::equal(bs.begin(), bs.end(), vExpected.begin(), [](const BestSpread& b1, const BestSpread& b2) {
+			return b1.prSpread == b2.prSpread && b1.prBidPrice == b2.prBidPrice && b1.bal.vBidQty == b2.bal.vBidQty && b1.bal.vAskQty == b2.bal.vAskQty; });
+	};
+
+	string szDetail;
+	bool bPassed = true;
+
+	for (int nCapacity : { 0, 1, 5, 10, 64 }) {
+
+		// Each distinct spread with its lowest bid and the last ladder at it, the tightest first
+		map<OBPrice, BestSpread> mapAll;
+		for (const auto& sr : vRows) {
+			auto it = mapAll.find(sr.prSpread);
+			if (it == mapAll.end())
+				mapAll.emplace(sr.prSpread, BestSpread{ sr.prSpread, sr.prBid, sr.bal });
+			else if (sr.prBid <= it->second.prBidPrice)
+				it->second = BestSpread{ sr.prSpread, sr.prBid, sr.bal };
+		}
+
+		vector<BestSpread> vExpected;
+		for (auto it = mapAll.begin(); it != mapAll.end() && vExpected.size() < static_cast<size_t>(nCapacity); ++it)
+			vExpected.push_back(it->second);
+
+		BestSpreads bsSequential;
+		bsSequential.setCapacity(nCapacity);
+		for (const auto& sr : vRows)
+			bsSequential.update(sr.prSpread, sr.prBid, sr.bal);
+
+		if (!sameSpreads(bsSequential, vExpected)) {
+			szDetail += "top " + to_string(nCapacity) + " kept other spreads; ";
+			bPassed = false;
+		}
+
+		// Chunks merged in row order, an empty one included
+		for (size_t nChunks : { 2, 7, 100 }) {
+			vector<size_t> vEnds{ 0, vRows.size() };
+			for (size_t i = 1; i < nChunks; ++i)
+				vEnds.push_back(rng() % vRows.size());
+			std::sort(vEnds.begin(), vEnds.end());
+
+			BestSpreads bsMerged;
+			bsMerged.setCapacity(nCapacity);
+			for (size_t i = 1; i < vEnds.size(); ++i) {
+				BestSpreads bsChunk;
+				bsChunk.setCapacity(nCapacity);
+				for (size_t n = vEnds[i - 1]; n < vEnds[i]; ++n)
+					bsChunk.update(vRows[n].prSpread, vRows[n].prBid, vRows[n].bal);
+				bsMerged.merge(bsChunk);
+			}
+
+			if (!sameSpreads(bsMerged, vExpected)) {
+				szDetail += "top " + to_string(nCapacity) + " merged from " + to_string(nChunks) + " chunks kept other spreads; ";
+				bPassed = false;
+			}
+		}
+
+		// Fewer spreads asked for keeps the tightest of them
+		if (nCapacity > 1) {
+			bsSequential.setCapacity(nCapacity / 2);
+			vExpected.resize(nCapacity / 2);
+			if (!sameSpreads(bsSequential, vExpected)) {
+				szDetail += "top " + to_string(nCapacity) + " cut to " + to_string(nCapacity / 2) + " kept other spreads; ";
+				bPassed = false;
+			}
+		}
+	}
+
+	return report("best spreads", bPassed, szDetail + to_string(vRows.size()) + " spreads logged");
+}
+
+bool OBCheck::checkPerfectHash() {
+
+	std::mt19937_64 rng(CHECK_SEED);
+	string szDetail;
+	bool bPassed = true;
+
+	OBPerfectHash ph;
+	for (size_t nKeys : { 0, 1, 2, 7, 100, 5000 }) {
+
+		// RICs and instrument ids as the feeds key their rows, an empty key now and then
+		set<string> setKeys;
+		vector<string> vKeys;
+		while (vKeys.size() < nKeys) {
+			string szKey = (rng() % 2) ? to_string(317837590000ULL + rng() % 1000000) : string(1, static_cast<char>('A' + rng() % 26)) + to_string(rng() % 100000) + ".J";
+			if (rng() % 50 == 0)
+				vKeys.push_back(string());
+			else if (setKeys.insert(szKey).second)
+				vKeys.push_back(szKey);
+		}
+
+		// The hash is built over the keys of the size before
+		ph.build(vKeys);
+
+		size_t nMissed = 0, nFound = 0;
+		for (size_t i = 0; i < vKeys.size(); ++i) {
+			int iExpected = vKeys[i].empty() ? OBPerfectHash::NO_KEY : static_cast<int>(i);
+			if (ph.find(vKeys[i]) != iExpected)
+				++nMissed;
+
+			// Keys a row may hold that were not built, next to the ones that were
+			if (!vKeys[i].empty()) {
+				for (const string& szOther : { vKeys[i] + " ", vKeys[i].substr(1), vKeys[i].substr(0, vKeys[i].size() - 1), vKeys[i] + vKeys[i] }) {
+					if (setKeys.count(szOther) == 0 && ph.find(szOther) != OBPerfectHash::NO_KEY)
+						++nFound;
+				}
+			}
+		}
+
+		if (ph.find(string_view()) != OBPerfectHash::NO_KEY || ph.find("TST.J") != OBPerfectHash::NO_KEY)
+			++nFound;
+
+		if (nMissed > 0 || nFound > 0) {
+			szDetail += to_string(nKeys) + " keys: " + to_string(nMissed) + " not found at their position, " + to_string(nFound) + " absent keys found; ";
+			bPassed = false;
+		}
+	}
+
+	// A key given twice cannot be told from itself, two empty keys are both left out
+	bool bThrown = false;
+	try {
+		ph.build({ "TST.J", "317837590261", "TST.J" });
+	}
+	catch (const TracedException&) {
+		bThrown = true;
+	}
+
+	ph.build({ "", "TST.J", "" });
+	if (!bThrown || ph.find("TST.J") != 1 || ph.find("") != OBPerfectHash::NO_KEY) {
+		szDetail += string(bThrown ? "" : "duplicate key accepted; ") + "empty keys build gave " + to_string(ph.find("TST.J")) + "; ";
+		bPassed = false;
+	}
+
+	return report("perfect hash", bPassed, szDetail + "up to 5000 keys");
+}
+
+void OBCheck::generateFeeds(string& szCsvFile, string& szLogFile, OBFeedGen::GenCounts& gc) const {
+
+	OBFeedGen::GenParams gp;
+	gp.nRows = 20000;
+	gp.nInstruments = 1;
+	gp.nVolatility = 3;
+	gp.nSeed = CHECK_SEED;
+
+	szCsvFile = m_szWorkDir + "/obcheck_gen.csv";
+	szLogFile = m_szWorkDir + "/obcheck_gen.log";
+
+	OBFeedGen(gp).generate(szCsvFile, szLogFile, gc);
+}
+
+bool OBCheck::checkReconcile(const string& szCsvFile, const string& szLogFile, const OBFeedGen::GenCounts& gc) {
+
+	auto formatCounts = [](const ReconCounts& rc) {
+		return "csv " + to_string(rc.nCsvBooks) + ", log " + to_string(rc.nLogBooks) + ", matched " + to_string(rc.nMatched)
+			+ ", csv only " + to_string(rc.nCsvOnly) + ", log only " + to_string(rc.nLogOnly);
+	};
+
+	auto runReconcile = [this](const string& szCsv, const string& szLog, int nToleranceMs, int nLogOffsetMs, int nWindowMs, ReconCounts& rc, vector<string>& vWindows) {
+		int nCsvLevels = MAX_BOOK_LEVELS;
+		int nLogLevels = MAX_BOOK_LEVELS;
+		OBStreamCSV obsCsv(szCsv, nCsvLevels);
+		OBStreamLog obsLog(szLog, nLogLevels);
+
+		OBReconcile rec(obsCsv, obsLog, m_szWorkDir + "/obcheck_diff.log");
+		rec.setTolerance(nToleranceMs);
+		rec.setLogOffset(nLogOffsetMs);
+		rec.setWindow(nWindowMs);
+		rec.reconcile();
+		rec.CheckNotifyException();
+		rc = rec.getTotals();
+
+		// Window summaries of the diff file, the books they count are checked against the totals
+		vWindows.clear();
+		ifstream file(rec.getDiffFile());
+		for (string szLine; getline(file, szLine); ) {
+			if (szLine.compare(0, 7, "Window ") == 0)
+				vWindows.push_back(szLine);
+		}
+	};
+
+	string szDetail;
+	bool bPassed = true;
+
+	// The csv feed shows whole seconds and the log feed the same books within the next one, save the injected divergences
+	ReconCounts rc;
+	vector<string> vWindows;
+	runReconcile(szCsvFile, szLogFile, 1000, 0, 60000, rc, vWindows);
+
+	ReconCounts rcExpected;
+	rcExpected.nCsvBooks = static_cast<int>(gc.nCsvRows);
+	rcExpected.nLogBooks = static_cast<int>(gc.nLogRows);
+	rcExpected.nCsvOnly = static_cast<int>(gc.csvOnly());
+	rcExpected.nLogOnly = static_cast<int>(gc.logOnly());
+	rcExpected.nMatched = rcExpected.nCsvBooks - rcExpected.nCsvOnly;
+
+	if (formatCounts(rc) != formatCounts(rcExpected) || vWindows.empty()) {
+		szDetail += "generated feeds gave " + formatCounts(rc) + " over " + to_string(vWindows.size()) + " windows, expected " + formatCounts(rcExpected) + "; ";
+		bPassed = false;
+	}
+
+	// Six books a minute apart in two windows, the csv feed repeating its first one, the log feed showing each a second
+	// later but the fifth one and a half seconds later
+	auto csvRow = [](const char* szTime, int nBidQty) {
+		return "\"TST.J\"\t\"06/12/2018 " + string(szTime) + "\"\t\"01000000\"\t\"0\"\t\"Continuous\"\t\"0\"\t\"0\"\t\"1025\"\t\"10\"\t\"850\"\t\""
+			+ to_string(nBidQty) + "\"\t\"Level: 1 Price: 850 Quantity: " + to_string(nBidQty) + "\"\t\"Level: 1 Price: 1025 Quantity: 10\"\n";
+	};
+	auto logRow = [](const char* szTime, int nBidQty) {
+		return "DBG 20180612-" + string(szTime) + " [24] Sending mdata update - InstrumentId{317837590261}, TradingStatus{1}, DataQuality{1}, Bid{850,"
+			+ to_string(nBidQty) + "}, Ask{1025,10}, BidBook{850," + to_string(nBidQty) + "}, AskBook{1025,10}\n";
+	};
+
+	string szCsv = "\"RIC\"\t\"TimeUtc\"\t\"Flags\"\t\"VolumeAccumulated\"\t\"TradingStatus\"\t\"LatestTradePrice\"\t\"LatestTradeSize\"\t"
+		"\"BestAskPrice\"\t\"BestAskSize\"\t\"BestBidPrice\"\t\"BestBidSize\"\t\"BidOrderBook\"\t\"AskOrderBook\"\n";
+	szCsv += csvRow("07:00:00", 100) + csvRow("07:00:05", 100) + csvRow("07:00:10", 200) + csvRow("07:00:20", 300)
+		+ csvRow("07:01:00", 400) + csvRow("07:01:10", 500) + csvRow("07:01:20", 600);
+
+	string szLog = logRow("07:00:01.000", 100) + logRow("07:00:11.000", 200) + logRow("07:00:21.000", 300)
+		+ logRow("07:01:01.000", 400) + logRow("07:01:11.500", 500) + logRow("07:01:21.000", 600);
+
+	string szSmallCsv = writeFeed("obcheck_recon.csv", szCsv);
+	string szSmallLog = writeFeed("obcheck_recon.log", szLog);
+
+	const struct { int nToleranceMs; int nLogOffsetMs; int nWindowMs; int nMatched; const char* szWindow; } vRuns[] = {
+		{ 1000, 0, 60000, 5, "Window 2018-06-12 07:01:00.000 to 2018-06-12 07:02:00.000: csv 3, log 3, matched 2, csv only 1, log only 1" },
+		{ 999, 0, 60000, 0, "Window 2018-06-12 07:00:00.000 to 2018-06-12 07:01:00.000: csv 3, log 3, matched 0, csv only 3, log only 3" },
+		{ 0, -1000, 60000, 5, "Window 2018-06-12 07:01:00.000 to 2018-06-12 07:02:00.000: csv 3, log 3, matched 2, csv only 1, log only 1" },
+		{ 500, -1000, 60000, 6, nullptr },
+		{ 1000, -2000, 60000, 6, nullptr },
+		{ 1000, 0, 10000, 5, "Window 2018-06-12 07:01:10.000 to 2018-06-12 07:01:20.000: csv 1, log 1, matched 0, csv only 1, log only 1" } };
+
+	for (const auto& rn : vRuns) {
+		runReconcile(szSmallCsv, szSmallLog, rn.nToleranceMs, rn.nLogOffsetMs, rn.nWindowMs, rc, vWindows);
+
+		rcExpected = ReconCounts();
+		rcExpected.nCsvBooks = rcExpected.nLogBooks = 6;
+		rcExpected.nMatched = rn.nMatched;
+		rcExpected.nCsvOnly = rcExpected.nLogOnly = 6 - rn.nMatched;
+
+		bool bWindows = (rn.szWindow == nullptr) ? vWindows.empty() : !vWindows.empty() && vWindows.front() == rn.szWindow;
+		if (formatCounts(rc) != formatCounts(rcExpected) || !bWindows) {
+			szDetail += "tolerance " + to_string(rn.nToleranceMs) + " ms, log offset " + to_string(rn.nLogOffsetMs) + " ms, window " + to_string(rn.nWindowMs)
+				+ " ms gave " + formatCounts(rc) + (vWindows.empty() ? string() : ", " + vWindows.front()) + "; ";
+			bPassed = false;
+		}
+	}
+
+	return report("reconcile", bPassed, szDetail + to_string(gc.nCsvRows) + " generated rows, " + to_string(gc.csvOnly()) + " csv only, " + to_string(gc.logOnly()) + " log only");
+}
+
+bool OBCheck::sameLevels(const vecLevels& vl, const vecLevels& vlOther) {
+
+	if (vl.size() != vlOther.size())
+		return false;
+
+	for (size_t i = 0; i < vl.size(); ++i) {
+		if (vl[i].pairs() != vlOther[i].pairs())
+			return false;
+	}
+	return true;
+}
+
+string OBCheck::formatBook(const OrderBook& ob) const {
+
+	// The json report holds the checks, the last best prices, the analytics and the best spreads of a book
+	string szFile = m_szWorkDir + "/obcheck_book.jsonl";
+	{
+		OBJsonEmitter je(szFile);
+		je.beginReport("");
+		je.emitBook(REPORT_CSV, ob, ob.bestSpreads.getCapacity());
+		je.endReport();
+	}
+
+	ifstream file(szFile, ios::binary);
+	stringstream ss;
+	ss << file.rdbuf();
+	return ss.str();
+}
+
+template <class S>
+bool OBCheck::checkChunkedRead(const string& szFile) {
+
+	auto readFeed = [&szFile](int nThreads, size_t nChunkBytes) {
+		int nLevels = MAX_BOOK_LEVELS;
+		S obs(szFile, nLevels);
+		obs.setInputMode(OBStream::FEED_INPUT_MAPPED);
+		obs.setParseThreads(nThreads, nChunkBytes);
+		obs.setTickSize(1);
+		obs.processFeeds();
+		obs.CheckNotifyException();
+		return obs.getOrderBook();
+	};
+
+	boost::shared_ptr<OrderBook> pSequential = readFeed(1, 0);
+	const OrderBook& obSequential = *pSequential;
+	string szSequential = formatBook(obSequential);
+
+	string szDetail;
+	bool bPassed = obSequential.nBookFeeds > 0;
+
+	// One chunk per thread, then chunks so small that most rows of a chunk continue the book of the one before
+	const pair<int, size_t> vReads[] = { { 2, 0 }, { 4, 0 }, { 3, 1 << 16 }, { 8, 4096 } };
+
+	for (const auto& rd : vReads) {
+		boost::shared_ptr<OrderBook> pChunked = readFeed(rd.first, rd.second);
+		const OrderBook& ob = *pChunked;
+
+		string szDiffers;
+		if (ob.nBookFeeds != obSequential.nBookFeeds || ob.vecBidTotal != obSequential.vecBidTotal || ob.vecAskTotal != obSequential.vecAskTotal)
+			szDiffers += " totals";
+		if (!sameLevels(ob.vecBidLevels, obSequential.vecBidLevels) || !sameLevels(ob.vecAskLevels, obSequential.vecAskLevels))
+			szDiffers += " levels";
+		if (ob.feedErrors.count() != obSequential.feedErrors.count() || ob.feedErrors.nLines != obSequential.feedErrors.nLines)
+			szDiffers += " errors";
+		if (formatBook(ob) != szSequential)
+			szDiffers += " checks, spreads or analytics";
+
+		if (!szDiffers.empty()) {
+			szDetail += to_string(rd.first) + " threads, " + to_string(rd.second) + " byte chunks differ in" + szDiffers + "; ";
+			bPassed = false;
+		}
+	}
+
+	string szName = szFile.substr(szFile.find_last_of("/\\") + 1);
+	return report("chunked read " + szName, bPassed, szDetail + to_string(obSequential.nBookFeeds) + " rows, " + to_string(obSequential.bestSpreads.size()) + " best spreads, "
+		+ formatChecks(obSequential.bookEngine.getChecks()));
+}
+
+int main(int argc, char* argv[])
+{
+	string szFeedDir = (argc > 1) ? argv[1] : OB_BENCH_FEED_DIR;
+	string szWorkDir = (argc > 2) ? argv[2] : ".";
+
+	int nFailed = 0;
+	try {
+		OBCheck obc(szFeedDir, szWorkDir);
+		nFailed += obc.checkRowAllocs<OBStreamCSV>("TSTJ.csv", 1) ? 0 : 1;
+		nFailed += obc.checkRowAllocs<OBStreamLog>("TSTJ.log", 0) ? 0 : 1;
+		nFailed += obc.checkUntimedSpread() ? 0 : 1;
+		nFailed += obc.checkEngineMerge() ? 0 : 1;
+		nFailed += obc.checkDelimScan() ? 0 : 1;
+		nFailed += obc.checkPriceParse() ? 0 : 1;
+		nFailed += obc.checkFeedErrors() ? 0 : 1;
+		nFailed += obc.checkLevelDiff() ? 0 : 1;
+		nFailed += obc.checkBestSpreads() ? 0 : 1;
+		nFailed += obc.checkPerfectHash() ? 0 : 1;
+
+		string szCsvFile, szLogFile;
+		OBFeedGen::GenCounts gc;
+		obc.generateFeeds(szCsvFile, szLogFile, gc);
+		nFailed += obc.checkChunkedRead<OBStreamCSV>(szCsvFile) ? 0 : 1;
+		nFailed += obc.checkChunkedRead<OBStreamLog>(szLogFile) ? 0 : 1;
+		nFailed += obc.checkReconcile(szCsvFile, szLogFile, gc) ? 0 : 1;
+#ifdef OB_GZIP
+		nFailed += obc.checkCompressedFeed(szCsvFile) ? 0 : 1;
+#endif
+	}
+	catch (const TracedException& te) {
+		te.coutException();
+		return 2;
+	}
+	catch (const std::exception& e) {
+		cout << e.what() << endl;
+		return 2;
+	}
+
+	return (nFailed > 0) ? 1 : 0;
+}
@@ -0,0 +1,359 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Synthetic csv and log source feeds with injected divergences
+//==============================================================
+#include "pch.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+
+using namespace std;
+
+#include "TracedException.hpp"
+#include "OrderGen.hpp"
+
+namespace {
+
+	void appendInt(string& szBuf, uint64_t n) {
+		char chDigits[20];
+		int nDigits = 0;
+		do {
+			chDigits[nDigits++] = static_cast<char>('0' + n % 10);
+			n /= 10;
+		} while (n != 0);
+
+		while (nDigits > 0)
+			szBuf += chDigits[--nDigits];
+	}
+
+	void appendFixed(string& szBuf, int n, int nWidth) {
+		char chDigits[8];
+		for (int i = nWidth - 1; i >= 0; --i, n /= 10)
+			chDigits[i] = static_cast<char>('0' + n % 10);
+		szBuf.append(chDigits, nWidth);
+	}
+
+	// Calendar date of a day count since 1970-01-01
+	void civilFromDays(long long nDays, int& nYear, int& nMonth, int& nDay) {
+		nDays += 719468;
+		long long nEra = (nDays >= 0 ? nDays : nDays - 146096) / 146097;
+		long long nDayOfEra = nDays - nEra * 146097;
+		long long nYearOfEra = (nDayOfEra - nDayOfEra / 1460 + nDayOfEra / 36524 - nDayOfEra / 146096) / 365;
+		long long nDayOfYear = nDayOfEra - (365 * nYearOfEra + nYearOfEra / 4 - nYearOfEra / 100);
+		long long nMarchMonth = (5 * nDayOfYear + 2) / 153;
+
+		nDay = static_cast<int>(nDayOfYear - (153 * nMarchMonth + 2) / 5 + 1);
+		nMonth = static_cast<int>(nMarchMonth < 10 ? nMarchMonth + 3 : nMarchMonth - 9);
+		nYear = static_cast<int>(nYearOfEra + nEra * 400 + (nMonth <= 2 ? 1 : 0));
+	}
+
+	struct GenTime {
+		int		nYear, nMonth, nDay, nHour, nMin, nSec, nMs;
+
+		explicit GenTime(long long nTimeMs) {
+			long long nDays = nTimeMs / 86400000LL;
+			long long nMsOfDay = nTimeMs % 86400000LL;
+			civilFromDays(nDays, nYear, nMonth, nDay);
+			nHour = static_cast<int>(nMsOfDay / 3600000);
+			nMin = static_cast<int>(nMsOfDay / 60000 % 60);
+			nSec = static_cast<int>(nMsOfDay / 1000 % 60);
+			nMs = static_cast<int>(nMsOfDay % 1000);
+		}
+	};
+}
+
+OBFeedGen::OBFeedGen(const GenParams& gp) : m_gp(gp), m_nState(gp.nSeed) {
+
+	m_gp.nInstruments = std::max(m_gp.nInstruments, 1);
+	m_gp.nDepth = std::max(m_gp.nDepth, 1);
+	m_gp.nVolatility = std::max(m_gp.nVolatility, 0);
+
+	// Instruments trade apart from one another, each with a ladder of its own
+	m_vBooks.resize(m_gp.nInstruments);
+	for (int i = 0; i < m_gp.nInstruments; ++i) {
+
+		GenBook& gb = m_vBooks[i];
+		gb.nMid = 1000 + 250 * i;
+		gb.nVolume = 0;
+
+		gb.vBidQty.resize(m_gp.nDepth);
+		gb.vAskQty.resize(m_gp.nDepth);
+		for (int l = 0; l < m_gp.nDepth; ++l) {
+			gb.vBidQty[l] = LOT_SIZE * random(1, MAX_LOTS);
+			gb.vAskQty[l] = LOT_SIZE * random(1, MAX_LOTS);
+		}
+
+		gb.vBidPrice.resize(m_gp.nDepth);
+		gb.vAskPrice.resize(m_gp.nDepth);
+		update(gb);
+	}
+}
+
+bool OBFeedGen::parseOption(const string& szOption, const string& szValue, GenParams& gp) {
+
+	if (szOption == "--rows")					gp.nRows = strtoull(szValue.c_str(), nullptr, 10);
+	else if (szOption == "--instruments")		gp.nInstruments = atoi(szValue.c_str());
+	else if (szOption == "--depth")				gp.nDepth = atoi(szValue.c_str());
+	else if (szOption == "--volatility")		gp.nVolatility = atoi(szValue.c_str());
+	else if (szOption == "--diverge-rate")		gp.dDivergeRate = atof(szValue.c_str());
+	else if (szOption == "--seed")				gp.nSeed = strtoull(szValue.c_str(), nullptr, 10);
+	else
+		return false;
+
+	return true;
+}
+
+uint64_t OBFeedGen::random() {
+
+	// splitmix64, so a seed gives the same feeds with any standard library
+	uint64_t n = (m_nState += 0x9e3779b97f4a7c15ULL);
+	n = (n ^ (n >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	n = (n ^ (n >> 27)) * 0x94d049bb133111ebULL;
+	return n ^ (n >> 31);
+}
+
+void OBFeedGen::update(GenBook& gb) {
+
+	// Move the price and keep the ladder clear of zero
+	gb.nMid += random(-m_gp.nVolatility, m_gp.nVolatility);
+	gb.nMid = std::max(gb.nMid, 8 * m_gp.nDepth + 10);
+
+	int nHalfSpread = random(1, 2);
+	int nBid = gb.nMid - nHalfSpread;
+	int nAsk = gb.nMid + nHalfSpread;
+	for (int l = 0; l < m_gp.nDepth; ++l) {
+		gb.vBidPrice[l] = nBid;
+		gb.vAskPrice[l] = nAsk;
+		nBid -= random(1, 3);
+		nAsk += random(1, 3);
+	}
+
+	// One level of each side changes size, and so does the best bid so no update repeats the book before it
+	gb.vBidQty[random(0, m_gp.nDepth - 1)] = LOT_SIZE * random(1, MAX_LOTS);
+	gb.vAskQty[random(0, m_gp.nDepth - 1)] = LOT_SIZE * random(1, MAX_LOTS);
+
+	int nBidQty = LOT_SIZE * random(1, MAX_LOTS);
+	if (nBidQty == gb.vBidQty[0])
+		nBidQty = (nBidQty == LOT_SIZE * MAX_LOTS) ? LOT_SIZE : nBidQty + LOT_SIZE;
+	gb.vBidQty[0] = nBidQty;
+
+	gb.nVolume += LOT_SIZE;
+}
+
+void OBFeedGen::appendCsvRow(string& szBuf, int nInstrument, const GenBook& gb, long long nTimeMs) const {
+
+	GenTime gt(nTimeMs);
+
+	szBuf += "\"GEN";
+	appendInt(szBuf, nInstrument);
+	szBuf += ".J\"\t\"";
+	appendFixed(szBuf, gt.nMonth, 2);
+	szBuf += '/';
+	appendFixed(szBuf, gt.nDay, 2);
+	szBuf += '/';
+	appendFixed(szBuf, gt.nYear, 4);
+	szBuf += ' ';
+	appendFixed(szBuf, gt.nHour, 2);
+	szBuf += ':';
+	appendFixed(szBuf, gt.nMin, 2);
+	szBuf += ':';
+	appendFixed(szBuf, gt.nSec, 2);
+	szBuf += "\"\t\"00100000\"\t\"";
+	appendInt(szBuf, gb.nVolume);
+	szBuf += "\"\t\"Continuous\"\t\"";
+	appendInt(szBuf, gb.vBidPrice[0]);
+	szBuf += "\"\t\"";
+	appendInt(szBuf, LOT_SIZE);
+
+	// Best ask and bid columns, then the books
+	const int* pBest[] = { &gb.vAskPrice[0], &gb.vAskQty[0], &gb.vBidPrice[0], &gb.vBidQty[0] };
+	for (const int* p : pBest) {
+		szBuf += "\"\t\"";
+		appendInt(szBuf, *p);
+	}
+
+	const vector<int>* pSides[][2] = { { &gb.vBidPrice, &gb.vBidQty }, { &gb.vAskPrice, &gb.vAskQty } };
+	for (const auto& side : pSides) {
+		szBuf += "\"\t\"";
+		for (int l = 0; l < m_gp.nDepth; ++l) {
+			szBuf += (l == 0) ? "Level: " : "| Level: ";
+			appendInt(szBuf, l + 1);
+			szBuf += " Price: ";
+			appendInt(szBuf, (*side[0])[l]);
+			szBuf += " Quantity: ";
+			appendInt(szBuf, (*side[1])[l]);
+		}
+	}
+
+	szBuf += "\"\n";
+}
+
+void OBFeedGen::appendLogRow(string& szBuf, int nInstrument, const GenBook& gb, long long nTimeMs) const {
+
+	GenTime gt(nTimeMs);
+
+	szBuf += "DBG ";
+	appendFixed(szBuf, gt.nYear, 4);
+	appendFixed(szBuf, gt.nMonth, 2);
+	appendFixed(szBuf, gt.nDay, 2);
+	szBuf += '-';
+	appendFixed(szBuf, gt.nHour, 2);
+	szBuf += ':';
+	appendFixed(szBuf, gt.nMin, 2);
+	szBuf += ':';
+	appendFixed(szBuf, gt.nSec, 2);
+	szBuf += '.';
+	appendFixed(szBuf, gt.nMs, 3);
+	szBuf += " [24] Sending mdata update - InstrumentId{";
+	appendInt(szBuf, 317837590261ULL + nInstrument);
+	szBuf += "}, TradingStatus{1}, DataQuality{1}, Bid{";
+	appendInt(szBuf, gb.vBidPrice[0]);
+	szBuf += ',';
+	appendInt(szBuf, gb.vBidQty[0]);
+	szBuf += "}, Ask{";
+	appendInt(szBuf, gb.vAskPrice[0]);
+	szBuf += ',';
+	appendInt(szBuf, gb.vAskQty[0]);
+
+	const char* szTags[] = { "}, BidBook{", "}, AskBook{" };
+	const vector<int>* pSides[][2] = { { &gb.vBidPrice, &gb.vBidQty }, { &gb.vAskPrice, &gb.vAskQty } };
+	for (int s = 0; s < 2; ++s) {
+		szBuf += szTags[s];
+		for (int l = 0; l < m_gp.nDepth; ++l) {
+			if (l > 0)
+				szBuf += "; ";
+			appendInt(szBuf, (*pSides[s][0])[l]);
+			szBuf += ',';
+			appendInt(szBuf, (*pSides[s][1])[l]);
+		}
+	}
+
+	szBuf += "}\n";
+}
+
+void OBFeedGen::generate(const string& szCsvFile, const string& szLogFile, GenCounts& gc) {
+
+	static const string SZ_OBFEEDGEN_GENERATE = "generate";
+
+	ofstream ofsCsv(szCsvFile, ios::binary | ios::trunc);
+	ofstream ofsLog(szLogFile, ios::binary | ios::trunc);
+	if (!ofsCsv || !ofsLog)
+		throw TracedException(SZ_OBFEEDGEN_EXCEPTION, "Cannot create feeds " + szCsvFile + " and " + szLogFile, SZ_OBFEEDGEN_GENERATE);
+
+	string szCsv, szLog;
+	szCsv.reserve(FLUSH_BYTES + 4096);
+	szLog.reserve(FLUSH_BYTES + 4096);
+
+	szCsv += "\"RIC\"\t\"TimeUtc\"\t\"Flags\"\t\"VolumeAccumulated\"\t\"TradingStatus\"\t\"LatestTradePrice\"\t\"LatestTradeSize\"\t"
+		"\"BestAskPrice\"\t\"BestAskSize\"\t\"BestBidPrice\"\t\"BestBidSize\"\t\"BidOrderBook\"\t\"AskOrderBook\"\n";
+
+	long long nTimeMs = START_TIME_MS;
+	double dDiverge = 0;
+	uint64_t nDiverged = 0;
+
+	for (uint64_t nRow = 0; nRow < m_gp.nRows; ++nRow) {
+
+		int nInstrument = static_cast<int>(nRow % m_gp.nInstruments);
+		GenBook& gb = m_vBooks[nInstrument];
+		update(gb);
+
+		// The csv feed has whole seconds only, the log one keeps the milliseconds
+		nTimeMs += random(0, 2 * MEAN_GAP_MS);
+		appendCsvRow(szCsv, nInstrument, gb, nTimeMs);
+		gc.nCsvRows++;
+
+		// Spread the divergences evenly over the updates
+		dDiverge += m_gp.dDivergeRate;
+		if (dDiverge < 1.0) {
+			appendLogRow(szLog, nInstrument, gb, nTimeMs);
+			gc.nLogRows++;
+		}
+		else {
+			dDiverge -= 1.0;
+
+			// Odd quantities are never generated, so a diverged book matches no other
+			GEN_DIVERGENCE gd = static_cast<GEN_DIVERGENCE>(nDiverged++ % GEN_DIVERGE_KINDS);
+			GenBook gbLog = gb;
+			switch (gd) {
+			case GEN_DIVERGE_CHANGED:
+				gbLog.vBidQty[0]++;
+				appendLogRow(szLog, nInstrument, gbLog, nTimeMs);
+				gc.nLogRows++;
+				break;
+
+			case GEN_DIVERGE_DROPPED:
+				break;
+
+			default:
+				appendLogRow(szLog, nInstrument, gb, nTimeMs);
+				gbLog.vAskQty[0]++;
+				appendLogRow(szLog, nInstrument, gbLog, nTimeMs);
+				gc.nLogRows += 2;
+				break;
+			}
+			gc.nDiverged[gd]++;
+		}
+
+		if (szCsv.size() >= FLUSH_BYTES)
+			flush(ofsCsv, szCsv, szCsvFile, gc.nCsvBytes);
+		if (szLog.size() >= FLUSH_BYTES)
+			flush(ofsLog, szLog, szLogFile, gc.nLogBytes);
+	}
+
+	flush(ofsCsv, szCsv, szCsvFile, gc.nCsvBytes);
+	flush(ofsLog, szLog, szLogFile, gc.nLogBytes);
+}
+
+void OBFeedGen::flush(ofstream& ofs, string& szBuf, const string& szFile, uint64_t& nBytes) {
+
+	static const string SZ_OBFEEDGEN_FLUSH = "flush";
+
+	ofs.write(szBuf.data(), static_cast<streamsize>(szBuf.size()));
+	if (!ofs)
+		throw TracedException(SZ_OBFEEDGEN_EXCEPTION, "Cannot write feed " + szFile, SZ_OBFEEDGEN_FLUSH);
+
+	nBytes += szBuf.size();
+	szBuf.clear();
+}
+
+void OBFeedGen::writeXml(const string& szXmlFile, const string& szFeed, const string& szCsvFile, const string& szLogFile, const string& szPlotFile, int nBookLevels) {
+
+	static const string SZ_OBFEEDGEN_WRITEXML = "writeXml";
+
+	ofstream ofs(szXmlFile, ios::trunc);
+
+	// The feeds share one clock, so the log needs no offset and books match within a second
+	ofs << "<?xml version=\"1.0\" encoding=\"utf-8\"?>" << endl;
+	ofs << "<task1>" << endl;
+	ofs << "  <bookplot>" << endl;
+	ofs << "    <file>" << szPlotFile << "</file>" << endl;
+	ofs << "    <summary>Order Books Summary</summary>" << endl;
+	ofs << "    <bestspreads>10</bestspreads>" << endl;
+	ofs << "    <markers>" << endl;
+	ofs << "      <begin_summary>Begin Order Books Summary</begin_summary>" << endl;
+	ofs << "      <end_summary>End Order Books Summary</end_summary>" << endl;
+	ofs << "    </markers>" << endl;
+	ofs << "  </bookplot>" << endl;
+	ofs << "  <sessionfeed>" << endl;
+	ofs << "    <sourcefeed>" << szFeed << "</sourcefeed>" << endl;
+	ofs << "    <maxBookLevels>" << nBookLevels << "</maxBookLevels>" << endl;
+	ofs << "    <cache>false</cache>" << endl;
+	ofs << "    <inputMode>mapped</inputMode>" << endl;
+	ofs << "    <reconToleranceMs>1000</reconToleranceMs>" << endl;
+	ofs << "    <reconLogOffsetMs>0</reconLogOffsetMs>" << endl;
+	ofs << "    <reconWindowSec>60</reconWindowSec>" << endl;
+	ofs << "    <" << szFeed << ">" << endl;
+	ofs << "      <csv>" << szCsvFile << "</csv>" << endl;
+	ofs << "      <log>" << szLogFile << "</log>" << endl;
+	ofs << "      <diff>" << szFeed << "_DIFF.log</diff>" << endl;
+	ofs << "    </" << szFeed << ">" << endl;
+	ofs << "  </sessionfeed>" << endl;
+	ofs << "</task1>" << endl;
+
+	if (!ofs)
+		throw TracedException(SZ_OBFEEDGEN_EXCEPTION, "Cannot write " + szXmlFile, SZ_OBFEEDGEN_WRITEXML);
+}
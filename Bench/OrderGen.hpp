@@ -0,0 +1,95 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <fstream>
+
+using namespace std;
+
+// Writes a matched pair of csv and log source feeds in the formats OBStreamCSV and OBStreamLog read.
+// Each instrument walks its own book, one update per row, and both feeds show the same updates except
+// for the divergences injected at the asked rate, so the reconciliation of the two feeds must find
+// exactly the books counted in GenCounts.
+class OBFeedGen
+{
+public:
+	struct GenParams {
+		uint64_t	nRows;			// Book updates written to the csv feed
+		int			nInstruments;	// Instruments updated in turn
+		int			nDepth;			// Levels of each side of a book
+		int			nVolatility;	// Most ticks the price of an instrument moves on an update
+		double		dDivergeRate;	// Share of the updates whose log row diverges from the csv one
+		uint64_t	nSeed;
+
+		GenParams() : nRows(1000000), nInstruments(4), nDepth(10), nVolatility(2), dDivergeRate(0.001), nSeed(1) {}
+	};
+
+	// How the feeds diverge, one kind after the other
+	enum GEN_DIVERGENCE {
+		GEN_DIVERGE_CHANGED = 0,	// Log row shows another quantity at the best bid
+		GEN_DIVERGE_DROPPED,		// Log row is missing
+		GEN_DIVERGE_EXTRA,			// Log has an update the csv feed does not
+		GEN_DIVERGE_KINDS
+	};
+
+	struct GenCounts {
+		uint64_t	nCsvRows;
+		uint64_t	nLogRows;
+		uint64_t	nCsvBytes;
+		uint64_t	nLogBytes;
+		uint64_t	nDiverged[GEN_DIVERGE_KINDS];
+
+		GenCounts() : nCsvRows(0), nLogRows(0), nCsvBytes(0), nLogBytes(0), nDiverged{ 0, 0, 0 } {}
+
+		// Books the reconciliation must report as shown by one feed only
+		uint64_t csvOnly() const	{ return nDiverged[GEN_DIVERGE_CHANGED] + nDiverged[GEN_DIVERGE_DROPPED]; }
+		uint64_t logOnly() const	{ return nDiverged[GEN_DIVERGE_CHANGED] + nDiverged[GEN_DIVERGE_EXTRA]; }
+	};
+
+	explicit OBFeedGen(const GenParams& gp);
+
+	// Take a generator command line option, returning false when it is not one
+	static bool parseOption(const string& szOption, const string& szValue, GenParams& gp);
+	static const char* getOptionsUsage()	{ return "[--instruments n] [--depth n] [--volatility ticks] [--diverge-rate r] [--seed n]"; }
+
+	// Write both feeds, throwing a TracedException when a file cannot be written
+	void generate(const string& szCsvFile, const string& szLogFile, GenCounts& gc);
+
+	// Write an OrderBook xml reading and reconciling the feeds as session feed szFeed
+	static void writeXml(const string& szXmlFile, const string& szFeed, const string& szCsvFile, const string& szLogFile, const string& szPlotFile, int nBookLevels);
+
+private:
+	// Book of an instrument, best level first
+	struct GenBook {
+		int				nMid;			// Price midway between the best bid and ask
+		vector<int>		vBidPrice;
+		vector<int>		vBidQty;
+		vector<int>		vAskPrice;
+		vector<int>		vAskQty;
+		uint64_t		nVolume;
+	};
+
+	void update(GenBook& gb);
+
+	void appendCsvRow(string& szBuf, int nInstrument, const GenBook& gb, long long nTimeMs) const;
+	void appendLogRow(string& szBuf, int nInstrument, const GenBook& gb, long long nTimeMs) const;
+
+	static void flush(ofstream& ofs, string& szBuf, const string& szFile, uint64_t& nBytes);
+
+	uint64_t random();
+	int random(int nLow, int nHigh)		{ return nLow + static_cast<int>(random() % static_cast<uint64_t>(nHigh - nLow + 1)); }
+
+private:
+	GenParams			m_gp;
+	uint64_t			m_nState;		// splitmix64 state
+	vector<GenBook>		m_vBooks;
+
+	static constexpr long long START_TIME_MS = 1528786800000LL;		// 06/12/2018 07:00:00
+	static constexpr int MEAN_GAP_MS = 50;								// Mean time between updates
+	static constexpr int LOT_SIZE = 100;
+	static constexpr int MAX_LOTS = 1000;
+	static constexpr size_t FLUSH_BYTES = 1 << 20;
+
+	static constexpr auto SZ_OBFEEDGEN_EXCEPTION = "OBFeedGen Exception";
+};
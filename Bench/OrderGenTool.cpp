@@ -0,0 +1,61 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Command line generator of synthetic source feeds
+//==============================================================
+#include "pch.h"
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+#include "TracedException.hpp"
+#include "OrderGen.hpp"
+
+static void usage() {
+	cout << "Usage: obgen [--out name] [--rows n] [--levels n] " << OBFeedGen::getOptionsUsage() << endl;
+	cout << "Writes name.csv, name.log and name.xml, an OrderBook xml reconciling them." << endl;
+}
+
+int main(int argc, char* argv[])
+{
+	OBFeedGen::GenParams gp;
+	string szName = "gen";
+	int nLevels = 5;
+
+	for (int i = 1; i < argc; ++i) {
+
+		string szArg = argv[i];
+		if (i + 1 == argc) {
+			usage();
+			return 2;
+		}
+
+		string szValue = argv[++i];
+		if (szArg == "--out")
+			szName = szValue;
+		else if (szArg == "--levels")
+			nLevels = atoi(szValue.c_str());
+		else if (!OBFeedGen::parseOption(szArg, szValue, gp)) {
+			usage();
+			return 2;
+		}
+	}
+
+	try {
+		OBFeedGen::GenCounts gc;
+		OBFeedGen(gp).generate(szName + ".csv", szName + ".log", gc);
+		OBFeedGen::writeXml(szName + ".xml", "gen", szName + ".csv", szName + ".log", szName + ".htm", nLevels);
+
+		cout << szName << ".csv: " << gc.nCsvRows << " rows, " << gc.nCsvBytes << " bytes" << endl;
+		cout << szName << ".log: " << gc.nLogRows << " rows, " << gc.nLogBytes << " bytes" << endl;
+		cout << "Divergences: " << gc.nDiverged[OBFeedGen::GEN_DIVERGE_CHANGED] << " changed, " << gc.nDiverged[OBFeedGen::GEN_DIVERGE_DROPPED] << " dropped, "
+			<< gc.nDiverged[OBFeedGen::GEN_DIVERGE_EXTRA] << " extra, to be reconciled as " << gc.csvOnly() << " csv only and " << gc.logOnly() << " log only." << endl;
+	}
+	catch (const TracedException& te) {
+		te.coutException();
+		return 2;
+	}
+
+	return 0;
+}
@@ -0,0 +1,284 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// End to end load runs of the OrderBook application on synthetic feeds
+//==============================================================
+#include "pch.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <boost/algorithm/string.hpp>
+
+using namespace std;
+
+#include "TracedException.hpp"
+#include "OrderGen.hpp"
+
+#ifndef OB_BENCH_FEED_DIR
+#define OB_BENCH_FEED_DIR "."
+#endif
+
+// Generates a corpus for each asked size, runs the whole application on it as a separate process and
+// records its wall time, its peak resident memory and whether its reconciliation found exactly the
+// divergences injected in the corpus.
+class OBLoad
+{
+public:
+	struct LoadParams {
+		OBFeedGen::GenParams	gp;
+		vector<uint64_t>		vSizes;			// Rows of each corpus
+		string					szWorkDir;
+		string					szOrderBook;	// Application binary
+		string					szTemplate;		// Html the plot is injected in
+		bool					bKeep;			// Keep the corpora once run
+	};
+
+	struct LoadResult {
+		uint64_t				nRows;
+		OBFeedGen::GenCounts	gc;
+		double					dGenSeconds;
+		double					dWallSeconds;
+		long					nPeakRssKb;
+		int						nExitCode;
+		long long				nCsvOnly;		// As reported by the application, -1 when not reported
+		long long				nLogOnly;
+
+		bool found() const		{ return nExitCode == 0 && nCsvOnly == static_cast<long long>(gc.csvOnly()) && nLogOnly == static_cast<long long>(gc.logOnly()); }
+	};
+
+	explicit OBLoad(const LoadParams& lp) : m_lp(lp) {}
+
+	LoadResult run(uint64_t nRows);
+
+	static void writeJson(ostream& os, const vector<LoadResult>& vResults, const LoadParams& lp);
+
+private:
+	// Run the application on the xml from the work directory, its output going to szOutFile
+	void runOrderBook(const string& szXml, const string& szOutFile, LoadResult& lr);
+
+	static void readReconcile(const string& szOutFile, LoadResult& lr);
+
+private:
+	LoadParams		m_lp;
+
+	static constexpr int BOOK_LEVELS = 5;
+
+	static constexpr auto SZ_OBLOAD_EXCEPTION = "OBLoad Exception";
+};
+
+OBLoad::LoadResult OBLoad::run(uint64_t nRows) {
+
+	static const string SZ_OBLOAD_RUN = "run";
+
+	LoadResult lr;
+	lr.nRows = nRows;
+	lr.nExitCode = -1;
+	lr.nPeakRssKb = 0;
+	lr.dWallSeconds = 0;
+	lr.nCsvOnly = lr.nLogOnly = -1;
+
+	// Files are named from the work directory, where the application runs
+	string szName = "load" + to_string(nRows);
+	string szPath = m_lp.szWorkDir + "/" + szName;
+
+	OBFeedGen::GenParams gp = m_lp.gp;
+	gp.nRows = nRows;
+
+	auto tBeg = std::chrono::steady_clock::now();
+	OBFeedGen(gp).generate(szPath + ".csv", szPath + ".log", lr.gc);
+	lr.dGenSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tBeg).count();
+
+	OBFeedGen::writeXml(szPath + ".xml", "load", szName + ".csv", szName + ".log", szName + ".htm", BOOK_LEVELS);
+
+	{
+		ifstream ifs(m_lp.szTemplate, ios::binary);
+		ofstream ofs(szPath + ".htm", ios::binary | ios::trunc);
+		if (!ifs || !(ofs << ifs.rdbuf()))
+			throw TracedException(SZ_OBLOAD_EXCEPTION, "Cannot copy plot template " + m_lp.szTemplate, SZ_OBLOAD_RUN);
+	}
+
+	runOrderBook(szName + ".xml", szPath + ".out", lr);
+	readReconcile(szPath + ".out", lr);
+
+	if (!m_lp.bKeep) {
+		for (const char* szExt : { ".csv", ".log", ".xml", ".htm", ".out" })
+			std::remove((szPath + szExt).c_str());
+		std::remove((m_lp.szWorkDir + "/load_DIFF.log").c_str());
+	}
+
+	return lr;
+}
+
+void OBLoad::runOrderBook(const string& szXml, const string& szOutFile, LoadResult& lr) {
+
+	static const string SZ_OBLOAD_RUNORDERBOOK = "runOrderBook";
+
+	int fdOut = open(szOutFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fdOut < 0)
+		throw TracedException(SZ_OBLOAD_EXCEPTION, "Cannot create " + szOutFile, SZ_OBLOAD_RUNORDERBOOK);
+
+	auto tBeg = std::chrono::steady_clock::now();
+
+	pid_t pid = fork();
+	if (pid == 0) {
+		dup2(fdOut, STDOUT_FILENO);
+		dup2(fdOut, STDERR_FILENO);
+		if (chdir(m_lp.szWorkDir.c_str()) == 0)
+			execl(m_lp.szOrderBook.c_str(), m_lp.szOrderBook.c_str(), szXml.c_str(), static_cast<char*>(nullptr));
+		_exit(127);
+	}
+
+	close(fdOut);
+	if (pid < 0)
+		throw TracedException(SZ_OBLOAD_EXCEPTION, "Cannot start " + m_lp.szOrderBook, SZ_OBLOAD_RUNORDERBOOK);
+
+	// The usage of the child alone gives its peak memory
+	int nStatus = 0;
+	struct rusage ru;
+	if (wait4(pid, &nStatus, 0, &ru) != pid)
+		throw TracedException(SZ_OBLOAD_EXCEPTION, "Lost " + m_lp.szOrderBook, SZ_OBLOAD_RUNORDERBOOK);
+
+	lr.dWallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tBeg).count();
+	lr.nPeakRssKb = ru.ru_maxrss;
+	lr.nExitCode = WIFEXITED(nStatus) ? WEXITSTATUS(nStatus) : 128 + WTERMSIG(nStatus);
+}
+
+void OBLoad::readReconcile(const string& szOutFile, LoadResult& lr) {
+
+	// The application reports "... : n books matched, c csv only, l log only."
+	ifstream ifs(szOutFile);
+	string szLine;
+	while (getline(ifs, szLine)) {
+		size_t nPos = szLine.find(" books matched, ");
+		if (nPos == string::npos)
+			continue;
+
+		long long nCsvOnly, nLogOnly;
+		if (sscanf(szLine.c_str() + nPos, " books matched, %lld csv only, %lld log only", &nCsvOnly, &nLogOnly) == 2) {
+			lr.nCsvOnly = nCsvOnly;
+			lr.nLogOnly = nLogOnly;
+		}
+	}
+}
+
+void OBLoad::writeJson(ostream& os, const vector<LoadResult>& vResults, const LoadParams& lp) {
+
+	os << "{" << endl;
+	os << "\t\"instruments\": " << lp.gp.nInstruments << ", \"depth\": " << lp.gp.nDepth << ", \"volatility\": " << lp.gp.nVolatility
+		<< ", \"diverge_rate\": " << lp.gp.dDivergeRate << ", \"seed\": " << lp.gp.nSeed << "," << endl;
+	os << "\t\"runs\": [" << endl;
+
+	for (size_t i = 0; i < vResults.size(); ++i) {
+		const LoadResult& lr = vResults[i];
+		os << "\t\t{ \"rows\": " << lr.nRows
+			<< ", \"csv_bytes\": " << lr.gc.nCsvBytes
+			<< ", \"log_bytes\": " << lr.gc.nLogBytes
+			<< ", \"gen_seconds\": " << std::fixed << std::setprecision(3) << lr.dGenSeconds
+			<< ", \"wall_seconds\": " << lr.dWallSeconds << std::defaultfloat
+			<< ", \"peak_rss_kb\": " << lr.nPeakRssKb
+			<< ", \"exit_code\": " << lr.nExitCode
+			<< ", \"injected_csv_only\": " << lr.gc.csvOnly()
+			<< ", \"injected_log_only\": " << lr.gc.logOnly()
+			<< ", \"found_csv_only\": " << lr.nCsvOnly
+			<< ", \"found_log_only\": " << lr.nLogOnly
+			<< ", \"divergences_found\": " << (lr.found() ? "true" : "false")
+			<< " }" << (i + 1 < vResults.size() ? "," : "") << endl;
+	}
+
+	os << "\t]" << endl;
+	os << "}" << endl;
+}
+
+static void usage() {
+	cout << "Usage: obload [--sizes n,n,...] [--work dir] [--orderbook path] [--json file] [--keep 1]" << endl;
+	cout << "              " << OBFeedGen::getOptionsUsage() << endl;
+}
+
+int main(int argc, char* argv[])
+{
+	// The application is built next to the harness
+	string szSelf = argv[0];
+	size_t nSlash = szSelf.rfind('/');
+
+	OBLoad::LoadParams lp;
+	lp.vSizes = { 1000000, 10000000, 100000000 };
+	lp.szWorkDir = ".";
+	lp.szOrderBook = (nSlash == string::npos ? string(".") : szSelf.substr(0, nSlash)) + "/orderbook";
+	lp.szTemplate = string(OB_BENCH_FEED_DIR) + "/OrderBook.htm";
+	lp.bKeep = false;
+	string szJson = "obload.json";
+
+	for (int i = 1; i < argc; ++i) {
+
+		string szArg = argv[i];
+		if (i + 1 == argc) {
+			usage();
+			return 2;
+		}
+
+		string szValue = argv[++i];
+		if (szArg == "--sizes") {
+			vector<string> vSizes;
+			boost::split(vSizes, szValue, boost::is_any_of(","));
+			lp.vSizes.clear();
+			for (const auto& sz : vSizes)
+				lp.vSizes.push_back(strtoull(sz.c_str(), nullptr, 10));
+		}
+		else if (szArg == "--work")			lp.szWorkDir = szValue;
+		else if (szArg == "--orderbook")	lp.szOrderBook = szValue;
+		else if (szArg == "--json")			szJson = szValue;
+		else if (szArg == "--keep")			lp.bKeep = szValue != "0";
+		else if (!OBFeedGen::parseOption(szArg, szValue, lp.gp)) {
+			usage();
+			return 2;
+		}
+	}
+
+	// Relative paths are resolved from the work directory once the application runs there
+	if (lp.szOrderBook[0] != '/') {
+		char szCwd[4096];
+		if (getcwd(szCwd, sizeof(szCwd)) != nullptr)
+			lp.szOrderBook = string(szCwd) + "/" + lp.szOrderBook;
+	}
+
+	vector<OBLoad::LoadResult> vResults;
+	try {
+		OBLoad ol(lp);
+		cout << std::setw(12) << "rows" << std::setw(12) << "gen s" << std::setw(12) << "wall s" << std::setw(14) << "peak MB" << std::setw(24) << "csv/log only found" << endl;
+
+		for (uint64_t nRows : lp.vSizes) {
+			vResults.push_back(ol.run(nRows));
+
+			const OBLoad::LoadResult& lr = vResults.back();
+			stringstream ss;
+			ss << lr.nCsvOnly << "/" << lr.nLogOnly << " of " << lr.gc.csvOnly() << "/" << lr.gc.logOnly();
+			cout << std::setw(12) << lr.nRows << std::fixed << std::setprecision(2) << std::setw(12) << lr.dGenSeconds << std::setw(12) << lr.dWallSeconds
+				<< std::setw(14) << std::setprecision(1) << lr.nPeakRssKb / 1024.0 << std::defaultfloat << std::setw(24) << ss.str()
+				<< (lr.nExitCode != 0 ? "  FAILED" : lr.found() ? "" : "  MISSED") << endl;
+		}
+	}
+	catch (const TracedException& te) {
+		te.coutException();
+		return 2;
+	}
+
+	ofstream file(szJson, ios::trunc);
+	OBLoad::writeJson(file, vResults, lp);
+
+	for (const auto& lr : vResults) {
+		if (!lr.found())
+			return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,171 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Streaming spread and microstructure statistics of the source feeds
+//==============================================================
+#include "pch.h"
+#include <string>
+#include <set>
+#include <map>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+#include "OrderBook.hpp"
+
+BookAnalytics::BookAnalytics() : m_nTick(1), m_nUpdates(0), m_nBooks(0), m_nCrossed(0), m_vSpreadBins{}, m_nSpreadSum(0), m_nMinSpread(0), m_nMaxSpread(0),
+	m_dSpreadTimeSum(0), m_nSpreadMs(0), m_nFirstMs(NO_TIME), m_nLastMs(NO_TIME), m_bSpread(false), m_nLastSpread(0),
+	m_dLastMid(0), m_dLastMicro(0), m_nFirstPoint(0), m_nWidthMs(SERIES_WIDTH_MS) {
+}
+
+void BookAnalytics::addBook(long long nTimeMs, bool bQuoted, int32_t nBid, int nBidQty, int32_t nAsk, int nAskQty) {
+
+	m_nUpdates++;
+
+	// A row without a time stamp is read at the time of the row before it, so no time passes over it
+	if (nTimeMs == NO_TIME)
+		nTimeMs = m_nLastMs;
+	else if (m_nFirstMs == NO_TIME)
+		m_nFirstMs = nTimeMs;
+
+	// The spread of the last book held until this row. Time stamps going back count no time, and
+	// neither does the time before the first time stamp.
+	if (nTimeMs != NO_TIME) {
+		if (m_bSpread && m_nLastMs != NO_TIME && nTimeMs > m_nLastMs) {
+			m_dSpreadTimeSum += static_cast<double>(m_nLastSpread) * (nTimeMs - m_nLastMs);
+			m_nSpreadMs += nTimeMs - m_nLastMs;
+		}
+		m_nLastMs = std::max(m_nLastMs, nTimeMs);
+	}
+
+	// A book missing a side has no inside market
+	m_bSpread = bQuoted;
+	if (!m_bSpread)
+		return;
+
+	int64_t nSpread = static_cast<int64_t>(nAsk) - nBid;
+	if (nSpread < 0)
+		m_nCrossed++;
+	else
+		m_vSpreadBins[std::min<int64_t>(nSpread / m_nTick, SPREAD_BINS - 1)]++;
+
+	m_nMinSpread = (m_nBooks == 0) ? nSpread : std::min(m_nMinSpread, nSpread);
+	m_nMaxSpread = (m_nBooks == 0) ? nSpread : std::max(m_nMaxSpread, nSpread);
+	m_nSpreadSum += nSpread;
+	m_nLastSpread = nSpread;
+	m_nBooks++;
+
+	// The microprice leans to the side with less size, the one more likely to trade through
+	m_dLastMid = (static_cast<double>(nBid) + nAsk) / 2;
+	int64_t nDepth = static_cast<int64_t>(nBidQty) + nAskQty;
+	m_dLastMicro = (nDepth != 0) ? (static_cast<double>(nBid) * nAskQty + static_cast<double>(nAsk) * nBidQty) / nDepth : m_dLastMid;
+
+	// Books read before any time stamp have no place in the series
+	if (nTimeMs != NO_TIME)
+		addPoint(nTimeMs, 1, m_dLastMid, m_dLastMicro);
+}
+
+void BookAnalytics::addPoint(long long nTimeMs, uint64_t nBooks, double dMidSum, double dMicroSum) {
+
+	long long iPoint = floorDiv(nTimeMs, m_nWidthMs);
+	if (m_vSeries.empty())
+		m_nFirstPoint = iPoint;
+
+	// Widen the points until the series spans them all, time stamps going back included
+	while (std::max(iPoint, m_nFirstPoint + static_cast<long long>(m_vSeries.size()) - 1) - std::min(iPoint, m_nFirstPoint) >= static_cast<long long>(SERIES_POINTS)) {
+		foldSeries();
+		iPoint = floorDiv(nTimeMs, m_nWidthMs);
+	}
+
+	if (iPoint < m_nFirstPoint) {
+		m_vSeries.insert(m_vSeries.begin(), static_cast<size_t>(m_nFirstPoint - iPoint), SeriesPoint());
+		m_nFirstPoint = iPoint;
+	}
+	else if (iPoint - m_nFirstPoint >= static_cast<long long>(m_vSeries.size()))
+		m_vSeries.resize(static_cast<size_t>(iPoint - m_nFirstPoint) + 1);
+
+	SeriesPoint& sp = m_vSeries[static_cast<size_t>(iPoint - m_nFirstPoint)];
+	sp.nTimeMs = (sp.nBooks == 0) ? nTimeMs : std::min(sp.nTimeMs, nTimeMs);
+	sp.nBooks += nBooks;
+	sp.dMidSum += dMidSum;
+	sp.dMicroSum += dMicroSum;
+}
+
+void BookAnalytics::foldSeries() {
+
+	m_nWidthMs *= 2;
+	if (m_vSeries.empty())
+		return;
+
+	long long iFirst = floorDiv(m_nFirstPoint, 2);
+	long long iLast = floorDiv(m_nFirstPoint + static_cast<long long>(m_vSeries.size()) - 1, 2);
+
+	vector<SeriesPoint> vFolded(static_cast<size_t>(iLast - iFirst) + 1);
+	for (size_t i = 0; i < m_vSeries.size(); ++i) {
+		const SeriesPoint& spFold = m_vSeries[i];
+		if (spFold.nBooks == 0)
+			continue;
+
+		SeriesPoint& sp = vFolded[static_cast<size_t>(floorDiv(m_nFirstPoint + static_cast<long long>(i), 2) - iFirst)];
+		sp.nTimeMs = (sp.nBooks == 0) ? spFold.nTimeMs : std::min(sp.nTimeMs, spFold.nTimeMs);
+		sp.nBooks += spFold.nBooks;
+		sp.dMidSum += spFold.dMidSum;
+		sp.dMicroSum += spFold.dMicroSum;
+	}
+
+	m_vSeries.swap(vFolded);
+	m_nFirstPoint = iFirst;
+}
+
+void BookAnalytics::merge(const BookAnalytics& ba) {
+
+	if (ba.m_nUpdates == 0)
+		return;
+
+	// The last spread of these rows held until the first row of the later ones
+	if (m_bSpread && ba.m_nFirstMs != NO_TIME && ba.m_nFirstMs > m_nLastMs) {
+		m_dSpreadTimeSum += static_cast<double>(m_nLastSpread) * (ba.m_nFirstMs - m_nLastMs);
+		m_nSpreadMs += ba.m_nFirstMs - m_nLastMs;
+	}
+
+	m_dSpreadTimeSum += ba.m_dSpreadTimeSum;
+	m_nSpreadMs += ba.m_nSpreadMs;
+	if (m_nFirstMs == NO_TIME)
+		m_nFirstMs = ba.m_nFirstMs;
+	if (ba.m_nLastMs != NO_TIME)
+		m_nLastMs = std::max(m_nLastMs, ba.m_nLastMs);
+
+	if (ba.m_nBooks > 0) {
+		m_nMinSpread = (m_nBooks == 0) ? ba.m_nMinSpread : std::min(m_nMinSpread, ba.m_nMinSpread);
+		m_nMaxSpread = (m_nBooks == 0) ? ba.m_nMaxSpread : std::max(m_nMaxSpread, ba.m_nMaxSpread);
+		m_dLastMid = ba.m_dLastMid;
+		m_dLastMicro = ba.m_dLastMicro;
+	}
+
+	m_nUpdates += ba.m_nUpdates;
+	m_nBooks += ba.m_nBooks;
+	m_nCrossed += ba.m_nCrossed;
+	m_nSpreadSum += ba.m_nSpreadSum;
+	for (int i = 0; i < SPREAD_BINS; ++i)
+		m_vSpreadBins[i] += ba.m_vSpreadBins[i];
+
+	m_bSpread = ba.m_bSpread;
+	m_nLastSpread = ba.m_nLastSpread;
+
+	// Points of the later rows fall whole in a point as wide as theirs or wider, placed by their earliest time stamp
+	while (m_nWidthMs < ba.m_nWidthMs)
+		foldSeries();
+
+	for (const auto& sp : ba.m_vSeries) {
+		if (sp.nBooks > 0)
+			addPoint(sp.nTimeMs, sp.nBooks, sp.dMidSum, sp.dMicroSum);
+	}
+
+	if (m_vImbalance.size() < ba.m_vImbalance.size())
+		m_vImbalance.resize(ba.m_vImbalance.size());
+	for (size_t i = 0; i < ba.m_vImbalance.size(); ++i) {
+		m_vImbalance[i].nBooks += ba.m_vImbalance[i].nBooks;
+		m_vImbalance[i].dSum += ba.m_vImbalance[i].dSum;
+	}
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstdint>
+#include <climits>
+#include <vector>
+#include <algorithm>
+
+// Built on the level types of OrderBook.hpp, which includes this header once they are declared
+
+// Spread and microstructure statistics of a source feed, updated with every book read. Each update costs
+// the same whatever the length of the feed and the memory held is bounded by the book depth and the
+// fixed sizes below, so no row is kept. Prices are counted in units of the last price decimal:
+//   - spreads of the inside market in a histogram of tick wide bins, crossed spreads counted apart
+//   - the mean spread over the books, and over time with each spread held until the next book
+//   - the mid price and the microprice, the mid weighted towards the side with less size, as a time
+//     series of at most SERIES_POINTS points whose width doubles whenever the feed outgrows it. Points
+//     span whole multiples of their width from the epoch, so the series of the parts of a feed nest
+//     in each other and merge into the series of the whole feed.
+//   - the mean depth imbalance (bid - ask) / (bid + ask) of the sizes at each level both sides quote
+class BookAnalytics
+{
+public:
+	static constexpr long long NO_TIME = LLONG_MIN;
+
+	static constexpr int SPREAD_BINS = 32;				// Spreads of 0 to 30 ticks, then any wider one
+	static constexpr size_t SERIES_POINTS = 256;
+	static constexpr long long SERIES_WIDTH_MS = 1000;	// Width of the series points until the feed outgrows them
+
+	// Books of a span of the series, their earliest time stamp and their sums
+	struct SeriesPoint {
+		long long	nTimeMs;
+		uint64_t	nBooks;			// No book fell in the span when 0
+		double		dMidSum;
+		double		dMicroSum;
+
+		SeriesPoint() : nTimeMs(NO_TIME), nBooks(0), dMidSum(0), dMicroSum(0) {}
+
+		double mid() const			{ return dMidSum / nBooks; }
+		double micro() const		{ return dMicroSum / nBooks; }
+	};
+
+	// Depth imbalance of one level over the books quoting both its sides
+	struct LevelImbalance {
+		uint64_t	nBooks;
+		double		dSum;
+
+		LevelImbalance() : nBooks(0), dSum(0) {}
+
+		double mean() const			{ return nBooks > 0 ? dSum / nBooks : 0; }
+	};
+
+	BookAnalytics();
+
+	// Price step of the histogram bins, in units of the last price decimal
+	void setTick(int nTick)							{ m_nTick = (nTick > 0) ? nTick : 1; }
+	int getTick() const								{ return m_nTick; }
+
+	// Count the book of a feed row at its time stamp, NO_TIME when the row has none
+	void update(long long nTimeMs, const vecPriceQty& vBids, const vecPriceQty& vAsks) {
+		if (vBids.empty() || vAsks.empty()) {
+			addBook(nTimeMs, false, 0, 0, 0, 0);
+			return;
+		}
+
+		addBook(nTimeMs, true, vBids[0].first.units(), vBids[0].second, vAsks[0].first.units(), vAsks[0].second);
+
+		size_t nLevels = std::min(vBids.size(), vAsks.size());
+		if (m_vImbalance.size() < nLevels)
+			m_vImbalance.resize(nLevels);
+
+		for (size_t i = 0; i < nLevels; ++i) {
+			int nDepth = vBids[i].second + vAsks[i].second;
+			if (nDepth > 0) {
+				m_vImbalance[i].nBooks++;
+				m_vImbalance[i].dSum += static_cast<double>(vBids[i].second - vAsks[i].second) / nDepth;
+			}
+		}
+	}
+
+	// Fold in the statistics of the rows that follow this one's, as the partial books of a feed are merged
+	void merge(const BookAnalytics& ba);
+
+	uint64_t getBooks() const						{ return m_nBooks; }
+	uint64_t getCrossed() const						{ return m_nCrossed; }
+	const uint64_t* getSpreadBins() const			{ return m_vSpreadBins; }
+	int64_t getMinSpread() const					{ return m_nMinSpread; }
+	int64_t getMaxSpread() const					{ return m_nMaxSpread; }
+	double getMeanSpread() const					{ return m_nBooks > 0 ? static_cast<double>(m_nSpreadSum) / m_nBooks : 0; }
+
+	// Spread weighted by the time each held, and that time. No time passes in feeds without time stamps.
+	double getTimeWeightedSpread() const			{ return m_nSpreadMs > 0 ? m_dSpreadTimeSum / m_nSpreadMs : getMeanSpread(); }
+	long long getSpreadMs() const					{ return m_nSpreadMs; }
+
+	double getLastMid() const						{ return m_dLastMid; }
+	double getLastMicro() const						{ return m_dLastMicro; }
+
+	const vector<SeriesPoint>& getSeries() const		{ return m_vSeries; }
+	long long getSeriesWidthMs() const				{ return m_nWidthMs; }
+
+	const vector<LevelImbalance>& getImbalance() const	{ return m_vImbalance; }
+
+	// Price units as a price, and the decimals to print it with, two more than the feeds quote
+	static double toPrice(double dUnits)			{ return dUnits / OBPrice::unitsPerOne(); }
+	static constexpr int PRICE_DECIMALS = OB_PRICE_DECIMALS + 2;
+
+private:
+	// Count a book by its inside market in price units, with no inside market when it misses a side
+	void addBook(long long nTimeMs, bool bQuoted, int32_t nBid, int nBidQty, int32_t nAsk, int nAskQty);
+
+	// Add the books of a span to the point of the series its time falls in
+	void addPoint(long long nTimeMs, uint64_t nBooks, double dMidSum, double dMicroSum);
+
+	// Double the width of the points, folding each pair of them into one
+	void foldSeries();
+
+	static long long floorDiv(long long n, long long nDiv)	{ return n / nDiv - ((n % nDiv < 0) ? 1 : 0); }
+
+private:
+	int				m_nTick;
+	uint64_t		m_nUpdates;				// Rows counted, books missing a side included
+	uint64_t		m_nBooks;				// Books quoting both sides
+	uint64_t		m_nCrossed;				// Books whose ask was below their bid
+	uint64_t		m_vSpreadBins[SPREAD_BINS];
+	int64_t			m_nSpreadSum;
+	int64_t			m_nMinSpread;
+	int64_t			m_nMaxSpread;
+
+	double			m_dSpreadTimeSum;		// Spread held times the milliseconds it held
+	long long		m_nSpreadMs;
+	long long		m_nFirstMs;				// First and last time stamps read, NO_TIME before any
+	long long		m_nLastMs;
+	bool			m_bSpread;				// The last row quoted both sides, its spread holds until the next row
+	int64_t			m_nLastSpread;
+
+	double			m_dLastMid;
+	double			m_dLastMicro;
+
+	vector<SeriesPoint>		m_vSeries;
+	long long				m_nFirstPoint;	// Widths from the epoch to the first point of the series
+	long long				m_nWidthMs;
+
+	vector<LevelImbalance>	m_vImbalance;
+
+	// The cache saves and restores the statistics as they are
+	friend class OBBookCache;
+};
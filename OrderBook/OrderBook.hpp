@@ -1,21 +1,328 @@
 #pragma once
 
-typedef pair<int, int>				pairInt;
-typedef vector<pairInt>				vecPairInt;
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+
+#include "OrderPrice.hpp"
+#include "OrderStats.hpp"
+
+// Decimals of the prices quoted by the source feeds, set at build time. Prices are held exactly
+// as a number of units of the last decimal, so the default reads the integer prices of the feeds.
+#ifndef OB_PRICE_DECIMALS
+#define OB_PRICE_DECIMALS 0
+#endif
+
+typedef Price<OB_PRICE_DECIMALS>	OBPrice;
+
+typedef pair<OBPrice, int>			pairPriceQty;
+typedef vector<pairPriceQty>		vecPriceQty;
 
 typedef struct BidAskLevels {
-	vecPairInt	vBidQty;
-	vecPairInt	vAskQty;
+	vecPriceQty	vBidQty;
+	vecPriceQty	vAskQty;
 } BidAskLevels;
 
 typedef set<int>					setInt;
-typedef map<int, setInt>			mapPriceQty;
-typedef vector<mapPriceQty>			vecLevels;
+typedef set<OBPrice>				setPrice;
+typedef map<OBPrice, setInt>		mapPriceQty;
+
+// Distinct price/quantity pairs seen at one book level. Pairs are packed in a flat vector in
+// arrival order behind an open-addressed index, so a repeated pair costs one probe and a new
+// one an append. sort() then orders them by price and quantity, the order of a map of sets.
+class LevelSummary
+{
+public:
+	LevelSummary() : m_bSorted(true) {}
+
+	// Record a price/quantity pair, returning false when it was already seen
+	bool insert(OBPrice prPrice, int nQty) {
+
+		// Keep the index at most half full so probe chains stay short
+		if ((m_vPairs.size() + 1) * 2 > m_vIndex.size())
+			rehash(m_vIndex.empty() ? MIN_INDEX_SLOTS : m_vIndex.size() * 2);
+
+		size_t nMask = m_vIndex.size() - 1;
+		for (size_t nSlot = hash(prPrice, nQty) & nMask; ; nSlot = (nSlot + 1) & nMask) {
+
+			uint32_t nEntry = m_vIndex[nSlot];
+			if (nEntry == 0) {
+				m_vPairs.push_back(make_pair(prPrice, nQty));
+				m_vIndex[nSlot] = static_cast<uint32_t>(m_vPairs.size());
+				m_bSorted = m_bSorted && (m_vPairs.size() == 1 || m_vPairs[m_vPairs.size() - 2] < m_vPairs.back());
+				return true;
+			}
+
+			const pairPriceQty& pi = m_vPairs[nEntry - 1];
+			if (pi.first == prPrice && pi.second == nQty)
+				return false;
+		}
+	}
+
+	// Fold in the pairs of another summary of the same level
+	void merge(const LevelSummary& ls) {
+		for (const auto& pi : ls.m_vPairs)
+			insert(pi.first, pi.second);
+	}
+
+	// Take over pairs that are already distinct and in price then quantity order, as sort() leaves them
+	void assignSorted(vecPriceQty&& vPairs) {
+		m_vPairs = std::move(vPairs);
+
+		size_t nSlots = MIN_INDEX_SLOTS;
+		while (nSlots < m_vPairs.size() * 2)
+			nSlots *= 2;
+
+		rehash(nSlots);
+		m_bSorted = true;
+	}
+
+	// Order the pairs by price then quantity and rebuild the index over the new positions
+	void sort() {
+		if (m_bSorted)
+			return;
+
+		std::sort(m_vPairs.begin(), m_vPairs.end());
+		rehash(m_vIndex.size());
+		m_bSorted = true;
+	}
+
+	bool isSorted() const					{ return m_bSorted; }
+	bool empty() const						{ return m_vPairs.empty(); }
+	size_t size() const						{ return m_vPairs.size(); }
+
+	// Pairs in price then quantity order once sorted
+	const vecPriceQty& pairs() const			{ return m_vPairs; }
+	vecPriceQty::const_iterator begin() const	{ return m_vPairs.begin(); }
+	vecPriceQty::const_iterator end() const	{ return m_vPairs.end(); }
+
+	// Memory held by the summary, for sizing comparisons
+	size_t capacityBytes() const			{ return m_vPairs.capacity() * sizeof(pairPriceQty) + m_vIndex.capacity() * sizeof(uint32_t); }
+
+private:
+	static size_t hash(OBPrice prPrice, int nQty) {
+		uint64_t n = (static_cast<uint64_t>(static_cast<uint32_t>(prPrice.units())) << 32) | static_cast<uint32_t>(nQty);
+		n ^= n >> 33;
+		n *= 0xff51afd7ed558ccdULL;
+		n ^= n >> 33;
+		return static_cast<size_t>(n);
+	}
+
+	void rehash(size_t nSlots) {
+		m_vIndex.assign(nSlots, 0);
 
-typedef map<int, BidAskLevels>		mapBidAskLevels;
-typedef map<int, mapBidAskLevels>	mapSpreadLevels;
+		size_t nMask = nSlots - 1;
+		for (size_t i = 0; i < m_vPairs.size(); ++i) {
+			size_t nSlot = hash(m_vPairs[i].first, m_vPairs[i].second) & nMask;
+			while (m_vIndex[nSlot] != 0)
+				nSlot = (nSlot + 1) & nMask;
+			m_vIndex[nSlot] = static_cast<uint32_t>(i + 1);
+		}
+	}
+
+private:
+	vecPriceQty			m_vPairs;		// Distinct pairs, packed
+	vector<uint32_t>	m_vIndex;		// Open-addressed slots holding pair position + 1, 0 when free
+	bool				m_bSorted;		// Pairs are in price then quantity order
+
+	static constexpr size_t MIN_INDEX_SLOTS = 16;
+};
+
+typedef vector<LevelSummary>		vecLevels;
 
 const int MAX_BOOK_LEVELS = 5;
+const int MAX_BEST_SPREADS = 5;
+
+// Inside market spread of a feed, at the lowest bid it was seen at and with the last ladder logged there
+struct BestSpread
+{
+	OBPrice			prSpread;
+	OBPrice			prBidPrice;
+	BidAskLevels	bal;
+};
+
+// The tightest spreads seen, tightest first. A feed wider than every spread kept is dropped after
+// one compare, so memory is bounded by the number of spreads plotted whatever the number of feeds.
+class BestSpreads
+{
+public:
+	BestSpreads() : m_nCapacity(MAX_BEST_SPREADS) {}
+
+	// Number of spreads kept, the widest are evicted past it
+	void setCapacity(int nCapacity) {
+		m_nCapacity = static_cast<size_t>(std::max(nCapacity, 0));
+		if (m_vSpreads.size() > m_nCapacity)
+			m_vSpreads.resize(m_nCapacity);
+	}
+	int getCapacity() const					{ return static_cast<int>(m_nCapacity); }
+
+	// Log the ladder of a feed at its spread. A spread keeps its lowest bid and the last ladder logged at it.
+	void update(OBPrice prSpread, OBPrice prBidPrice, const BidAskLevels& bal) {
+
+		if (m_vSpreads.size() == m_nCapacity && (m_nCapacity == 0 || prSpread > m_vSpreads.back().prSpread))
+			return;
+
+		auto it = std::lower_bound(m_vSpreads.begin(), m_vSpreads.end(), prSpread, [](const BestSpread& bs, OBPrice pr) { return bs.prSpread < pr; });
+		if (it != m_vSpreads.end() && it->prSpread == prSpread) {
+			if (prBidPrice <= it->prBidPrice) {
+				it->prBidPrice = prBidPrice;
+				it->bal = bal;
+			}
+			return;
+		}
+
+		// Make room by evicting the widest spread
+		size_t nPos = it - m_vSpreads.begin();
+		if (m_vSpreads.size() == m_nCapacity)
+			m_vSpreads.pop_back();
+
+		m_vSpreads.insert(m_vSpreads.begin() + nPos, BestSpread{ prSpread, prBidPrice, bal });
+	}
+
+	// Fold in the spreads of the rows that follow this one's, their ladders win at equal spread and bid
+	void merge(const BestSpreads& bsLater) {
+		for (const auto& bs : bsLater.m_vSpreads)
+			update(bs.prSpread, bs.prBidPrice, bs.bal);
+	}
+
+	bool empty() const						{ return m_vSpreads.empty(); }
+	size_t size() const						{ return m_vSpreads.size(); }
+	vector<BestSpread>::const_iterator begin() const	{ return m_vSpreads.begin(); }
+	vector<BestSpread>::const_iterator end() const		{ return m_vSpreads.end(); }
+
+private:
+	vector<BestSpread>	m_vSpreads;		// Tightest first
+	size_t				m_nCapacity;
+};
+
+#include "OrderLadder.hpp"
+#include "OrderAnalytics.hpp"
+
+// Feed rows skipped as unreadable, counted by reason, with the first of them logged by position
+struct FeedErrors
+{
+	enum FEED_ERROR_REASON {
+		FEED_ERROR_MALFORMED = 0,	// Row is truncated or misses book fields
+		FEED_ERROR_BADNUMBER		// Row has a price or quantity that cannot be read
+	};
+
+	struct FeedError {
+		uint64_t			nLine;		// Line of the row in the source feed, from 1
+		uint64_t			nOffset;	// Byte offset of the row in the source feed
+		FEED_ERROR_REASON	fer;
+	};
+
+	uint64_t			nLines;			// Lines read, header lines included
+	int					nMalformed;
+	int					nBadNumbers;
+	vector<FeedError>	vLog;			// First rows skipped, in file order
+
+	FeedErrors() : nLines(0), nMalformed(0), nBadNumbers(0) {}
+
+	int count() const						{ return nMalformed + nBadNumbers; }
+
+	// Count a skipped row, which is the last line read
+	void add(FEED_ERROR_REASON fer, uint64_t nOffset) {
+		if (fer == FEED_ERROR_MALFORMED)
+			nMalformed++;
+		else
+			nBadNumbers++;
+
+		if (vLog.size() < MAX_FEED_ERRORS)
+			vLog.push_back(FeedError{ nLines, nOffset, fer });
+	}
+
+	// Fold in the errors of the rows that follow, whose lines are numbered from the end of these
+	void merge(const FeedErrors& fe) {
+		nMalformed += fe.nMalformed;
+		nBadNumbers += fe.nBadNumbers;
+
+		for (size_t i = 0; i < fe.vLog.size() && vLog.size() < MAX_FEED_ERRORS; ++i)
+			vLog.push_back(FeedError{ fe.vLog[i].nLine + nLines, fe.vLog[i].nOffset, fe.vLog[i].fer });
+
+		nLines += fe.nLines;
+	}
+
+	static constexpr size_t MAX_FEED_ERRORS = 100;
+};
+
+// Book fields of one side recently read from a feed, byte for byte, with the levels they were read to.
+// Feeds often repeat a side from row to row, and a field found here needs neither its parse nor its
+// recording in the level summaries, which already hold its pairs. A field is looked up in the slot its
+// hash picks and overwrites whatever that slot held once its levels are recorded.
+class BookSideMemo
+{
+public:
+	BookSideMemo() : m_iLast(NO_SLOT) {}
+
+	// Slot holding the levels of a field, or NO_SLOT when the field is not kept
+	int find(const string_view& svField, uint64_t nHash) const {
+		int iSlot = static_cast<int>(nHash & (MEMO_SLOTS - 1));
+		const MemoSlot& ms = m_vSlots[iSlot];
+		return (ms.bUsed && ms.nHash == nHash && svField == ms.szField) ? iSlot : NO_SLOT;
+	}
+
+	// Keep the levels of a field once they are recorded in the level summaries
+	int store(const string_view& svField, uint64_t nHash, const vecPriceQty& vps) {
+		int iSlot = static_cast<int>(nHash & (MEMO_SLOTS - 1));
+		MemoSlot& ms = m_vSlots[iSlot];
+		ms.nHash = nHash;
+		ms.szField.assign(svField.data(), svField.size());
+		ms.vps = vps;
+		ms.bUsed = true;
+		return iSlot;
+	}
+
+	const vecPriceQty& levels(int iSlot) const	{ return m_vSlots[iSlot].vps; }
+
+	// Slot of the field of the last row applied to the book
+	int last() const							{ return m_iLast; }
+	void setLast(int iSlot)						{ m_iLast = iSlot; }
+
+	// Hash a field eight bytes at a time, which costs far less than reading its levels
+	static uint64_t hashField(const string_view& svField) {
+		const char* p = svField.data();
+		size_t n = svField.size();
+
+		uint64_t h = n * 0x9e3779b97f4a7c15ULL;
+		for (; n >= 8; p += 8, n -= 8) {
+			uint64_t w;
+			memcpy(&w, p, 8);
+			h = (h ^ w) * 0xff51afd7ed558ccdULL;
+			h ^= h >> 32;
+		}
+		if (n > 0) {
+			uint64_t w = 0;
+			memcpy(&w, p, n);
+			h = (h ^ w) * 0xff51afd7ed558ccdULL;
+		}
+
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ULL;
+		h ^= h >> 33;
+		return h;
+	}
+
+	static constexpr int NO_SLOT = -1;
+
+private:
+	struct MemoSlot {
+		uint64_t		nHash;
+		string			szField;
+		vecPriceQty		vps;
+		bool			bUsed;
+
+		MemoSlot() : nHash(0), bUsed(false) {}
+	};
+
+	static constexpr size_t MEMO_SLOTS = 16;		// Power of 2
+
+	MemoSlot	m_vSlots[MEMO_SLOTS];
+	int			m_iLast;
+};
 
 struct OrderBook
 {
@@ -27,8 +334,64 @@ struct OrderBook
 	vector<int>		vecBidTotal;		// Run up total of bid feeds at each level
 	vector<int>		vecAskTotal;		// Run up total of ask feeds at each level
 
-	mapSpreadLevels	mapBestSpread;		// Best inside market spreads
+	BestSpreads		bestSpreads;		// Best inside market spreads
 
 	vecLevels		vecBidLevels;		// Summary of market bid levels
 	vecLevels		vecAskLevels;		// Summary of market ask levels
+
+	OBBookEngine	bookEngine;			// Live book as of the last feed
+
+	FeedErrors		feedErrors;			// Rows skipped as unreadable
+
+	RunStats		runStats;			// Counts and stage times of the read
+
+	BookAnalytics	analytics;			// Spread and microstructure statistics of the feeds
+
+	BookSideMemo	bidMemo;			// Bid and ask fields recently read, kept for the read only
+	BookSideMemo	askMemo;
+
+	// Put every level summary in price then quantity order once the feeds are read
+	void sortLevels() {
+		for (auto& ls : vecBidLevels) ls.sort();
+		for (auto& ls : vecAskLevels) ls.sort();
+	}
+
+	// Record the memory the book ended up with
+	void finishStats() {
+		if (!RunStats::ENABLED)
+			return;
+
+		runStats.nLevelBytes = 0;
+		for (const auto& ls : vecBidLevels) runStats.nLevelBytes += ls.capacityBytes();
+		for (const auto& ls : vecAskLevels) runStats.nLevelBytes += ls.capacityBytes();
+		runStats.nPeakRssKb = RunStats::peakRssKb();
+	}
+
+	// Fold in the partial book of the rows that follow this one's. Books must be merged in row
+	// order so a spread logged again by the later rows keeps their ladder, as a sequential read would.
+	void merge(OrderBook&& ob) {
+
+		nBookFeeds += ob.nBookFeeds;
+
+		for (size_t i = 0; i < vecBidTotal.size() && i < ob.vecBidTotal.size(); ++i) vecBidTotal[i] += ob.vecBidTotal[i];
+		for (size_t i = 0; i < vecAskTotal.size() && i < ob.vecAskTotal.size(); ++i) vecAskTotal[i] += ob.vecAskTotal[i];
+
+		mergeLevels(vecBidLevels, ob.vecBidLevels);
+		mergeLevels(vecAskLevels, ob.vecAskLevels);
+
+		bookEngine.merge(std::move(ob.bookEngine));
+		bestSpreads.merge(ob.bestSpreads);
+		feedErrors.merge(ob.feedErrors);
+		runStats.merge(ob.runStats);
+		analytics.merge(ob.analytics);
+	}
+
+private:
+	static void mergeLevels(vecLevels& vl, const vecLevels& vlOther) {
+		if (vl.size() < vlOther.size())
+			vl.resize(vlOther.size());
+
+		for (size_t i = 0; i < vlOther.size(); ++i)
+			vl[i].merge(vlOther[i]);
+	}
 };
@@ -0,0 +1,396 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Binary cache of the order book of each source feed
+//==============================================================
+#include "pch.h"
+#include <iostream>
+#include <string>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+#include "OrderSource.hpp"
+#include "OrderCache.hpp"
+
+// Append the fields of a cache image in native layout, the byte order marker rejects foreign images
+class CacheWriter
+{
+public:
+	explicit CacheWriter(string& szBuf) : m_szBuf(szBuf) {}
+
+	template <typename T> void put(T t)	{ m_szBuf.append(reinterpret_cast<const char*>(&t), sizeof(T)); }
+
+	void putPairs(const vecPriceQty& vpi) {
+		put(static_cast<uint32_t>(vpi.size()));
+		for (const auto& pi : vpi) {
+			put(static_cast<int32_t>(pi.first.units()));
+			put(static_cast<int32_t>(pi.second));
+		}
+	}
+
+	void putInts(const vector<int>& vi) {
+		put(static_cast<uint32_t>(vi.size()));
+		for (int n : vi)
+			put(static_cast<int32_t>(n));
+	}
+
+private:
+	string&		m_szBuf;
+};
+
+// Read back the fields of a cache image, failing rather than reading past its end
+class CacheReader
+{
+public:
+	CacheReader(const char* pData, size_t nSize) : m_pCur(pData), m_pEnd(pData + nSize), m_bOk(true) {}
+
+	template <typename T> T get() {
+		T t = T();
+		if (static_cast<size_t>(m_pEnd - m_pCur) < sizeof(T)) {
+			m_bOk = false;
+			return t;
+		}
+		memcpy(&t, m_pCur, sizeof(T));
+		m_pCur += sizeof(T);
+		return t;
+	}
+
+	// Counts are checked against the bytes left so a damaged image cannot ask for huge allocations
+	uint32_t getCount(size_t nItemBytes) {
+		uint32_t n = get<uint32_t>();
+		if (static_cast<uint64_t>(n) * nItemBytes > static_cast<uint64_t>(m_pEnd - m_pCur)) {
+			m_bOk = false;
+			return 0;
+		}
+		return n;
+	}
+
+	void getPairs(vecPriceQty& vpi) {
+		uint32_t n = getCount(2 * sizeof(int32_t));
+		vpi.resize(n);
+		for (auto& pi : vpi) {
+			pi.first = OBPrice::fromUnits(get<int32_t>());
+			pi.second = get<int32_t>();
+		}
+	}
+
+	void getInts(vector<int>& vi) {
+		uint32_t n = getCount(sizeof(int32_t));
+		vi.resize(n);
+		for (auto& ni : vi)
+			ni = get<int32_t>();
+	}
+
+	const char* pos() const		{ return m_pCur; }
+	size_t left() const			{ return static_cast<size_t>(m_pEnd - m_pCur); }
+	bool ok() const				{ return m_bOk; }
+
+private:
+	const char*		m_pCur;
+	const char*		m_pEnd;
+	bool			m_bOk;
+};
+
+uint64_t OBBookCache::hashBytes(const char* pData, size_t nSize) {
+
+	const uint64_t nPrime1 = 0x9E3779B185EBCA87ULL;
+	const uint64_t nPrime2 = 0xC2B2AE3D27D4EB4FULL;
+
+	auto rotl = [](uint64_t n, int nBits) { return (n << nBits) | (n >> (64 - nBits)); };
+	auto mix = [&](uint64_t h, uint64_t w) { return rotl(h + w * nPrime2, 31) * nPrime1; };
+
+	// Four independent lanes of words keep the hash close to memory speed on feed sized files
+	uint64_t h[4] = { nPrime1 + nPrime2, nPrime2, 0, 0 - nPrime1 };
+
+	size_t i = 0;
+	for (; i + 32 <= nSize; i += 32) {
+		for (int j = 0; j < 4; ++j) {
+			uint64_t w;
+			memcpy(&w, pData + i + j * 8, 8);
+			h[j] = mix(h[j], w);
+		}
+	}
+
+	uint64_t nHash = rotl(h[0], 1) + rotl(h[1], 7) + rotl(h[2], 12) + rotl(h[3], 18) + nSize;
+
+	for (; i < nSize; ++i)
+		nHash = rotl(nHash ^ (static_cast<uint8_t>(pData[i]) * nPrime1), 11) * nPrime2;
+
+	// Spread the last bytes over the whole hash
+	nHash ^= nHash >> 33;
+	nHash *= nPrime2;
+	nHash ^= nHash >> 29;
+
+	return nHash;
+}
+
+bool OBBookCache::makeKey(const OrderBook& ob, CacheKey& ck) {
+
+	try {
+		OBMappedFile mf(ob.szSourceFeed);
+
+		ck.nSize = mf.size();
+		ck.nModified = mf.getModifiedTime();
+		ck.nHash = hashBytes(mf.data(), mf.size());
+		ck.nBookLevels = ob.nBookLevels;
+		ck.nTick = ob.bookEngine.getTick();
+		ck.nBestSpreads = ob.bestSpreads.getCapacity();
+		ck.nPriceDecimals = OB_PRICE_DECIMALS;
+	}
+	catch (...) {
+		return false;
+	}
+
+	return true;
+}
+
+bool OBBookCache::save(const OrderBook& ob, const CacheKey& ck) {
+
+	try {
+		// The book itself
+		string szBody;
+		CacheWriter cwBody(szBody);
+
+		cwBody.put(static_cast<int32_t>(ob.nBookFeeds));
+		cwBody.putInts(ob.vecBidTotal);
+		cwBody.putInts(ob.vecAskTotal);
+
+		for (const vecLevels* pvl : { &ob.vecBidLevels, &ob.vecAskLevels }) {
+			cwBody.put(static_cast<uint32_t>(pvl->size()));
+			for (const auto& ls : *pvl)
+				cwBody.putPairs(ls.pairs());
+		}
+
+		cwBody.put(static_cast<uint32_t>(ob.bestSpreads.size()));
+		for (const auto& bs : ob.bestSpreads) {
+			cwBody.put(static_cast<int32_t>(bs.prSpread.units()));
+			cwBody.put(static_cast<int32_t>(bs.prBidPrice.units()));
+			cwBody.putPairs(bs.bal.vBidQty);
+			cwBody.putPairs(bs.bal.vAskQty);
+		}
+
+		const OBBookEngine& obe = ob.bookEngine;
+		const BookChecks& bc = obe.getChecks();
+		cwBody.put(static_cast<uint8_t>(obe.isSeeded()));
+		for (int n : { bc.nSnapshots, bc.nUnchanged, bc.nCrossed, bc.nLocked, bc.nOneSided, bc.nUnordered, bc.nOffLadder, bc.nBidChanges, bc.nAskChanges })
+			cwBody.put(static_cast<int32_t>(n));
+		cwBody.putPairs(obe.getBookBid());
+		cwBody.putPairs(obe.getBookAsk());
+
+		const FeedErrors& fe = ob.feedErrors;
+		cwBody.put(fe.nLines);
+		cwBody.put(static_cast<int32_t>(fe.nMalformed));
+		cwBody.put(static_cast<int32_t>(fe.nBadNumbers));
+		cwBody.put(static_cast<uint32_t>(fe.vLog.size()));
+		for (const auto& e : fe.vLog) {
+			cwBody.put(e.nLine);
+			cwBody.put(e.nOffset);
+			cwBody.put(static_cast<uint8_t>(e.fer));
+		}
+
+		const BookAnalytics& ba = ob.analytics;
+		for (uint64_t n : { ba.m_nUpdates, ba.m_nBooks, ba.m_nCrossed })
+			cwBody.put(n);
+		for (uint64_t n : ba.m_vSpreadBins)
+			cwBody.put(n);
+		for (int64_t n : { ba.m_nSpreadSum, ba.m_nMinSpread, ba.m_nMaxSpread })
+			cwBody.put(n);
+		cwBody.put(ba.m_dSpreadTimeSum);
+		for (long long n : { ba.m_nSpreadMs, ba.m_nFirstMs, ba.m_nLastMs })
+			cwBody.put(static_cast<int64_t>(n));
+		cwBody.put(static_cast<uint8_t>(ba.m_bSpread));
+		cwBody.put(ba.m_nLastSpread);
+		cwBody.put(ba.m_dLastMid);
+		cwBody.put(ba.m_dLastMicro);
+		cwBody.put(static_cast<int64_t>(ba.m_nFirstPoint));
+		cwBody.put(static_cast<int64_t>(ba.m_nWidthMs));
+		cwBody.put(static_cast<uint32_t>(ba.m_vSeries.size()));
+		for (const auto& sp : ba.m_vSeries) {
+			cwBody.put(static_cast<int64_t>(sp.nTimeMs));
+			cwBody.put(sp.nBooks);
+			cwBody.put(sp.dMidSum);
+			cwBody.put(sp.dMicroSum);
+		}
+		cwBody.put(static_cast<uint32_t>(ba.m_vImbalance.size()));
+		for (const auto& li : ba.m_vImbalance) {
+			cwBody.put(li.nBooks);
+			cwBody.put(li.dSum);
+		}
+
+		// Header identifying the format, the source feed and the body
+		string szHead(SZ_CACHE_MAGIC, strlen(SZ_CACHE_MAGIC) + 1);
+		CacheWriter cwHead(szHead);
+
+		cwHead.put(CACHE_VERSION);
+		cwHead.put(CACHE_BYTE_ORDER);
+		cwHead.put(ck.nSize);
+		cwHead.put(ck.nModified);
+		cwHead.put(ck.nHash);
+		cwHead.put(ck.nBookLevels);
+		cwHead.put(ck.nTick);
+		cwHead.put(ck.nBestSpreads);
+		cwHead.put(ck.nPriceDecimals);
+		cwHead.put(static_cast<uint64_t>(szBody.size()));
+		cwHead.put(hashBytes(szBody.data(), szBody.size()));
+
+		// Write a temporary file renamed over the old cache, so a cache is never read half written
+		string szCacheFile = getCacheFile(ob.szSourceFeed);
+		string szTempFile = szCacheFile + ".tmp";
+
+		ofstream ofs(szTempFile, ios::out | ios::binary | ios::trunc);
+		ofs.write(szHead.data(), szHead.size());
+		ofs.write(szBody.data(), szBody.size());
+		ofs.close();
+
+		if (!ofs) {
+			std::remove(szTempFile.c_str());
+			return false;
+		}
+
+#ifdef _WIN32
+		// Windows does not rename over an existing file
+		std::remove(szCacheFile.c_str());
+#endif
+		if (std::rename(szTempFile.c_str(), szCacheFile.c_str()) != 0) {
+			std::remove(szTempFile.c_str());
+			return false;
+		}
+	}
+	catch (...) {
+		return false;
+	}
+
+	return true;
+}
+
+bool OBBookCache::load(OrderBook& ob, const CacheKey& ck) {
+
+	try {
+		OBMappedFile mf(getCacheFile(ob.szSourceFeed));
+		CacheReader cr(mf.data(), mf.size());
+
+		// Reject images of another format, machine, source feed or book settings
+		size_t nMagic = strlen(SZ_CACHE_MAGIC) + 1;
+		if (mf.size() < nMagic || memcmp(mf.data(), SZ_CACHE_MAGIC, nMagic) != 0)
+			return false;
+		for (size_t i = 0; i < nMagic; ++i)
+			cr.get<char>();
+
+		if (cr.get<uint32_t>() != CACHE_VERSION || cr.get<uint32_t>() != CACHE_BYTE_ORDER)
+			return false;
+
+		CacheKey ckCache;
+		ckCache.nSize = cr.get<uint64_t>();
+		ckCache.nModified = cr.get<int64_t>();
+		ckCache.nHash = cr.get<uint64_t>();
+		ckCache.nBookLevels = cr.get<int32_t>();
+		ckCache.nTick = cr.get<int32_t>();
+		ckCache.nBestSpreads = cr.get<int32_t>();
+		ckCache.nPriceDecimals = cr.get<int32_t>();
+		if (!cr.ok() || !ckCache.serves(ck))
+			return false;
+
+		uint64_t nBodySize = cr.get<uint64_t>();
+		uint64_t nBodyHash = cr.get<uint64_t>();
+		if (!cr.ok() || nBodySize != cr.left() || nBodyHash != hashBytes(cr.pos(), cr.left()))
+			return false;
+
+		// Read into a book of its own so a failed load leaves the caller's book as it was
+		OrderBook obCache;
+		obCache.szSourceFeed = ob.szSourceFeed;
+		obCache.nBookLevels = ob.nBookLevels;
+		obCache.nBookFeeds = cr.get<int32_t>();
+		cr.getInts(obCache.vecBidTotal);
+		cr.getInts(obCache.vecAskTotal);
+
+		// Level summaries were saved sorted and their image is checked, so the pairs are taken as they are
+		for (vecLevels* pvl : { &obCache.vecBidLevels, &obCache.vecAskLevels }) {
+			pvl->resize(cr.getCount(sizeof(uint32_t)));
+			for (auto& ls : *pvl) {
+				vecPriceQty vpi;
+				cr.getPairs(vpi);
+				ls.assignSorted(std::move(vpi));
+			}
+		}
+
+		// Spreads were saved tightest first, the widest ones past the capacity asked for are dropped
+		obCache.bestSpreads.setCapacity(ob.bestSpreads.getCapacity());
+		uint32_t nSpreads = cr.getCount(2 * sizeof(int32_t) + 2 * sizeof(uint32_t));
+		for (uint32_t i = 0; i < nSpreads && cr.ok(); ++i) {
+			OBPrice prSpread = OBPrice::fromUnits(cr.get<int32_t>());
+			OBPrice prBidPrice = OBPrice::fromUnits(cr.get<int32_t>());
+
+			BidAskLevels bal;
+			cr.getPairs(bal.vBidQty);
+			cr.getPairs(bal.vAskQty);
+			obCache.bestSpreads.update(prSpread, prBidPrice, bal);
+		}
+
+		bool bSeeded = cr.get<uint8_t>() != 0;
+		BookChecks bc;
+		for (int* pn : { &bc.nSnapshots, &bc.nUnchanged, &bc.nCrossed, &bc.nLocked, &bc.nOneSided, &bc.nUnordered, &bc.nOffLadder, &bc.nBidChanges, &bc.nAskChanges })
+			*pn = cr.get<int32_t>();
+
+		vecPriceQty vBookBid, vBookAsk;
+		cr.getPairs(vBookBid);
+		cr.getPairs(vBookAsk);
+
+		FeedErrors& fe = obCache.feedErrors;
+		fe.nLines = cr.get<uint64_t>();
+		fe.nMalformed = cr.get<int32_t>();
+		fe.nBadNumbers = cr.get<int32_t>();
+		fe.vLog.resize(cr.getCount(2 * sizeof(uint64_t) + sizeof(uint8_t)));
+		for (auto& e : fe.vLog) {
+			e.nLine = cr.get<uint64_t>();
+			e.nOffset = cr.get<uint64_t>();
+			e.fer = (cr.get<uint8_t>() == FeedErrors::FEED_ERROR_MALFORMED) ? FeedErrors::FEED_ERROR_MALFORMED : FeedErrors::FEED_ERROR_BADNUMBER;
+		}
+
+		BookAnalytics& ba = obCache.analytics;
+		for (uint64_t* pn : { &ba.m_nUpdates, &ba.m_nBooks, &ba.m_nCrossed })
+			*pn = cr.get<uint64_t>();
+		for (uint64_t& n : ba.m_vSpreadBins)
+			n = cr.get<uint64_t>();
+		for (int64_t* pn : { &ba.m_nSpreadSum, &ba.m_nMinSpread, &ba.m_nMaxSpread })
+			*pn = cr.get<int64_t>();
+		ba.m_dSpreadTimeSum = cr.get<double>();
+		for (long long* pn : { &ba.m_nSpreadMs, &ba.m_nFirstMs, &ba.m_nLastMs })
+			*pn = cr.get<int64_t>();
+		ba.m_bSpread = cr.get<uint8_t>() != 0;
+		ba.m_nLastSpread = cr.get<int64_t>();
+		ba.m_dLastMid = cr.get<double>();
+		ba.m_dLastMicro = cr.get<double>();
+		ba.m_nFirstPoint = cr.get<int64_t>();
+		ba.m_nWidthMs = cr.get<int64_t>();
+		ba.m_vSeries.resize(cr.getCount(sizeof(int64_t) + sizeof(uint64_t) + 2 * sizeof(double)));
+		for (auto& sp : ba.m_vSeries) {
+			sp.nTimeMs = cr.get<int64_t>();
+			sp.nBooks = cr.get<uint64_t>();
+			sp.dMidSum = cr.get<double>();
+			sp.dMicroSum = cr.get<double>();
+		}
+		ba.m_vImbalance.resize(cr.getCount(sizeof(uint64_t) + sizeof(double)));
+		for (auto& li : ba.m_vImbalance) {
+			li.nBooks = cr.get<uint64_t>();
+			li.dSum = cr.get<double>();
+		}
+
+		if (!cr.ok() || cr.left() != 0 || ba.m_nWidthMs <= 0)
+			return false;
+
+		obCache.bookEngine.setTick(ob.bookEngine.getTick());
+		obCache.analytics.setTick(ob.analytics.getTick());
+		if (bSeeded)
+			obCache.bookEngine.restore(bc, vBookBid, vBookAsk);
+
+		ob = std::move(obCache);
+	}
+	catch (...) {
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+#include "OrderBook.hpp"
+
+// Binary image of the finished order book of a source feed, kept next to the feed file. The image is
+// keyed by the size, modification time and content hash of the feed and by the book settings, so a
+// later run loads it instead of reading the feed again for as long as none of them change.
+class OBBookCache
+{
+public:
+	OBBookCache() = delete;
+
+	// Source feed identity a cache is made from
+	struct CacheKey {
+		uint64_t	nSize;
+		int64_t		nModified;
+		uint64_t	nHash;
+		int32_t		nBookLevels;
+		int32_t		nTick;
+		int32_t		nBestSpreads;
+		int32_t		nPriceDecimals;
+
+		// A cache keeping more spreads than asked for serves any smaller number of them
+		bool serves(const CacheKey& ck) const {
+			return nSize == ck.nSize && nModified == ck.nModified && nHash == ck.nHash && nBookLevels == ck.nBookLevels && nTick == ck.nTick && nBestSpreads >= ck.nBestSpreads && nPriceDecimals == ck.nPriceDecimals;
+		}
+	};
+
+	// Identify the source feed of a book, before it is read so a feed changing meanwhile is not cached as read.
+	// Returns false when the feed cannot be mapped.
+	static bool makeKey(const OrderBook& ob, CacheKey& ck);
+
+	// Load the cached book of ob.szSourceFeed into ob, returning false and leaving ob untouched when
+	// there is no cache or it was made from another source feed or book settings
+	static bool load(OrderBook& ob, const CacheKey& ck);
+
+	// Store the finished book, replacing any older cache. A cache that cannot be written is skipped.
+	static bool save(const OrderBook& ob, const CacheKey& ck);
+
+	static string getCacheFile(const string& szSourceFeed)	{ return szSourceFeed + SZ_CACHE_EXTENSION; }
+
+private:
+	static uint64_t hashBytes(const char* pData, size_t nSize);
+
+	static constexpr uint32_t CACHE_VERSION = 6;
+	static constexpr uint32_t CACHE_BYTE_ORDER = 0x01020304;
+	static constexpr auto SZ_CACHE_MAGIC = "OBCACHE";
+	static constexpr auto SZ_CACHE_EXTENSION = ".obcache";
+};
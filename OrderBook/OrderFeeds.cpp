@@ -9,13 +9,18 @@
 #include <iostream>
 #include <vector>
 #include <fstream>
-#include <boost/regex.hpp>
-#include <boost/lexical_cast.hpp>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <climits>
+#include <cstring>
 #include <boost/algorithm/string.hpp>
 #include <boost/range/irange.hpp>
 #include <boost/format.hpp>
 #include <boost/thread.hpp>
 #include <boost/asio/thread_pool.hpp>
+#include <boost/asio/post.hpp>
 #include <boost/foreach.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/xml_parser.hpp>
@@ -23,10 +28,14 @@
 using namespace std;
 using namespace boost;
 
+#include "OrderSource.hpp"
+#include "OrderCache.hpp"
+#include "OrderScan.hpp"
+#include "OrderPipe.hpp"
 #include "OrderFeeds.hpp"
 #include "OrderPlot.hpp"
 
-OBStream::OBStream(const string& szFile, const int& nMaxBookLevels) {
+OBStream::OBStream(const string& szFile, const int& nMaxBookLevels) : m_fim(FEED_INPUT_MAPPED), m_nParseThreads(1), m_nChunkBytes(0), m_nShardWorkers(0), m_nFollowIdleMs(0), m_bStopFollow(false), m_bCache(false), m_bFromCache(false) {
 
 	// Stub to allocate function name at compile time
 	static const string SZ_OBSTREAM_CONSTRUCTOR = "OBStream::OBStream";
@@ -53,57 +62,111 @@ OBStream::OBStream(const string& szFile, const int& nMaxBookLevels) {
 	}
 }
 
-using boost::lexical_cast;
-using boost::bad_lexical_cast;
+// Feed fields are plain ASCII so the character classes are tested without locale lookups
+static inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+static inline bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\f' || c == '\v'; }
 
-int OBStream::addLevels(vecLevels& vLevels, const string& szLevel, const regex& re, vecPairInt& vps) {
+static inline const char* skipDigits(const char* p, const char* pEnd) {
+	while (p != pEnd && isDigit(*p)) ++p;
+	return p;
+}
 
-	// Stub to allocate function name at compile time
-	static const string SZ_OBSTREAM_ADDLEVELS = "addLevels";
-	
-	// Initialize the level processed so far
-	int iLevel = 0;
+// Digits of a price, with the decimal point of prices quoted in decimals
+static inline const char* skipPrice(const char* p, const char* pEnd) {
+	while (p != pEnd && (isDigit(*p) || *p == '.')) ++p;
+	return p;
+}
 
-	try {
-		for (sregex_iterator rit = sregex_iterator(szLevel.begin(), szLevel.end(), re); rit != sregex_iterator(); ++rit, ++iLevel)
-		{
-			// Read only the user configured levels
-			if (iLevel == m_pOrderBook->nBookLevels)
-				break;
+static inline const char* skipSpaces(const char* p, const char* pEnd) {
+	while (p != pEnd && isSpace(*p)) ++p;
+	return p;
+}
 
-			// Read regex match and extract price and quantity
-			smatch m = *rit;
-			int nPrice = boost::lexical_cast<int>(m.str(1));
-			int nQty   = boost::lexical_cast<int>(m.str(2));
+// Convert a run of decimal digits, failing on empty runs and int overflow
+static bool parseDigits(const char* pBeg, const char* pEnd, int& n) {
 
-			// Add the quantity of this price in its quantity set
-			try {
-				mapPriceQty& mpq = vLevels.at(iLevel);
+	if (pBeg == pEnd)
+		return false;
 
-				// Insert quantity to quantity set and quantity set to map using [] operator
-				mpq[nPrice].insert(nQty);
-			}
-			catch (const std::out_of_range) {
+	int nVal = 0;
+	for (const char* p = pBeg; p != pEnd; ++p) {
+		int nDigit = *p - '0';
+		if (nVal > (INT_MAX - nDigit) / 10)
+			return false;
+		nVal = nVal * 10 + nDigit;
+	}
+
+	n = nVal;
+	return true;
+}
 
-				// This is a new level therefore a new level with price and quantities must be added
-				setInt qtyset;
-				qtyset.insert(nQty);
+// Fixed width run of digits, as found in time stamps
+static bool parseFixed(const char* p, int nWidth, int& n) {
+	return skipDigits(p, p + nWidth) == p + nWidth && parseDigits(p, p + nWidth, n);
+}
 
-				// Insert quantity set to map with [] operator
-				mapPriceQty mpq;
-				mpq[nPrice] = qtyset;
+// Milliseconds since the epoch of a UTC calendar time, failing on fields out of range
+static bool toEpochMs(int nYear, int nMonth, int nDay, int nHour, int nMin, int nSec, int nMs, long long& nTimeMs) {
 
-				// Save this next level
-				vLevels.push_back(mpq);
-			}
-			catch (...) {
-				TracedException te(SZ_OBSTREAM_EXCEPTION, TracedException::SZ_EXCEPTION_UNEXPECTED, SZ_OBSTREAM_ADDLEVELS);
-				throw te;
-			}
+	if (nMonth < 1 || nMonth > 12 || nDay < 1 || nDay > 31 || nHour > 23 || nMin > 59 || nSec > 60 || nMs > 999)
+		return false;
+
+	// Days since 1970-01-01 in the proleptic Gregorian calendar, counting years from March
+	int nMarchYear = nYear - (nMonth <= 2 ? 1 : 0);
+	long long nEra = (nMarchYear >= 0 ? nMarchYear : nMarchYear - 399) / 400;
+	long long nYearOfEra = nMarchYear - nEra * 400;
+	long long nDayOfYear = (153 * (nMonth > 2 ? nMonth - 3 : nMonth + 9) + 2) / 5 + nDay - 1;
+	long long nDayOfEra = nYearOfEra * 365 + nYearOfEra / 4 - nYearOfEra / 100 + nDayOfYear;
+	long long nDays = nEra * 146097 + nDayOfEra - 719468;
+
+	nTimeMs = (((nDays * 24 + nHour) * 60 + nMin) * 60 + nSec) * 1000 + nMs;
+	return true;
+}
+
+OBStream::FEED_ROW_STATUS OBStream::readLevels(const string_view& svLevel, vecPriceQty& vps) const {
+
+	const char* pCur = svLevel.data();
+	const char* pEnd = pCur + svLevel.size();
+
+	OBPrice prPrice;
+	int nQty;
+
+	// Read only the user configured levels
+	vps.clear();
+	while (static_cast<int>(vps.size()) < m_pOrderBook->nBookLevels) {
 
-			// Insert scanned prices lowest to largest
-			vps.push_back(make_pair(nPrice, nQty));
+		FEED_LEVEL_STATUS fls = nextPriceQty(pCur, pEnd, prPrice, nQty);
+		if (fls == FEED_LEVEL_END)
+			break;
+		if (fls == FEED_LEVEL_BADNUMBER)
+			return FEED_ROW_BADNUMBER;
+
+		vps.push_back(make_pair(prPrice, nQty));
+	}
+
+	return FEED_ROW_BOOK;
+}
+
+size_t OBStream::addLevels(vecLevels& vLevels, const vecPriceQty& vps) {
+
+	// Stub to allocate function name at compile time
+	static const string SZ_OBSTREAM_ADDLEVELS = "addLevels";
+
+	try {
+		size_t nNewPairs = 0;
+		for (size_t iLevel = 0; iLevel < vps.size(); ++iLevel) {
+
+			// Open the summary of a level seen for the first time, then record the price and quantity
+			if (iLevel == vLevels.size())
+				vLevels.emplace_back();
+
+			if (vLevels[iLevel].insert(vps[iLevel].first, vps[iLevel].second))
+				nNewPairs++;
 		}
+		return nNewPairs;
+	}
+	catch (const TracedException&) {
+		throw;
 	}
 	catch (const std::bad_alloc&) {
 		TracedException te(SZ_OBSTREAM_EXCEPTION, TracedException::SZ_EXCEPTION_BADALLOC, SZ_OBSTREAM_ADDLEVELS);
@@ -113,35 +176,803 @@ int OBStream::addLevels(vecLevels& vLevels, const string& szLevel, const regex&
 		TracedException te(SZ_OBSTREAM_EXCEPTION, TracedException::SZ_EXCEPTION_UNEXPECTED, SZ_OBSTREAM_ADDLEVELS);
 		throw te;
 	}
-
-	// Return number of levels processed
-	return iLevel;
 }
 
-void OBStream::processLevel(const string& szBidLevel, const string& szAskLevel, const regex& reg) {
+OBStream::FEED_ROW_STATUS OBStream::processLevel(OrderBook& ob, const string_view& svBidLevel, const string_view& svAskLevel, long long nTimeMs) {
+
+	// Levels of the row being processed. Chunks are parsed on several threads, so each thread keeps
+	// its own and their storage is reused from row to row instead of allocated for every feed.
+	thread_local BidAskLevels bal;
 
-	BidAskLevels bal;
+	// A side read before is taken from the memo of the book rather than parsed again
+	uint64_t nBidHash = BookSideMemo::hashField(svBidLevel);
+	uint64_t nAskHash = BookSideMemo::hashField(svAskLevel);
+	int iBidSlot = ob.bidMemo.find(svBidLevel, nBidHash);
+	int iAskSlot = ob.askMemo.find(svAskLevel, nAskHash);
+	bool bBidKept = iBidSlot != BookSideMemo::NO_SLOT;
+	bool bAskKept = iAskSlot != BookSideMemo::NO_SLOT;
 
-	int nBidLevels = addLevels(m_pOrderBook->vecBidLevels, szBidLevel, reg, bal.vBidQty);
-	int nAskLevels = addLevels(m_pOrderBook->vecAskLevels, szAskLevel, reg, bal.vAskQty);
+	// Read both sides before touching the book, so a row with an unreadable number is skipped whole
+	bool bRead = (bBidKept || readLevels(svBidLevel, bal.vBidQty) == FEED_ROW_BOOK) && (bAskKept || readLevels(svAskLevel, bal.vAskQty) == FEED_ROW_BOOK);
+	ob.runStats.mark(RunStats::STATS_PARSE);
+	if (!bRead)
+		return FEED_ROW_BADNUMBER;
 
-	// Update the number of feeds
-	m_pOrderBook->nBookFeeds++;
+	// The level summaries already hold the pairs of a remembered side
+	size_t nNewPairs = 0;
+	if (bBidKept)
+		bal.vBidQty = ob.bidMemo.levels(iBidSlot);
+	else {
+		nNewPairs += addLevels(ob.vecBidLevels, bal.vBidQty);
+		iBidSlot = ob.bidMemo.store(svBidLevel, nBidHash, bal.vBidQty);
+	}
+
+	if (bAskKept)
+		bal.vAskQty = ob.askMemo.levels(iAskSlot);
+	else {
+		nNewPairs += addLevels(ob.vecAskLevels, bal.vAskQty);
+		iAskSlot = ob.askMemo.store(svAskLevel, nAskHash, bal.vAskQty);
+	}
+	ob.runStats.addNewPairs(nNewPairs);
+	ob.runStats.addReused((bBidKept ? 1 : 0) + (bAskKept ? 1 : 0));
+
+	// A row repeating both sides of the previous one would log the same spread and ladder again
+	bool bUnchanged = bBidKept && bAskKept && iBidSlot == ob.bidMemo.last() && iAskSlot == ob.askMemo.last();
+	ob.bidMemo.setLast(iBidSlot);
+	ob.askMemo.setLast(iAskSlot);
+
+	int nBidLevels = static_cast<int>(bal.vBidQty.size());
+	int nAskLevels = static_cast<int>(bal.vAskQty.size());
+
+	// Update the number of feeds and the live book
+	ob.nBookFeeds++;
+	ob.bookEngine.apply(bal);
+	ob.analytics.update(nTimeMs, bal.vBidQty, bal.vAskQty);
 
 	// Make sure the bid ask feeds are valid
-	if (nBidLevels == 0 || nAskLevels == 0)
-		return;
+	if (nBidLevels == 0 || nAskLevels == 0) {
+		ob.runStats.mark(RunStats::STATS_INSERT);
+		return FEED_ROW_BOOK;
+	}
 
 	// Update the number of bid and ask feeds at each level
-	for (auto itb = std::begin(m_pOrderBook->vecBidTotal); itb != std::end(m_pOrderBook->vecBidTotal) && boost::distance(std::begin(m_pOrderBook->vecBidTotal), itb) < nBidLevels; ++itb) { ++(*itb); }
-	for (auto ita = std::begin(m_pOrderBook->vecAskTotal); ita != std::end(m_pOrderBook->vecAskTotal) && boost::distance(std::begin(m_pOrderBook->vecAskTotal), ita) < nAskLevels; ++ita) { ++(*ita); }
+	for (auto itb = std::begin(ob.vecBidTotal); itb != std::end(ob.vecBidTotal) && boost::distance(std::begin(ob.vecBidTotal), itb) < nBidLevels; ++itb) { ++(*itb); }
+	for (auto ita = std::begin(ob.vecAskTotal); ita != std::end(ob.vecAskTotal) && boost::distance(std::begin(ob.vecAskTotal), ita) < nAskLevels; ++ita) { ++(*ita); }
 
 	// Log the inside market spread and bid ask price and size on this feed
-	const pairInt& pbs = bal.vBidQty.at(0);	// fetch first bid pair
-	const pairInt& pas = bal.vAskQty.at(0);	// fetch first ask pair
+	const pairPriceQty& pbs = bal.vBidQty.at(0);	// fetch first bid pair
+	const pairPriceQty& pas = bal.vAskQty.at(0);	// fetch first ask pair
 
 	// Log spread key, bid price key, and levels
-	m_pOrderBook->mapBestSpread[pas.first - pbs.first][pbs.first] = bal;	// calculate spread and log it with associated bid and ask
+	if (!bUnchanged)
+		ob.bestSpreads.update(pas.first - pbs.first, pbs.first, bal);	// calculate spread and log it with associated bid and ask
+
+	ob.runStats.mark(RunStats::STATS_INSERT);
+	return FEED_ROW_BOOK;
+}
+
+OBStream::FEED_INPUT_MODE OBStream::toInputMode(const string& szMode) {
+
+	if (boost::iequals(szMode, "stream"))
+		return FEED_INPUT_STREAM;
+	if (boost::iequals(szMode, "follow"))
+		return FEED_INPUT_FOLLOW;
+	if (boost::iequals(szMode, "pipeline"))
+		return FEED_INPUT_PIPELINE;
+
+	return FEED_INPUT_MAPPED;
+}
+
+void OBStream::readFeeds(int nHeaderLines) {
+
+	// Stub to allocate function name at compile time
+	static const string SZ_OBSTREAM_READFEEDS = "readFeeds";
+
+	// A compressed archive is inflated front to back once, it does not grow and its rows cannot be sliced in place
+	bool bCompressed = OBCompressedFile::codecOf(getSourceFeed()) != OBCompressedFile::FEED_CODEC_NONE;
+	if (bCompressed && (m_fim == FEED_INPUT_FOLLOW || isSharded()))
+		throw TracedException(SZ_OBSTREAM_EXCEPTION, "Compressed source feed " + getSourceFeed() + " can be neither followed nor sharded", SZ_OBSTREAM_READFEEDS);
+
+	if (m_fim == FEED_INPUT_FOLLOW) {
+		followRows(nHeaderLines);
+		return;
+	}
+
+	// A sharded feed has no single book to keep in the cache
+	if (isSharded()) {
+		readShards(nHeaderLines);
+		return;
+	}
+
+	// The cached book of an unchanged source feed replaces the whole read
+	OBBookCache::CacheKey ck;
+	bool bCacheKey = m_bCache && OBBookCache::makeKey(*m_pOrderBook, ck);
+
+	if (bCacheKey && OBBookCache::load(*m_pOrderBook, ck)) {
+		m_bFromCache = true;
+		m_pOrderBook->finishStats();
+		return;
+	}
+
+	if (bCompressed)
+		readCompressed(nHeaderLines);
+	else if (m_fim == FEED_INPUT_STREAM) {
+		ifstream file(getSourceFeed());
+		string line;
+		uint64_t nOffset = 0;
+
+		m_pOrderBook->runStats.beginRow();
+		while (getline(file, line)) {
+			m_pOrderBook->runStats.addLine(line.size() + 1);
+			m_pOrderBook->runStats.mark(RunStats::STATS_READ);
+
+			m_pOrderBook->feedErrors.nLines++;
+			if (nHeaderLines > 0)
+				--nHeaderLines;
+			else
+				readRow(*m_pOrderBook, line, nOffset);
+
+			nOffset += line.size() + 1;
+			m_pOrderBook->runStats.beginRow();
+		}
+	}
+	else if (m_fim == FEED_INPUT_PIPELINE)
+		readPipeline(nHeaderLines);
+	else {
+		// Slice rows straight out of the mapped pages
+		OBMappedFile mf(getSourceFeed());
+
+		if (m_nParseThreads > 1)
+			readChunks(mf.data(), mf.data() + mf.size(), nHeaderLines);
+		else
+			readRows(*m_pOrderBook, mf.data(), mf.data() + mf.size(), nHeaderLines, 0);
+	}
+
+	m_pOrderBook->runStats.lap();
+	m_pOrderBook->sortLevels();
+	m_pOrderBook->runStats.mark(RunStats::STATS_INSERT);
+	m_pOrderBook->finishStats();
+
+	if (bCacheKey)
+		OBBookCache::save(*m_pOrderBook, ck);
+}
+
+void OBStream::readRow(OrderBook& ob, const string_view& svLine, uint64_t nOffset) {
+
+	countRow(ob, processRow(ob, svLine), nOffset);
+}
+
+void OBStream::countRow(OrderBook& ob, FEED_ROW_STATUS frs, uint64_t nOffset) {
+
+	if (frs == FEED_ROW_BOOK)
+		ob.runStats.addAccepted();
+	else if (frs == FEED_ROW_SKIP)
+		ob.runStats.addSkipped();
+	else {
+		ob.runStats.addRejected();
+		ob.feedErrors.add(frs == FEED_ROW_MALFORMED ? FeedErrors::FEED_ERROR_MALFORMED : FeedErrors::FEED_ERROR_BADNUMBER, nOffset);
+	}
+}
+
+int OBStream::readRows(OrderBook& ob, const char* pBeg, const char* pEnd, int nHeaderLines, uint64_t nOffset) {
+
+	for (const char* p = pBeg; p != pEnd; ) {
+		ob.runStats.beginRow();
+
+		const char* pEol = static_cast<const char*>(memchr(p, '\n', pEnd - p));
+		const char* pNext = (pEol != nullptr) ? pEol + 1 : pEnd;
+		if (pEol == nullptr)
+			pEol = pEnd;
+
+		// Drop the carriage return of CRLF rows as a text mode stream would
+		if (pEol != p && pEol[-1] == '\r')
+			--pEol;
+
+		ob.runStats.addLine(pNext - p);
+		ob.runStats.mark(RunStats::STATS_READ);
+
+		ob.feedErrors.nLines++;
+		if (nHeaderLines > 0)
+			--nHeaderLines;
+		else
+			readRow(ob, string_view(p, pEol - p), nOffset + (p - pBeg));
+
+		p = pNext;
+	}
+
+	// Header lines still to skip in the rows that follow
+	return nHeaderLines;
+}
+
+void OBStream::initPart(OrderBook& ob) const {
+
+	ob.nBookFeeds = 0;
+	ob.nBookLevels = m_pOrderBook->nBookLevels;
+	ob.vecBidTotal.resize(ob.nBookLevels);
+	ob.vecAskTotal.resize(ob.nBookLevels);
+	ob.bookEngine.setTick(m_pOrderBook->bookEngine.getTick());
+	ob.analytics.setTick(m_pOrderBook->analytics.getTick());
+	ob.bestSpreads.setCapacity(m_pOrderBook->bestSpreads.getCapacity());
+}
+
+void OBStream::readChunks(const char* pBeg, const char* pEnd, int nHeaderLines) {
+
+	// Cut the file in at least one chunk per thread, each ending on a row boundary
+	size_t nSize = pEnd - pBeg;
+	size_t nChunks = (m_nChunkBytes > 0) ? (nSize + m_nChunkBytes - 1) / m_nChunkBytes : 0;
+	nChunks = std::max(nChunks, static_cast<size_t>(m_nParseThreads));
+	size_t nStep = nSize / nChunks + 1;
+
+	vector<pair<const char*, const char*>> vChunks;
+	for (const char* p = pBeg; p != pEnd; ) {
+
+		const char* pCut = pEnd;
+		if (static_cast<size_t>(pEnd - p) > nStep) {
+			const char* pEol = static_cast<const char*>(memchr(p + nStep, '\n', pEnd - p - nStep));
+			pCut = (pEol != nullptr) ? pEol + 1 : pEnd;
+		}
+
+		vChunks.push_back(make_pair(p, pCut));
+		p = pCut;
+	}
+
+	// Parse every chunk into its own partial book
+	vector<OrderBook> vParts(vChunks.size());
+	vector<std::exception_ptr> vErrors(vChunks.size());
+
+	boost::asio::thread_pool pool(m_nParseThreads);
+
+	for (size_t i = 0; i < vChunks.size(); ++i) {
+
+		initPart(vParts[i]);
+
+		// Only the first chunk starts with the header lines
+		boost::asio::post(pool, [this, &vParts, &vChunks, &vErrors, i, nHeaderLines, pBeg]() {
+			try {
+				readRows(vParts[i], vChunks[i].first, vChunks[i].second, (i == 0) ? nHeaderLines : 0, vChunks[i].first - pBeg);
+			}
+			catch (...) {
+				vErrors[i] = std::current_exception();
+			}
+		});
+	}
+	pool.join();
+
+	// Report the first failure in file order
+	for (auto& ep : vErrors) {
+		if (ep)
+			std::rethrow_exception(ep);
+	}
+
+	// Reduce in file order so the result matches a sequential read
+	for (auto& ob : vParts)
+		m_pOrderBook->merge(std::move(ob));
+}
+
+void OBStream::readCompressed(int nHeaderLines) {
+
+	// Rows of a block are applied while the next blocks are inflated
+	OBCompressedFile cf(getSourceFeed());
+
+	const char* pData;
+	size_t nBytes;
+	while (cf.next(pData, nBytes))
+		nHeaderLines = readRows(*m_pOrderBook, pData, pData + nBytes, nHeaderLines, cf.getOffset());
+}
+
+void OBStream::readPipeline(int nHeaderLines) {
+
+	// Stub to allocate function name at compile time
+	static const string SZ_OBSTREAM_READPIPELINE = "readPipeline";
+
+	ifstream file(getSourceFeed(), ios::in | ios::binary);
+	if (!file)
+		throw TracedException(SZ_OBSTREAM_EXCEPTION, "Cannot open source feed " + getSourceFeed(), SZ_OBSTREAM_READPIPELINE);
+
+	// Blocks go round from the reader to the tokenizer, to the aggregator and back to the reader. The
+	// reader waits for the aggregator to free a block, which bounds the feed held in memory.
+	typedef OBSpscRing<uint32_t, PIPE_BLOCKS> BlockRing;
+	BlockRing brRead, brTokenized, brFree;
+
+	vector<FeedBlock> vBlocks(PIPE_BLOCKS);
+	for (uint32_t iBlock = 0; iBlock < PIPE_BLOCKS; ++iBlock)
+		brFree.push(iBlock);
+
+	auto abortAll = [&brRead, &brTokenized, &brFree]() {
+		brRead.abort();
+		brTokenized.abort();
+		brFree.abort();
+	};
+
+	OrderBook& ob = *m_pOrderBook;
+	RunStats rsRead, rsTokenize;
+	uint64_t nLines = 0;
+
+	enum PIPE_STAGE { PIPE_READ = 0, PIPE_TOKENIZE, PIPE_AGGREGATE, PIPE_STAGES };
+	std::exception_ptr vErrors[PIPE_STAGES];
+
+	// Each stage runs on its own thread, on its own core when one is configured
+	auto runStage = [this, &vErrors, &abortAll](PIPE_STAGE ps, std::function<void()> fnStage) {
+		return boost::thread([this, &vErrors, &abortAll, ps, fnStage]() {
+			if (static_cast<size_t>(ps) < m_vPipelineCores.size() && m_vPipelineCores[ps] >= 0)
+				OBCoreAffinity::pinThread(m_vPipelineCores[ps]);
+
+			try {
+				fnStage();
+			}
+			catch (...) {
+				vErrors[ps] = std::current_exception();
+				abortAll();
+			}
+		});
+	};
+
+	// Fill blocks with whole rows, carrying a row cut at the end of a read over to the next block
+	boost::thread thRead = runStage(PIPE_READ, [&file, &vBlocks, &brRead, &brFree, &rsRead]() {
+
+		vector<char> vCarry;
+		uint64_t nOffset = 0;
+		bool bEof = false;
+
+		uint32_t iBlock;
+		while (!bEof && brFree.pop(iBlock)) {
+			rsRead.lap();
+
+			FeedBlock& fb = vBlocks[iBlock];
+			fb.vBytes.assign(vCarry.begin(), vCarry.end());
+			fb.nOffset = nOffset;
+
+			// Read until the block holds a newline, so a row longer than a block grows the block
+			size_t nData = fb.vBytes.size();
+			size_t nCut = 0;
+			while (nCut == 0) {
+				fb.vBytes.resize(nData + PIPE_BLOCK_BYTES);
+				size_t nRead = static_cast<size_t>(file.rdbuf()->sgetn(fb.vBytes.data() + nData, PIPE_BLOCK_BYTES));
+
+				for (size_t i = nData + nRead; i > nData; --i) {
+					if (fb.vBytes[i - 1] == '\n') {
+						nCut = i;
+						break;
+					}
+				}
+
+				nData += nRead;
+				if (nRead == 0) {
+					// A last row without newline ends the feed
+					bEof = true;
+					nCut = nData;
+					break;
+				}
+			}
+
+			fb.nBytes = nCut;
+			vCarry.assign(fb.vBytes.begin() + nCut, fb.vBytes.begin() + nData);
+			nOffset += nCut;
+			rsRead.mark(RunStats::STATS_READ);
+
+			if (!brRead.push(iBlock))
+				return;
+		}
+		brRead.close();
+	});
+
+	// Slice the rows of each block and locate their book fields, keeping the rows the aggregator needs
+	boost::thread thTokenize = runStage(PIPE_TOKENIZE, [this, &vBlocks, &brRead, &brTokenized, &rsTokenize, &nLines, nHeaderLines]() mutable {
+
+		uint32_t iBlock;
+		while (brRead.pop(iBlock)) {
+
+			FeedBlock& fb = vBlocks[iBlock];
+			fb.vRows.clear();
+
+			const char* pBeg = fb.vBytes.data();
+			const char* pEnd = pBeg + fb.nBytes;
+			for (const char* p = pBeg; p != pEnd; ) {
+				rsTokenize.beginRow(nLines);
+
+				const char* pEol = static_cast<const char*>(memchr(p, '\n', pEnd - p));
+				const char* pNext = (pEol != nullptr) ? pEol + 1 : pEnd;
+				if (pEol == nullptr)
+					pEol = pEnd;
+
+				// Drop the carriage return of CRLF rows as a text mode stream would
+				if (pEol != p && pEol[-1] == '\r')
+					--pEol;
+
+				rsTokenize.addLine(pNext - p);
+				rsTokenize.mark(RunStats::STATS_READ);
+
+				nLines++;
+				if (nHeaderLines > 0)
+					--nHeaderLines;
+				else {
+					FeedRow fr;
+					fr.frs = tokenizeBook(string_view(p, pEol - p), fr.svBidLevels, fr.svAskLevels);
+					if (fr.frs == FEED_ROW_BOOK && !tokenizeRowTime(string_view(p, pEol - p), fr.nTimeMs))
+						fr.nTimeMs = BookAnalytics::NO_TIME;
+					rsTokenize.mark(RunStats::STATS_TOKENIZE);
+
+					if (fr.frs == FEED_ROW_SKIP)
+						rsTokenize.addSkipped();
+					else {
+						fr.nOffset = fb.nOffset + (p - pBeg);
+						fr.nLine = nLines;
+						fb.vRows.push_back(fr);
+					}
+				}
+
+				p = pNext;
+			}
+
+			if (!brTokenized.push(iBlock))
+				return;
+		}
+		brTokenized.close();
+	});
+
+	// Apply the rows to the order book in file order, then hand their block back to the reader
+	boost::thread thAggregate = runStage(PIPE_AGGREGATE, [this, &ob, &vBlocks, &brTokenized, &brFree]() {
+
+		uint32_t iBlock;
+		while (brTokenized.pop(iBlock)) {
+
+			for (const FeedRow& fr : vBlocks[iBlock].vRows) {
+				ob.runStats.beginRow(fr.nLine - 1);
+
+				FEED_ROW_STATUS frs = fr.frs;
+				if (frs == FEED_ROW_BOOK)
+					frs = processLevel(ob, fr.svBidLevels, fr.svAskLevels, fr.nTimeMs);
+
+				// Skipped rows are logged with their own line
+				ob.feedErrors.nLines = fr.nLine;
+				countRow(ob, frs, fr.nOffset);
+			}
+
+			if (!brFree.push(iBlock))
+				return;
+		}
+	});
+
+	thRead.join();
+	thTokenize.join();
+	thAggregate.join();
+
+	// Only a failed stage holds an error, the others stopped once it aborted the rings
+	for (auto& ep : vErrors) {
+		if (ep)
+			std::rethrow_exception(ep);
+	}
+
+	ob.feedErrors.nLines = nLines;
+	ob.runStats.merge(rsRead);
+	ob.runStats.merge(rsTokenize);
+}
+
+void OBStream::readShards(int nHeaderLines) {
+
+	OBMappedFile mf(getSourceFeed());
+	const char* pBeg = mf.data();
+	const char* pEnd = pBeg + mf.size();
+
+	OrderBook& obFeed = *m_pOrderBook;
+	m_vShards.clear();
+
+	// A row waiting for the worker owning its shard, as a slice of the mapped feed
+	struct ShardRow {
+		string_view		svLine;
+		uint64_t		nOffset;
+		uint64_t		nLine;
+		OrderBook*		pBook;
+	};
+
+	// Batches go to the worker full and come back applied, so a slow worker holds the reader back
+	typedef OBSpscRing<uint32_t, SHARD_BATCHES> BatchRing;
+	struct ShardWorker {
+		BatchRing			brRows;
+		BatchRing			brFree;
+		vector<ShardRow>	vBatches[SHARD_BATCHES];
+		uint32_t			iFilling;
+		std::exception_ptr	ep;
+	};
+
+	vector<std::unique_ptr<ShardWorker>> vWorkers;
+	for (int i = 0; i < m_nShardWorkers; ++i) {
+		vWorkers.emplace_back(new ShardWorker());
+		ShardWorker& sw = *vWorkers.back();
+
+		sw.iFilling = 0;
+		sw.vBatches[0].reserve(SHARD_BATCH_ROWS);
+		for (uint32_t iBatch = 1; iBatch < SHARD_BATCHES; ++iBatch)
+			sw.brFree.push(iBatch);
+	}
+
+	auto abortAll = [&vWorkers]() {
+		for (auto& pw : vWorkers) {
+			pw->brRows.abort();
+			pw->brFree.abort();
+		}
+	};
+
+	// Each worker applies the rows of its shards in file order, then sorts their levels
+	boost::thread_group ths;
+	for (int i = 0; i < m_nShardWorkers; ++i) {
+		ths.create_thread([this, &vWorkers, &abortAll, i]() {
+			ShardWorker& sw = *vWorkers[i];
+			try {
+				uint32_t iBatch;
+				while (sw.brRows.pop(iBatch)) {
+					for (const ShardRow& sr : sw.vBatches[iBatch]) {
+
+						// A shard counts its own rows, so its sampled rows do not depend on how the feed interleaves them
+						sr.pBook->runStats.beginRow();
+						sr.pBook->runStats.addLine(sr.svLine.size() + 1);
+
+						// Skipped rows are logged with their line in the whole feed
+						sr.pBook->feedErrors.nLines = sr.nLine;
+						readRow(*sr.pBook, sr.svLine, sr.nOffset);
+					}
+					if (!sw.brFree.push(iBatch))
+						return;
+				}
+
+				// The reader made its last shard before closing the rings
+				for (auto& fs : m_vShards) {
+					if (fs.iWorker != i)
+						continue;
+
+					fs.pBook->runStats.lap();
+					fs.pBook->sortLevels();
+					fs.pBook->runStats.mark(RunStats::STATS_INSERT);
+					fs.pBook->finishStats();
+				}
+			}
+			catch (...) {
+				sw.ep = std::current_exception();
+				abortAll();
+			}
+		});
+	}
+
+	// Shards of the configured instruments, made when their first row is read, and of any other key
+	const int nInstruments = m_pInstruments ? static_cast<int>(m_pInstruments->size()) : 0;
+	vector<int> vInstrumentShards(nInstruments, OBPerfectHash::NO_KEY);
+	unordered_map<string, int> mapOtherShards;
+	string szOtherKey;			// Key looked up in mapOtherShards, reused so the lookups allocate nothing once warm
+
+	string_view svLastKey;
+	int iLastShard = OBPerfectHash::NO_KEY;
+
+	auto findShard = [&](const string_view& svKey) {
+
+		// Rows of one instrument tend to come in runs
+		if (iLastShard != OBPerfectHash::NO_KEY && svKey == svLastKey)
+			return iLastShard;
+
+		int iInstrument = (nInstruments > 0) ? findInstrument(*m_pInstruments, svKey) : OBPerfectHash::NO_KEY;
+
+		int iShard;
+		if (iInstrument != OBPerfectHash::NO_KEY)
+			iShard = vInstrumentShards[iInstrument];
+		else {
+			szOtherKey.assign(svKey.data(), svKey.size());
+			auto it = mapOtherShards.find(szOtherKey);
+			iShard = (it != mapOtherShards.end()) ? it->second : OBPerfectHash::NO_KEY;
+		}
+
+		if (iShard == OBPerfectHash::NO_KEY) {
+			FeedShard fs;
+			fs.szKey = string(svKey);
+			fs.iInstrument = iInstrument;
+			fs.iWorker = static_cast<int>(m_vShards.size() % m_nShardWorkers);
+			fs.pBook = boost::make_shared<OrderBook>();
+			fs.pBook->szSourceFeed = getSourceFeed() + "#" + fs.szKey;
+			initPart(*fs.pBook);
+
+			iShard = static_cast<int>(m_vShards.size());
+			m_vShards.push_back(fs);
+
+			if (iInstrument != OBPerfectHash::NO_KEY)
+				vInstrumentShards[iInstrument] = iShard;
+			else
+				mapOtherShards.emplace(fs.szKey, iShard);
+		}
+
+		svLastKey = svKey;
+		iLastShard = iShard;
+		return iShard;
+	};
+
+	// Hand the batch being filled to its worker and take a free one. False once a worker failed.
+	auto sendBatch = [](ShardWorker& sw) {
+		if (!sw.brRows.push(sw.iFilling) || !sw.brFree.pop(sw.iFilling))
+			return false;
+
+		sw.vBatches[sw.iFilling].clear();
+		sw.vBatches[sw.iFilling].reserve(SHARD_BATCH_ROWS);
+		return true;
+	};
+
+	std::exception_ptr epRead;
+	try {
+		bool bSent = true;
+		for (const char* p = pBeg; p != pEnd && bSent; ) {
+			obFeed.runStats.beginRow();
+
+			const char* pEol = static_cast<const char*>(memchr(p, '\n', pEnd - p));
+			const char* pNext = (pEol != nullptr) ? pEol + 1 : pEnd;
+			if (pEol == nullptr)
+				pEol = pEnd;
+
+			// Drop the carriage return of CRLF rows as a text mode stream would
+			if (pEol != p && pEol[-1] == '\r')
+				--pEol;
+
+			obFeed.runStats.addLine(pNext - p);
+			obFeed.runStats.mark(RunStats::STATS_READ);
+
+			obFeed.feedErrors.nLines++;
+			if (nHeaderLines > 0)
+				--nHeaderLines;
+			else {
+				string_view svLine(p, pEol - p);
+				string_view svKey;
+
+				FEED_ROW_STATUS frs = tokenizeInstrument(svLine, svKey);
+				obFeed.runStats.mark(RunStats::STATS_TOKENIZE);
+
+				// Rows of no instrument are counted against the whole feed
+				if (frs != FEED_ROW_BOOK)
+					countRow(obFeed, frs, p - pBeg);
+				else {
+					const FeedShard& fs = m_vShards[findShard(svKey)];
+					ShardWorker& sw = *vWorkers[fs.iWorker];
+
+					sw.vBatches[sw.iFilling].push_back(ShardRow{ svLine, static_cast<uint64_t>(p - pBeg), obFeed.feedErrors.nLines, fs.pBook.get() });
+					if (sw.vBatches[sw.iFilling].size() == SHARD_BATCH_ROWS)
+						bSent = sendBatch(sw);
+				}
+			}
+
+			p = pNext;
+		}
+
+		// Send the last rows and let the workers drain their rings
+		for (auto& pw : vWorkers) {
+			if (bSent && !pw->vBatches[pw->iFilling].empty())
+				bSent = pw->brRows.push(pw->iFilling);
+			pw->brRows.close();
+		}
+	}
+	catch (...) {
+		epRead = std::current_exception();
+		abortAll();
+	}
+	ths.join_all();
+
+	if (epRead)
+		std::rethrow_exception(epRead);
+	for (auto& pw : vWorkers) {
+		if (pw->ep)
+			std::rethrow_exception(pw->ep);
+	}
+
+	// The feed book counts every shard, and logs their first skipped rows in file order
+	vector<FeedErrors::FeedError> vLog(obFeed.feedErrors.vLog);
+	uint64_t nFeedLines = obFeed.runStats.nLines;
+	uint64_t nFeedBytes = obFeed.runStats.nBytes;
+	for (auto& fs : m_vShards) {
+		OrderBook& ob = *fs.pBook;
+		ob.feedErrors.nLines = obFeed.feedErrors.nLines;
+
+		obFeed.nBookFeeds += ob.nBookFeeds;
+		obFeed.feedErrors.nMalformed += ob.feedErrors.nMalformed;
+		obFeed.feedErrors.nBadNumbers += ob.feedErrors.nBadNumbers;
+		vLog.insert(vLog.end(), ob.feedErrors.vLog.begin(), ob.feedErrors.vLog.end());
+		obFeed.runStats.merge(ob.runStats);
+	}
+
+	std::sort(vLog.begin(), vLog.end(), [](const FeedErrors::FeedError& a, const FeedErrors::FeedError& b) { return a.nLine < b.nLine; });
+	if (vLog.size() > FeedErrors::MAX_FEED_ERRORS)
+		vLog.resize(FeedErrors::MAX_FEED_ERRORS);
+	obFeed.feedErrors.vLog.swap(vLog);
+
+	// Lines were read once, by the feed
+	obFeed.runStats.nLines = nFeedLines;
+	obFeed.runStats.nBytes = nFeedBytes;
+	obFeed.runStats.nPeakRssKb = RunStats::peakRssKb();
+}
+
+void OBStream::followRows(int nHeaderLines) {
+
+	OBFollowedFile ff(getSourceFeed());
+
+	// Bytes read but not applied yet. A partial trailing row waits here until its newline is written.
+	string szPending;
+	uint64_t nPendingOffset = 0;
+
+	const int nFileHeaderLines = nHeaderLines;
+	boost::chrono::steady_clock::time_point tpLastWrite = boost::chrono::steady_clock::now();
+
+	while (!m_bStopFollow) {
+
+		OBFollowedFile::FOLLOW_EVENT fe;
+		size_t nRead = ff.readAppended(szPending, fe);
+
+		// A capture restarted from scratch begins with its header again, and its rows replace whatever
+		// the book held rather than add to it
+		if (fe == OBFollowedFile::FOLLOW_TRUNCATED) {
+			szPending.erase(0, szPending.size() - nRead);
+			nHeaderLines = nFileHeaderLines;
+			nPendingOffset = 0;
+
+			OrderBook obRestart;
+			initPart(obRestart);
+			obRestart.szSourceFeed = getSourceFeed();
+
+			boost::lock_guard<boost::mutex> lg(m_mtxBook);
+			*m_pOrderBook = std::move(obRestart);
+		}
+
+		// A rotated capture is read to its end, its last row ending with the file, and the rows of the
+		// new file follow in the same book. Lines and offsets are counted from the start of the new file.
+		if (fe == OBFollowedFile::FOLLOW_ROTATED) {
+			{
+				boost::lock_guard<boost::mutex> lg(m_mtxBook);
+				readRows(*m_pOrderBook, szPending.data(), szPending.data() + szPending.size(), nHeaderLines, nPendingOffset);
+				m_pOrderBook->feedErrors.nLines = 0;
+			}
+			szPending.clear();
+			nHeaderLines = nFileHeaderLines;
+			nPendingOffset = 0;
+			tpLastWrite = boost::chrono::steady_clock::now();
+			continue;
+		}
+
+		if (nRead == 0) {
+			if (m_nFollowIdleMs > 0 && boost::chrono::steady_clock::now() - tpLastWrite >= boost::chrono::milliseconds(m_nFollowIdleMs))
+				break;
+
+			ff.waitForWrite(FOLLOW_WAIT_MS);
+			continue;
+		}
+		tpLastWrite = boost::chrono::steady_clock::now();
+
+		// Apply the complete rows only
+		size_t nComplete = szPending.rfind('\n');
+		if (nComplete == string::npos)
+			continue;
+
+		{
+			boost::lock_guard<boost::mutex> lg(m_mtxBook);
+			nHeaderLines = readRows(*m_pOrderBook, szPending.data(), szPending.data() + nComplete + 1, nHeaderLines, nPendingOffset);
+		}
+		szPending.erase(0, nComplete + 1);
+		nPendingOffset += nComplete + 1;
+	}
+
+	// Once following ends a row without newline is the last row of the file
+	boost::lock_guard<boost::mutex> lg(m_mtxBook);
+	readRows(*m_pOrderBook, szPending.data(), szPending.data() + szPending.size(), nHeaderLines, nPendingOffset);
+
+	m_pOrderBook->runStats.lap();
+	m_pOrderBook->sortLevels();
+	m_pOrderBook->runStats.mark(RunStats::STATS_INSERT);
+	m_pOrderBook->finishStats();
+}
+
+OBStream::FEED_ROW_STATUS OBStream::readSnapshot(const string_view& svLine, FeedSnapshot& fs) const {
+
+	string_view svBidLevels, svAskLevels;
+
+	FEED_ROW_STATUS frs = tokenizeSnapshot(svLine, fs.nTimeMs, svBidLevels, svAskLevels);
+	if (frs != FEED_ROW_BOOK)
+		return frs;
+
+	// Keep the configured levels only, as the order book does
+	if (readLevels(svBidLevels, fs.bal.vBidQty) != FEED_ROW_BOOK || readLevels(svAskLevels, fs.bal.vAskQty) != FEED_ROW_BOOK)
+		return FEED_ROW_BADNUMBER;
+
+	return FEED_ROW_BOOK;
 }
 
 void OBStream::CheckNotifyException() const {
@@ -157,47 +988,157 @@ void OBStream::CheckNotifyException() const {
 	}
 }
 
-void OBStreamCSV::processFeeds()
-{
-	regex reQuotedFields("\"(.*?)\"");
-	regex rePriceQty("Price:\\s+([0-9]+)\\s+Quantity:\\s+([0-9]+)");
+OBStream::FEED_ROW_STATUS OBStreamCSV::tokenizeRow(const string_view& svLine, string_view& svBidLevels, string_view& svAskLevels) {
 
-	ifstream file(getSourceFeed());
-	string line;
-	
-	// Stub to allocate function name at compile time
-	static const string SZ_OBSTREAMCSV_PROCESSFEEDS = "processFeeds";
+	static const DelimSet dsQuote('"');
+	OBDelimScan ods(svLine.data(), svLine.data() + svLine.size(), dsQuote);
 
-	// Skip header line
-	getline(file, line);
+	// Walk the quoted fields in row order and stop as soon as the ask book field is closed
+	for (int iField = CSVFEED_INSTRUMENT; iField <= CSVFEED_ASK_LEVELS; ++iField) {
 
-	// Safely process all the csv feeds to build the order book
-	try {
-		// Read and parse all feeds
-		while (getline(file, line)) {
+		const char* pOpen = ods.next();
+		if (pOpen == nullptr)
+			return FEED_ROW_MALFORMED;
 
-			// Split each feed line into separate words such as Instrument, date, status, etc.
-			vector<string> fields;
+		const char* pClose = ods.next();
+		if (pClose == nullptr)
+			return FEED_ROW_MALFORMED;
 
-			// Use a Regex expression to identify the beginning and end of each word and push it in a vector
-			for (sregex_iterator i = sregex_iterator(line.begin(), line.end(), reQuotedFields); i != sregex_iterator(); ++i)
-			{
-				smatch m = *i;
-				string s = m.str(1);
+		// Only the book fields are kept, as slices of the row
+		if (iField == CSVFEED_BID_LEVELS)
+			svBidLevels = string_view(pOpen + 1, pClose - pOpen - 1);
+		else if (iField == CSVFEED_ASK_LEVELS)
+			svAskLevels = string_view(pOpen + 1, pClose - pOpen - 1);
+	}
 
-				// Push words from feed row safely
-				fields.push_back(s);
-			}
+	return FEED_ROW_BOOK;
+}
 
-			//int nBidLevels = addLevels(m_pOrderBook->vecBidLevels, fields.at(OBStreamCSV::CSVFEED_BID_LEVELS), rePriceQty);
-			//int nAskLevels = addLevels(m_pOrderBook->vecAskLevels, fields.at(OBStreamCSV::CSVFEED_ASK_LEVELS), rePriceQty);
+bool OBStreamCSV::tokenizeTime(const string_view& svLine, long long& nTimeMs) {
 
-			// Update the line feeds and increment the count of feed for each level
-			processLevel(fields.at(OBStreamCSV::CSVFEED_BID_LEVELS), fields.at(OBStreamCSV::CSVFEED_ASK_LEVELS), rePriceQty);
-		}
+	static const DelimSet dsQuote('"');
+	OBDelimScan ods(svLine.data(), svLine.data() + svLine.size(), dsQuote);
+
+	// Skip the quoted fields ahead of the time stamp
+	for (int iField = CSVFEED_INSTRUMENT; iField <= CSVFEED_DATETIME; ++iField) {
+
+		const char* pOpen = ods.next();
+		if (pOpen == nullptr)
+			return false;
+
+		const char* pClose = ods.next();
+		if (pClose == nullptr)
+			return false;
 
-		// Close the file
-		file.close();
+		if (iField < CSVFEED_DATETIME)
+			continue;
+
+		// Time stamps read "MM/DD/YYYY hh:mm:ss"
+		const char* t = pOpen + 1;
+		if (pClose - t != 19 || t[2] != '/' || t[5] != '/' || t[10] != ' ' || t[13] != ':' || t[16] != ':')
+			return false;
+
+		int nMonth, nDay, nYear, nHour, nMin, nSec;
+		if (!parseFixed(t, 2, nMonth) || !parseFixed(t + 3, 2, nDay) || !parseFixed(t + 6, 4, nYear) ||
+			!parseFixed(t + 11, 2, nHour) || !parseFixed(t + 14, 2, nMin) || !parseFixed(t + 17, 2, nSec))
+			return false;
+
+		return toEpochMs(nYear, nMonth, nDay, nHour, nMin, nSec, 0, nTimeMs);
+	}
+
+	return false;
+}
+
+OBStream::FEED_ROW_STATUS OBStreamCSV::tokenizeSnapshot(const string_view& svLine, long long& nTimeMs, string_view& svBidLevels, string_view& svAskLevels) const {
+
+	FEED_ROW_STATUS frs = tokenizeRow(svLine, svBidLevels, svAskLevels);
+	if (frs == FEED_ROW_BOOK && !tokenizeTime(svLine, nTimeMs))
+		return FEED_ROW_MALFORMED;
+
+	return frs;
+}
+
+OBStream::FEED_ROW_STATUS OBStreamCSV::tokenizeInstrument(const string_view& svLine, string_view& svKey) const {
+
+	const char* p = svLine.data();
+	const char* pEnd = p + svLine.size();
+
+	// The RIC is the first quoted field, found without indexing the rest of the row
+	const char* pOpen = static_cast<const char*>(memchr(p, '"', pEnd - p));
+	const char* pClose = (pOpen != nullptr) ? static_cast<const char*>(memchr(pOpen + 1, '"', pEnd - pOpen - 1)) : nullptr;
+	if (pClose == nullptr)
+		return FEED_ROW_MALFORMED;
+
+	svKey = string_view(pOpen + 1, pClose - pOpen - 1);
+	return FEED_ROW_BOOK;
+}
+
+OBStream::FEED_LEVEL_STATUS OBStreamCSV::nextPriceQty(const char*& pCur, const char* pEnd, OBPrice& prPrice, int& nQty) const {
+
+	static const string_view svPriceTag("Price:");
+	static const string_view svQtyTag("Quantity:");
+
+	// Each level reads "Level: n Price: p Quantity: q", so anchor on the price tag and match the rest in place
+	const string_view svLevel(pCur, pEnd - pCur);
+	for (size_t nPos = svLevel.find(svPriceTag); nPos != string_view::npos; nPos = svLevel.find(svPriceTag, nPos + 1)) {
+
+		const char* p = pCur + nPos + svPriceTag.size();
+
+		const char* pPriceBeg = skipSpaces(p, pEnd);
+		const char* pPriceEnd = skipPrice(pPriceBeg, pEnd);
+		if (pPriceBeg == p || pPriceEnd == pPriceBeg)
+			continue;
+
+		p = skipSpaces(pPriceEnd, pEnd);
+		if (p == pPriceEnd || static_cast<size_t>(pEnd - p) < svQtyTag.size() || string_view(p, svQtyTag.size()) != svQtyTag)
+			continue;
+		p += svQtyTag.size();
+
+		const char* pQtyBeg = skipSpaces(p, pEnd);
+		const char* pQtyEnd = skipDigits(pQtyBeg, pEnd);
+		if (pQtyBeg == p || pQtyEnd == pQtyBeg)
+			continue;
+
+		if (!OBPrice::parse(pPriceBeg, pPriceEnd, prPrice) || !parseDigits(pQtyBeg, pQtyEnd, nQty))
+			return FEED_LEVEL_BADNUMBER;
+
+		pCur = pQtyEnd;
+		return FEED_LEVEL_FOUND;
+	}
+
+	// No more levels in this field
+	pCur = pEnd;
+	return FEED_LEVEL_END;
+}
+
+OBStream::FEED_ROW_STATUS OBStreamCSV::processRow(OrderBook& ob, const string_view& svLine) {
+
+	// Pick up the bid and ask book fields of this feed line
+	string_view svBidLevels, svAskLevels;
+
+	FEED_ROW_STATUS frs = tokenizeRow(svLine, svBidLevels, svAskLevels);
+	ob.runStats.mark(RunStats::STATS_TOKENIZE);
+	if (frs != FEED_ROW_BOOK)
+		return frs;
+
+	// The analytics count a row without a readable time stamp at the time of the one before it
+	long long nTimeMs;
+	if (!tokenizeTime(svLine, nTimeMs))
+		nTimeMs = BookAnalytics::NO_TIME;
+
+	// Update the line feeds and increment the count of feed for each level
+	return processLevel(ob, svBidLevels, svAskLevels, nTimeMs);
+}
+
+void OBStreamCSV::processFeeds()
+{
+	// Stub to allocate function name at compile time
+	static const string SZ_OBSTREAMCSV_PROCESSFEEDS = "processFeeds";
+
+	// Safely process all the csv feeds to build the order book
+	try {
+		// Read and parse all feeds, skipping the header line
+		readFeeds(getHeaderLines());
 	}
 	catch (const TracedException& te) {
 		setExceptionInfo(te);
@@ -213,42 +1154,136 @@ void OBStreamCSV::processFeeds()
 	}
 }
 
-void OBStreamLog::processFeeds()
-{
-	regex reEllipsis("\\{(.*?)\\}");
-	regex rePriceQty("([0-9]*),([0-9]*)");
+OBStream::FEED_ROW_STATUS OBStreamLog::tokenizeRow(const string_view& svLine, string_view& svBidLevels, string_view& svAskLevels) {
 
-	ifstream file(getSourceFeed());
-	string line;
+	const char* p = svLine.data();
+	const char* pEnd = p + svLine.size();
 
-	// Stub to allocate function name at compile time
-	static const string SZ_OBSTREAMLOG_PROCESSFEEDS = "processFeeds";
+	// Books are only carried by market data updates, whose tag precedes the first field brace
+	const char* pBrace = static_cast<const char*>(memchr(p, '{', pEnd - p));
+	if (pBrace == nullptr || string_view(p, pBrace - p).find(SZ_LOGFEED_MDATA_UPDATE) == string_view::npos)
+		return FEED_ROW_SKIP;
 
-	// Safely process all the log feeds to build the order book
-	try {
-		// Read and parse all row feeds
-		while (getline(file, line)) {
+	// Walk the braced fields in row order and stop as soon as the ask book field is closed
+	static const DelimSet dsBraces('{', '}');
+	OBDelimScan ods(pBrace, pEnd, dsBraces);
 
-			vector<string> fields;
+	for (int iField = LOGFEED_INSTRUMENT; iField <= LOGFEED_ASK_BOOK; ++iField) {
 
-			// Use a Regex expression to identify the beginning and end of each value field within ellipsis and push it in a vector
-			for (sregex_iterator i = sregex_iterator(line.begin(), line.end(), reEllipsis); i != sregex_iterator(); ++i)
-			{
-				smatch m = *i;
-				string s = m.str(1);
-				fields.push_back(s);
-			}
+		const char* pOpen = ods.next('{');
+		if (pOpen == nullptr)
+			return FEED_ROW_MALFORMED;
 
-			// Use a Regex expression to build the bid and ask levels on this feed line
-			//addLevels(m_pOrderBook->vecBidLevels, fields.at(OBStreamLog::LOGFEED_BID_BOOK), rePriceQty);
-			//addLevels(m_pOrderBook->vecAskLevels, fields.at(OBStreamLog::LOGFEED_ASK_BOOK), rePriceQty);
+		const char* pClose = ods.next('}');
+		if (pClose == nullptr)
+			return FEED_ROW_MALFORMED;
 
-			// Count this feed
-			processLevel(fields.at(OBStreamLog::LOGFEED_BID_BOOK), fields.at(OBStreamLog::LOGFEED_ASK_BOOK), rePriceQty);
-		}
+		// Only the book fields are kept, as slices of the row
+		if (iField == LOGFEED_BID_BOOK)
+			svBidLevels = string_view(pOpen + 1, pClose - pOpen - 1);
+		else if (iField == LOGFEED_ASK_BOOK)
+			svAskLevels = string_view(pOpen + 1, pClose - pOpen - 1);
+	}
+
+	return FEED_ROW_BOOK;
+}
+
+bool OBStreamLog::tokenizeTime(const string_view& svLine, long long& nTimeMs) {
+
+	// The time stamp follows the log level, as in "DBG yyyymmdd-hh:mm:ss.mmm"
+	size_t nPos = svLine.find(' ');
+	if (nPos == string_view::npos || svLine.size() - nPos - 1 < 21)
+		return false;
+
+	const char* t = svLine.data() + nPos + 1;
+	if (t[8] != '-' || t[11] != ':' || t[14] != ':' || t[17] != '.')
+		return false;
+
+	int nYear, nMonth, nDay, nHour, nMin, nSec, nMs;
+	if (!parseFixed(t, 4, nYear) || !parseFixed(t + 4, 2, nMonth) || !parseFixed(t + 6, 2, nDay) ||
+		!parseFixed(t + 9, 2, nHour) || !parseFixed(t + 12, 2, nMin) || !parseFixed(t + 15, 2, nSec) || !parseFixed(t + 18, 3, nMs))
+		return false;
+
+	return toEpochMs(nYear, nMonth, nDay, nHour, nMin, nSec, nMs, nTimeMs);
+}
+
+OBStream::FEED_ROW_STATUS OBStreamLog::tokenizeSnapshot(const string_view& svLine, long long& nTimeMs, string_view& svBidLevels, string_view& svAskLevels) const {
+
+	FEED_ROW_STATUS frs = tokenizeRow(svLine, svBidLevels, svAskLevels);
+	if (frs == FEED_ROW_BOOK && !tokenizeTime(svLine, nTimeMs))
+		return FEED_ROW_MALFORMED;
+
+	return frs;
+}
+
+OBStream::FEED_ROW_STATUS OBStreamLog::tokenizeInstrument(const string_view& svLine, string_view& svKey) const {
+
+	const char* p = svLine.data();
+	const char* pEnd = p + svLine.size();
+
+	// Only market data updates name their instrument, in the first braced field
+	const char* pOpen = static_cast<const char*>(memchr(p, '{', pEnd - p));
+	if (pOpen == nullptr || string_view(p, pOpen - p).find(SZ_LOGFEED_MDATA_UPDATE) == string_view::npos)
+		return FEED_ROW_SKIP;
+
+	const char* pClose = static_cast<const char*>(memchr(pOpen, '}', pEnd - pOpen));
+	if (pClose == nullptr)
+		return FEED_ROW_MALFORMED;
+
+	svKey = string_view(pOpen + 1, pClose - pOpen - 1);
+	return FEED_ROW_BOOK;
+}
+
+OBStream::FEED_LEVEL_STATUS OBStreamLog::nextPriceQty(const char*& pCur, const char* pEnd, OBPrice& prPrice, int& nQty) const {
+
+	// Each level reads "p,q" so anchor on the comma and take the price and quantity on either side
+	const char* pComma = static_cast<const char*>(memchr(pCur, ',', pEnd - pCur));
+	if (pComma == nullptr) {
+		pCur = pEnd;
+		return FEED_LEVEL_END;
+	}
+
+	const char* pPriceBeg = pComma;
+	while (pPriceBeg != pCur && (isDigit(pPriceBeg[-1]) || pPriceBeg[-1] == '.'))
+		--pPriceBeg;
+
+	const char* pQtyEnd = skipDigits(pComma + 1, pEnd);
+
+	if (!OBPrice::parse(pPriceBeg, pComma, prPrice) || !parseDigits(pComma + 1, pQtyEnd, nQty))
+		return FEED_LEVEL_BADNUMBER;
+
+	pCur = pQtyEnd;
+	return FEED_LEVEL_FOUND;
+}
+
+OBStream::FEED_ROW_STATUS OBStreamLog::processRow(OrderBook& ob, const string_view& svLine) {
+
+	// Pick up the bid and ask book fields of market data updates and skip any other log line
+	string_view svBidLevels, svAskLevels;
+
+	FEED_ROW_STATUS frs = tokenizeRow(svLine, svBidLevels, svAskLevels);
+	ob.runStats.mark(RunStats::STATS_TOKENIZE);
+	if (frs != FEED_ROW_BOOK)
+		return frs;
 
-		// Close the file
-		file.close();
+	// The analytics count a row without a readable time stamp at the time of the one before it
+	long long nTimeMs;
+	if (!tokenizeTime(svLine, nTimeMs))
+		nTimeMs = BookAnalytics::NO_TIME;
+
+	// Count this feed
+	return processLevel(ob, svBidLevels, svAskLevels, nTimeMs);
+}
+
+void OBStreamLog::processFeeds()
+{
+	// Stub to allocate function name at compile time
+	static const string SZ_OBSTREAMLOG_PROCESSFEEDS = "processFeeds";
+
+	// Safely process all the log feeds to build the order book
+	try {
+		// Read and parse all row feeds
+		readFeeds(0);
 	}
 	catch (const TracedException& te) {
 		setExceptionInfo(te);
@@ -1,7 +1,13 @@
 #pragma once
 
+#include <string_view>
+#include <atomic>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+
 #include "TracedException.hpp"
 #include "OrderBook.hpp"
+#include "OrderShard.hpp"
 
 class OBStream
 {
@@ -13,11 +19,26 @@ protected:
 	ErrorExceptionInfo m_eei;
 
 public:
+	// How the source feed file is read. A feed named .gz or .zst is inflated block by block on a thread
+	// of its own in the stream, mapped and pipeline modes alike.
+	enum FEED_INPUT_MODE {
+		FEED_INPUT_STREAM = 0,	// Buffered stream copying each row into a string
+		FEED_INPUT_MAPPED,		// Whole file mapped and rows sliced in place
+		FEED_INPUT_FOLLOW,		// File tailed as it grows, rows applied as they are appended
+		FEED_INPUT_PIPELINE		// Blocks read, rows tokenized and levels aggregated on three threads in step
+	};
+
 	OBStream(const string& szFile, const int& nMaxBookLevels);
 
 	const string& getSourceFeed() const					{ return m_pOrderBook->szSourceFeed; }
 	int getNumFeeds() const								{ return m_pOrderBook->nBookFeeds; }
 
+	// Rows skipped as unreadable while the feed was read. A bad row no longer stops the read.
+	const FeedErrors& getFeedErrors() const				{ return m_pOrderBook->feedErrors; }
+
+	// Counts and stage times of the read, merged from every thread that read a part of the feed
+	const RunStats& getRunStats() const					{ return m_pOrderBook->runStats; }
+
 	operator boost::shared_ptr<OrderBook>()				{ return m_pOrderBook; }
 	boost::shared_ptr<OrderBook> getOrderBook()			{ return m_pOrderBook; }
 
@@ -26,17 +47,161 @@ public:
 
 	virtual void CheckNotifyException() const;
 
+	void setInputMode(FEED_INPUT_MODE fim)				{ m_fim = fim; }
+	FEED_INPUT_MODE getInputMode() const				{ return m_fim; }
+
+	// Map the xml input mode setting to its enum, defaulting to mapped input
+	static FEED_INPUT_MODE toInputMode(const string& szMode);
+
+	// Parse a mapped feed as newline aligned chunks on a pool of threads. One thread keeps the sequential read.
+	void setParseThreads(int nThreads, size_t nChunkBytes)	{ m_nParseThreads = nThreads; m_nChunkBytes = nChunkBytes; }
+	int getParseThreads() const							{ return m_nParseThreads; }
+
+	// Cores of the reader, tokenizer and aggregator threads of a pipelined read, in that order. Stages
+	// past the end of the list, or listed with a negative core, are left to the scheduler.
+	void setPipelineCores(const vector<int>& vCores)	{ m_vPipelineCores = vCores; }
+
+	// Route the rows of a feed interleaving several instruments to an order book per instrument, each
+	// applied by the one of the workers that owns it. An instrument missing from the map gets its book
+	// all the same, named after its key. The order book of the stream then only counts the whole feed.
+	void setSharding(boost::shared_ptr<const OBInstrumentMap> pInstruments, int nWorkers)	{ m_pInstruments = pInstruments; m_nShardWorkers = nWorkers; }
+	bool isSharded() const								{ return m_nShardWorkers > 0; }
+	const vector<FeedShard>& getShards() const			{ return m_vShards; }
+
+	// Followed feeds stop once the file has not grown for the idle time, or when asked to. No idle time follows forever.
+	void setFollowIdle(int nIdleMs)						{ m_nFollowIdleMs = nIdleMs; }
+	void stopFollow()									{ m_bStopFollow = true; }
+
+	// Keep the finished order book in a binary cache next to the source feed and load it back while the feed is unchanged
+	void setCache(bool bCache)							{ m_bCache = bCache; }
+	bool isFromCache() const							{ return m_bFromCache; }
+
+	// Number of tightest spreads kept, as many as are plotted
+	void setBestSpreads(int nBestSpreads)				{ m_pOrderBook->bestSpreads.setCapacity(nBestSpreads); }
+
+	// Price step of the live book ladders and the spread histogram, in units of the last price decimal
+	void setTickSize(int nTick)							{ m_pOrderBook->bookEngine.setTick(nTick); m_pOrderBook->analytics.setTick(nTick); }
+
+	// Followed feeds update the order book while it is plotted, hold this lock to read it
+	boost::mutex& getBookMutex()						{ return m_mtxBook; }
+
+	// Outcome of tokenizing a feed row
+	enum FEED_ROW_STATUS {
+		FEED_ROW_BOOK = 0,		// Row carries the bid and ask books
+		FEED_ROW_SKIP,			// Row carries no book and is ignored
+		FEED_ROW_MALFORMED,		// Row is truncated or misses book fields
+		FEED_ROW_BADNUMBER		// Row has a price or quantity that cannot be read
+	};
+
+	// Outcome of scanning a book field for its next level
+	enum FEED_LEVEL_STATUS {
+		FEED_LEVEL_FOUND = 0,	// A price and quantity were read
+		FEED_LEVEL_END,			// No more levels in the field
+		FEED_LEVEL_BADNUMBER	// The price or quantity of the level cannot be read
+	};
+
+	// A feed row as a time stamped book, read without touching the order book
+	struct FeedSnapshot {
+		long long		nTimeMs;	// Row time stamp in milliseconds since the epoch
+		BidAskLevels	bal;		// Configured levels of each side, best first
+	};
+
+	// Read the time stamp and books of a row into a snapshot whose storage is reused from row to row
+	FEED_ROW_STATUS readSnapshot(const string_view& svLine, FeedSnapshot& fs) const;
+
+	// Locate the instrument key of a feed row, its RIC or its InstrumentId
+	virtual FEED_ROW_STATUS tokenizeInstrument(const string_view& svLine, string_view& svKey) const = 0;
+
+	// Configured instrument of a row key, or OBPerfectHash::NO_KEY
+	virtual int findInstrument(const OBInstrumentMap& im, const string_view& svKey) const = 0;
+
 	virtual void processFeeds()					= 0;
 	virtual const string getObjectName() const	= 0;
+	virtual int getHeaderLines() const			= 0;
 
 protected:
-	int  addLevels(vecLevels&, const string& szLevel, const regex& re, vecPairInt& vps);
-	void processLevel(const string& szBidLevel, const string& szAskLevel, const regex& reg);
+	FEED_ROW_STATUS readLevels(const string_view& svLevel, vecPriceQty& vps) const;
+	size_t addLevels(vecLevels& vLevels, const vecPriceQty& vps);		// Returns the pairs new to the level summaries
+	FEED_ROW_STATUS processLevel(OrderBook& ob, const string_view& svBidLevel, const string_view& svAskLevel, long long nTimeMs);	// NO_TIME when the row has none
+
+	// Read every row of the source feed and hand it to the format specific row handler. Rows that
+	// cannot be read are skipped and logged with their line and their byte offset in the feed.
+	void readFeeds(int nHeaderLines);
+	int  readRows(OrderBook& ob, const char* pBeg, const char* pEnd, int nHeaderLines, uint64_t nOffset);
+	void readChunks(const char* pBeg, const char* pEnd, int nHeaderLines);
+	void followRows(int nHeaderLines);
+	void readPipeline(int nHeaderLines);
+	void readCompressed(int nHeaderLines);		// Rows of a .gz or .zst feed, inflated on a thread of its own
+	void readShards(int nHeaderLines);
+	void initPart(OrderBook& ob) const;		// Settings of a partial or shard book, as of the feed book
+	void readRow(OrderBook& ob, const string_view& svLine, uint64_t nOffset);
+	void countRow(OrderBook& ob, FEED_ROW_STATUS frs, uint64_t nOffset);
+	virtual FEED_ROW_STATUS processRow(OrderBook& ob, const string_view& svLine) = 0;
+
+	// Locate the bid and ask book fields of a feed row, as the row handler does before reading the levels
+	virtual FEED_ROW_STATUS tokenizeBook(const string_view& svLine, string_view& svBidLevels, string_view& svAskLevels) const = 0;
+
+	// Scan the next price and quantity pair of a book level field and advance the scan position past it
+	virtual FEED_LEVEL_STATUS nextPriceQty(const char*& pCur, const char* pEnd, OBPrice& prPrice, int& nQty) const = 0;
+
+	// Read the time stamp of a feed row, as the row handler does for the analytics
+	virtual bool tokenizeRowTime(const string_view& svLine, long long& nTimeMs) const = 0;
+
+	// Locate the time stamp and book fields of a feed row
+	virtual FEED_ROW_STATUS tokenizeSnapshot(const string_view& svLine, long long& nTimeMs, string_view& svBidLevels, string_view& svAskLevels) const = 0;
 
 	//void setDiffLevels();
 
 private:
+	// A row of a pipelined read once tokenized, its book fields sliced out of the block holding it
+	struct FeedRow {
+		string_view		svBidLevels;
+		string_view		svAskLevels;
+		uint64_t		nOffset;		// Byte offset of the row in the source feed
+		uint64_t		nLine;			// Line of the row in the source feed, from 1
+		long long		nTimeMs;		// Time stamp of the row, NO_TIME when it has none
+		FEED_ROW_STATUS	frs;
+	};
+
+	// Whole rows read from the source feed, passed from stage to stage by index and reused once aggregated
+	struct FeedBlock {
+		vector<char>	vBytes;
+		size_t			nBytes;			// Bytes of whole rows at the front of the buffer
+		uint64_t		nOffset;		// Byte offset of the block in the source feed
+		vector<FeedRow>	vRows;			// Rows carrying a book or failing to be read, in file order
+	};
+
+	FEED_INPUT_MODE	m_fim;
+	int				m_nParseThreads;
+	size_t			m_nChunkBytes;
+	vector<int>		m_vPipelineCores;
+
+	boost::shared_ptr<const OBInstrumentMap>	m_pInstruments;
+	int											m_nShardWorkers;
+	vector<FeedShard>							m_vShards;
+
+	int					m_nFollowIdleMs;
+	std::atomic<bool>	m_bStopFollow;
+	boost::mutex		m_mtxBook;
+
+	bool				m_bCache;
+	bool				m_bFromCache;
+
+	static constexpr int FOLLOW_WAIT_MS = 200;
+
+	// Blocks in flight between the pipeline stages, and the bytes each is read by
+	static constexpr size_t PIPE_BLOCKS = 8;
+	static constexpr size_t PIPE_BLOCK_BYTES = 1 << 20;
+
+	// Batches of rows in flight to each shard worker, and the rows each carries
+	static constexpr size_t SHARD_BATCHES = 4;
+	static constexpr size_t SHARD_BATCH_ROWS = 4096;
+
 	static constexpr auto SZ_OBSTREAM_EXCEPTION = "OBStream Exception";
+
+	// The benchmarks time the level handlers on their own, and the checks run the row handlers
+	friend class OBBench;
+	friend class OBCheck;
 };
 
 class OBStreamCSV : public OBStream {
@@ -46,6 +211,9 @@ public:
 
 	void processFeeds();
 	const string getObjectName() const { return "OBStreamCSV"; }
+	int getHeaderLines() const { return CSVFEED_HEADER_LINES; }
+	FEED_ROW_STATUS tokenizeInstrument(const string_view& svLine, string_view& svKey) const;
+	int findInstrument(const OBInstrumentMap& im, const string_view& svKey) const	{ return im.findRic(svKey); }
 
 	enum CSVFEED_ROW_ID {
 		CSVFEED_INSTRUMENT = 0,
@@ -63,7 +231,21 @@ public:
 		CSVFEED_ASK_LEVELS
 	};
 
+	// Locate the bid and ask book fields of a feed row without materializing the other columns
+	static FEED_ROW_STATUS tokenizeRow(const string_view& svLine, string_view& svBidLevels, string_view& svAskLevels);
+
+	// Read the "MM/DD/YYYY hh:mm:ss" TimeUtc field of a feed row
+	static bool tokenizeTime(const string_view& svLine, long long& nTimeMs);
+
+protected:
+	FEED_ROW_STATUS processRow(OrderBook& ob, const string_view& svLine);
+	FEED_LEVEL_STATUS nextPriceQty(const char*& pCur, const char* pEnd, OBPrice& prPrice, int& nQty) const;
+	FEED_ROW_STATUS tokenizeSnapshot(const string_view& svLine, long long& nTimeMs, string_view& svBidLevels, string_view& svAskLevels) const;
+	FEED_ROW_STATUS tokenizeBook(const string_view& svLine, string_view& svBidLevels, string_view& svAskLevels) const	{ return tokenizeRow(svLine, svBidLevels, svAskLevels); }
+	bool tokenizeRowTime(const string_view& svLine, long long& nTimeMs) const	{ return tokenizeTime(svLine, nTimeMs); }
+
 private:
+	static constexpr int CSVFEED_HEADER_LINES = 1;
 	static constexpr auto SZ_OBSTREAMCSV_EXCEPTION = "OBStreamCSV Exception";
 };
 
@@ -74,6 +256,9 @@ public:
 
 	void processFeeds();
 	const string getObjectName() const { return "OBStreamLog"; }
+	int getHeaderLines() const { return 0; }
+	FEED_ROW_STATUS tokenizeInstrument(const string_view& svLine, string_view& svKey) const;
+	int findInstrument(const OBInstrumentMap& im, const string_view& svKey) const	{ return im.findId(svKey); }
 
 	enum LOGFEED_ROW_ID {
 		LOGFEED_INSTRUMENT = 0,
@@ -85,8 +270,22 @@ public:
 		LOGFEED_ASK_BOOK
 	};
 
+	// Locate the bid and ask book fields of a market data update row, skipping any other log line
+	static FEED_ROW_STATUS tokenizeRow(const string_view& svLine, string_view& svBidLevels, string_view& svAskLevels);
+
+	// Read the "DBG yyyymmdd-hh:mm:ss.mmm" prefix of a log line
+	static bool tokenizeTime(const string_view& svLine, long long& nTimeMs);
+
+protected:
+	FEED_ROW_STATUS processRow(OrderBook& ob, const string_view& svLine);
+	FEED_LEVEL_STATUS nextPriceQty(const char*& pCur, const char* pEnd, OBPrice& prPrice, int& nQty) const;
+	FEED_ROW_STATUS tokenizeSnapshot(const string_view& svLine, long long& nTimeMs, string_view& svBidLevels, string_view& svAskLevels) const;
+	FEED_ROW_STATUS tokenizeBook(const string_view& svLine, string_view& svBidLevels, string_view& svAskLevels) const	{ return tokenizeRow(svLine, svBidLevels, svAskLevels); }
+	bool tokenizeRowTime(const string_view& svLine, long long& nTimeMs) const	{ return tokenizeTime(svLine, nTimeMs); }
+
 private:
 	static constexpr auto SZ_OBSTREAMLOG_EXCEPTION = "OBStreamLog Exception";
+	static constexpr auto SZ_LOGFEED_MDATA_UPDATE = "Sending mdata update";
 };
 
 
@@ -0,0 +1,290 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Live order book engine over tick indexed price ladders
+//==============================================================
+#include "pch.h"
+#include <iostream>
+#include <string>
+#include <set>
+#include <map>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+#include "OrderBook.hpp"
+
+bool OBLadder::reach(int nPrice) {
+
+	// Anchor a new ladder on the tick grid with the first price in its middle
+	if (m_vQty.empty()) {
+		m_nBasePrice = nPrice - (MIN_LADDER_SLOTS / 2) * m_nTick;
+		m_vQty.assign(MIN_LADDER_SLOTS, 0);
+		return true;
+	}
+
+	long long nSize = static_cast<long long>(m_vQty.size());
+	long long nSlot = (static_cast<long long>(nPrice) - m_nBasePrice) / m_nTick;
+	if (nSlot >= 0 && nSlot < nSize)
+		return true;
+
+	// Grow at least twice over so a drifting book re-lays its ladder rarely
+	long long nSpan = (nSlot < 0) ? nSize - nSlot : nSlot + 1;
+	long long nNewSize = std::max(nSpan, nSize * 2);
+	if (nSpan > MAX_LADDER_SLOTS)
+		return relay(nSlot);
+	nNewSize = std::min<long long>(nNewSize, MAX_LADDER_SLOTS);
+
+	// Growing below the base shifts the current slots up
+	long long nShift = (nSlot < 0) ? nNewSize - nSize : 0;
+
+	vector<int> vQty(static_cast<size_t>(nNewSize), 0);
+	std::copy(m_vQty.begin(), m_vQty.end(), vQty.begin() + static_cast<size_t>(nShift));
+	m_vQty.swap(vQty);
+
+	m_nBasePrice -= static_cast<int>(nShift) * m_nTick;
+	if (m_nBestSlot >= 0)
+		m_nBestSlot += static_cast<int>(nShift);
+
+	return true;
+}
+
+bool OBLadder::relay(long long nSlot) {
+
+	// The ladder cannot grow that far, lay it again around the levels it holds and the new price
+	long long nLow = nSlot, nHigh = nSlot;
+	for (long long i = 0; i < static_cast<long long>(m_vQty.size()); ++i) {
+		if (m_vQty[static_cast<size_t>(i)] != 0) {
+			nLow = std::min(nLow, i);
+			nHigh = std::max(nHigh, i);
+		}
+	}
+
+	long long nSpan = nHigh - nLow + 1;
+	if (nSpan > MAX_LADDER_SLOTS)
+		return false;
+
+	long long nNewSize = std::min<long long>(std::max<long long>(nSpan * 2, MIN_LADDER_SLOTS), MAX_LADDER_SLOTS);
+	long long nShift = (nNewSize - nSpan) / 2 - nLow;
+
+	vector<int> vQty(static_cast<size_t>(nNewSize), 0);
+	for (long long i = std::max<long long>(nLow, 0); i <= nHigh && i < static_cast<long long>(m_vQty.size()); ++i)
+		vQty[static_cast<size_t>(i + nShift)] = m_vQty[static_cast<size_t>(i)];
+	m_vQty.swap(vQty);
+
+	m_nBasePrice -= static_cast<int>(nShift) * m_nTick;
+	if (m_nBestSlot >= 0)
+		m_nBestSlot += static_cast<int>(nShift);
+
+	return true;
+}
+
+bool OBLadder::set(OBPrice prPrice, int nQty) {
+
+	int nPrice = prPrice.units();
+
+	// Removing a level that is not in the ladder leaves it unchanged
+	if (nQty == 0) {
+		if (qtyAt(prPrice) == 0)
+			return true;
+
+		int nSlot = slotOf(nPrice);
+		m_vQty[nSlot] = 0;
+
+		// The next best price is the closest non empty slot behind the removed best
+		if (--m_nLevels == 0) {
+			m_nBestSlot = -1;
+		}
+		else if (nSlot == m_nBestSlot) {
+			int nStep = m_bBid ? -1 : 1;
+			do { m_nBestSlot += nStep; } while (m_vQty[m_nBestSlot] == 0);
+		}
+		return true;
+	}
+
+	if (!onTick(nPrice) || !reach(nPrice))
+		return false;
+
+	int nSlot = slotOf(nPrice);
+	if (m_vQty[nSlot] == 0) {
+		++m_nLevels;
+		if (m_nBestSlot < 0 || isBetter(nSlot, m_nBestSlot))
+			m_nBestSlot = nSlot;
+	}
+	m_vQty[nSlot] = nQty;
+
+	return true;
+}
+
+int OBLadder::depth(int nLevels, vecPriceQty& vpi) const {
+
+	vpi.clear();
+
+	int nWant = std::min(nLevels, m_nLevels);
+	int nStep = m_bBid ? -1 : 1;
+
+	for (int nSlot = m_nBestSlot; nSlot >= 0 && static_cast<int>(vpi.size()) < nWant; nSlot += nStep) {
+		if (m_vQty[nSlot] != 0)
+			vpi.push_back(make_pair(OBPrice::fromUnits(m_nBasePrice + nSlot * m_nTick), m_vQty[nSlot]));
+	}
+
+	return static_cast<int>(vpi.size());
+}
+
+void OBBookEngine::apply(const BidAskLevels& bal) {
+
+	updateBook(bal);
+	checkRow(bal);
+}
+
+void OBBookEngine::checkRow(const BidAskLevels& bal) {
+
+	m_bc.nSnapshots++;
+
+	// Levels must move away from the inside market, bids downwards and asks upwards
+	bool bBidOrdered = std::adjacent_find(bal.vBidQty.begin(), bal.vBidQty.end(), [](const pairPriceQty& a, const pairPriceQty& b) { return a.first <= b.first; }) == bal.vBidQty.end();
+	bool bAskOrdered = std::adjacent_find(bal.vAskQty.begin(), bal.vAskQty.end(), [](const pairPriceQty& a, const pairPriceQty& b) { return a.first >= b.first; }) == bal.vAskQty.end();
+	if (!bBidOrdered || !bAskOrdered)
+		m_bc.nUnordered++;
+
+	if (m_ladBid.empty() || m_ladAsk.empty()) {
+		m_bc.nOneSided++;
+		return;
+	}
+
+	if (bestBid() > bestAsk())
+		m_bc.nCrossed++;
+	else if (bestBid() == bestAsk())
+		m_bc.nLocked++;
+}
+
+void OBBookEngine::updateBook(const BidAskLevels& bal) {
+
+	int nBidChanges = updateSide(m_ladBid, m_vBookBid, bal.vBidQty);
+	int nAskChanges = updateSide(m_ladAsk, m_vBookAsk, bal.vAskQty);
+
+	// The first row has no previous book to be checked against
+	if (!m_bSeeded) {
+		m_balFirst = bal;
+		m_bSeeded = true;
+		return;
+	}
+
+	if (nBidChanges == 0 && nAskChanges == 0)
+		m_bc.nUnchanged++;
+
+	m_bc.nBidChanges += nBidChanges;
+	m_bc.nAskChanges += nAskChanges;
+}
+
+int OBBookEngine::updateSide(OBLadder& lad, vecPriceQty& vBook, const vecPriceQty& vRow) {
+
+	int nChanges = 0;
+	OBPrice prAnchor = lad.anchorOf(vRow);
+
+	// Clear the levels this row no longer shows or shows too far from its other prices, so the levels
+	// left all fit the ladder around the row
+	for (const auto& pi : vBook) {
+		if (!lad.holds(pi.first, prAnchor) || std::none_of(vRow.begin(), vRow.end(), [&pi](const pairPriceQty& p) { return p.first == pi.first; })) {
+			lad.set(pi.first, 0);
+			++nChanges;
+		}
+	}
+
+	// Then add or resize the levels it shows
+	vBook.clear();
+	for (const auto& pi : vRow) {
+
+		if (!lad.holds(pi.first, prAnchor)) {
+			m_bc.nOffLadder++;
+			continue;
+		}
+
+		if (lad.qtyAt(pi.first) != pi.second) {
+			if (!lad.set(pi.first, pi.second)) {
+				m_bc.nOffLadder++;
+				continue;
+			}
+			++nChanges;
+		}
+		vBook.push_back(pi);
+	}
+
+	return nChanges;
+}
+
+int OBBookEngine::sideChanges(const OBLadder& lad, const vecPriceQty& vBook, const vecPriceQty& vRow) {
+
+	int nChanges = 0;
+	OBPrice prAnchor = lad.anchorOf(vRow);
+
+	// The changes updateSide would count, read from the levels of the side instead of its ladder
+	auto shows = [&vRow](const pairPriceQty& pi) { return std::any_of(vRow.begin(), vRow.end(), [&pi](const pairPriceQty& p) { return p.first == pi.first; }); };
+	for (const auto& pi : vBook) {
+		if (!lad.holds(pi.first, prAnchor) || !shows(pi))
+			++nChanges;
+	}
+
+	for (auto it = vRow.begin(); it != vRow.end(); ++it) {
+		if (!lad.holds(it->first, prAnchor))
+			continue;
+
+		// A price shown twice in the row was set by its first showing
+		auto isPrice = [it](const pairPriceQty& p) { return p.first == it->first; };
+		auto itRow = std::find_if(std::make_reverse_iterator(it), vRow.rend(), isPrice);
+		auto itBook = std::find_if(vBook.begin(), vBook.end(), isPrice);
+
+		int nQty = (itRow != vRow.rend()) ? itRow->second : (itBook != vBook.end()) ? itBook->second : 0;
+		if (nQty != it->second)
+			++nChanges;
+	}
+
+	return nChanges;
+}
+
+void OBBookEngine::merge(OBBookEngine&& later) {
+
+	if (!later.m_bSeeded)
+		return;
+
+	if (!m_bSeeded) {
+		*this = std::move(later);
+		return;
+	}
+
+	// The later engine could not count the changes its first row made to the book before it. Its levels
+	// and prices off the ladder were counted when it applied the row, so only the changes are.
+	int nBidChanges = sideChanges(m_ladBid, m_vBookBid, later.m_balFirst.vBidQty);
+	int nAskChanges = sideChanges(m_ladAsk, m_vBookAsk, later.m_balFirst.vAskQty);
+	if (nBidChanges == 0 && nAskChanges == 0)
+		m_bc.nUnchanged++;
+	m_bc.nBidChanges += nBidChanges;
+	m_bc.nAskChanges += nAskChanges;
+
+	m_bc.merge(later.m_bc);
+
+	// The current book is the one of the last row
+	m_ladBid = std::move(later.m_ladBid);
+	m_ladAsk = std::move(later.m_ladAsk);
+	m_vBookBid = std::move(later.m_vBookBid);
+	m_vBookAsk = std::move(later.m_vBookAsk);
+}
+
+void OBBookEngine::restore(const BookChecks& bc, const vecPriceQty& vBookBid, const vecPriceQty& vBookAsk) {
+
+	m_ladBid.clear();
+	m_ladAsk.clear();
+	m_vBookBid.clear();
+	m_vBookAsk.clear();
+
+	// The saved levels were laddered once already, so they set again
+	BidAskLevels bal;
+	bal.vBidQty = vBookBid;
+	bal.vAskQty = vBookAsk;
+
+	m_bSeeded = false;
+	updateBook(bal);
+
+	m_bc = bc;
+}
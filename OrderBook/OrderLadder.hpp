@@ -0,0 +1,169 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+
+// Built on the level types of OrderBook.hpp, which includes this header once they are declared
+
+// One side of the live book as a tick indexed price ladder. Slot i holds the quantity resting at
+// base price + i * tick, so a price lookup is one index and the best price is tracked as a slot.
+// Prices and the tick are laddered in units of the last price decimal.
+class OBLadder
+{
+public:
+	explicit OBLadder(bool bBid) : m_nBasePrice(0), m_nTick(1), m_nBestSlot(-1), m_nLevels(0), m_bBid(bBid) {}
+
+	void setTick(int nTick)					{ m_nTick = (nTick > 0) ? nTick : 1; clear(); }
+	int  getTick() const					{ return m_nTick; }
+
+	// Remove every price level, keeping the ladder storage
+	void clear() {
+		std::fill(m_vQty.begin(), m_vQty.end(), 0);
+		m_nBestSlot = -1;
+		m_nLevels = 0;
+	}
+
+	bool empty() const						{ return m_nLevels == 0; }
+	int  levels() const						{ return m_nLevels; }
+
+	// Best price and its quantity, valid when the ladder is not empty
+	OBPrice bestPrice() const				{ return OBPrice::fromUnits(m_nBasePrice + m_nBestSlot * m_nTick); }
+	int  bestQty() const					{ return m_vQty[m_nBestSlot]; }
+
+	// Quantity resting at a price, 0 when the level is empty
+	int qtyAt(OBPrice prPrice) const {
+		int nPrice = prPrice.units();
+		if (!onTick(nPrice) || nPrice < m_nBasePrice)
+			return 0;
+
+		int nSlot = slotOf(nPrice);
+		return (nSlot < static_cast<int>(m_vQty.size())) ? m_vQty[nSlot] : 0;
+	}
+
+	// Set the quantity resting at a price, 0 removes the level. Returns false for an off tick price or
+	// one too far from the book to be laddered.
+	bool set(OBPrice prPrice, int nQty);
+
+	// First price of a row side on the tick grid, which the other prices of the row are laddered around
+	OBPrice anchorOf(const vecPriceQty& vRow) const {
+		for (const auto& pi : vRow) {
+			if (onTick(pi.first.units()))
+				return pi.first;
+		}
+		return OBPrice();
+	}
+
+	// Whether a row price is laddered: on the tick grid and close enough to the anchor of its row that
+	// the levels of any one row fit the ladder. It depends on the row alone, not on the rows before it.
+	bool holds(OBPrice prPrice, OBPrice prAnchor) const {
+		long long nDistance = static_cast<long long>(prPrice.units()) - prAnchor.units();
+		return onTick(prPrice.units()) && std::abs(nDistance) < static_cast<long long>(MAX_LADDER_SLOTS / 2) * m_nTick;
+	}
+
+	// Collect up to nLevels price levels from the best price outwards, returning how many were found
+	int depth(int nLevels, vecPriceQty& vpi) const;
+
+private:
+	// Slots sit on multiples of the tick
+	bool onTick(int nPrice) const			{ return nPrice % m_nTick == 0; }
+	int  slotOf(int nPrice) const			{ return (nPrice - m_nBasePrice) / m_nTick; }
+	bool reach(int nPrice);
+	bool relay(long long nSlot);
+	bool isBetter(int nSlot, int nThan) const	{ return m_bBid ? nSlot > nThan : nSlot < nThan; }
+
+private:
+	vector<int>		m_vQty;			// Quantity per tick slot, 0 when empty
+	int				m_nBasePrice;	// Price of slot 0
+	int				m_nTick;		// Price step between slots
+	int				m_nBestSlot;	// Slot of the best price, -1 when empty
+	int				m_nLevels;		// Non empty slots
+	bool			m_bBid;			// Bids are best high, asks best low
+
+	static constexpr int MIN_LADDER_SLOTS = 1024;
+	static constexpr int MAX_LADDER_SLOTS = 1 << 22;
+};
+
+// Outcome of checking every feed row against the book it updates
+struct BookChecks
+{
+	int		nSnapshots;		// Rows applied to the book
+	int		nUnchanged;		// Rows repeating the previous book
+	int		nCrossed;		// Rows with the best bid above the best ask
+	int		nLocked;		// Rows with the best bid at the best ask
+	int		nOneSided;		// Rows with an empty bid or ask side
+	int		nUnordered;		// Rows whose levels do not move away from the inside market
+	int		nOffLadder;		// Prices off the tick grid or too far from the other prices of their row
+	int		nBidChanges;	// Bid levels added, removed or resized from the previous row
+	int		nAskChanges;	// Ask levels added, removed or resized from the previous row
+
+	BookChecks() : nSnapshots(0), nUnchanged(0), nCrossed(0), nLocked(0), nOneSided(0), nUnordered(0), nOffLadder(0), nBidChanges(0), nAskChanges(0) {}
+
+	void merge(const BookChecks& bc) {
+		nSnapshots += bc.nSnapshots;
+		nUnchanged += bc.nUnchanged;
+		nCrossed += bc.nCrossed;
+		nLocked += bc.nLocked;
+		nOneSided += bc.nOneSided;
+		nUnordered += bc.nUnordered;
+		nOffLadder += bc.nOffLadder;
+		nBidChanges += bc.nBidChanges;
+		nAskChanges += bc.nAskChanges;
+	}
+};
+
+// Live limit order book driven by the bid/ask ladders of each feed row. Every row replaces the
+// visible book, is checked against the previous one, and leaves the best prices readable in O(1).
+class OBBookEngine
+{
+public:
+	OBBookEngine() : m_ladBid(true), m_ladAsk(false), m_bSeeded(false) {}
+
+	void setTick(int nTick)					{ m_ladBid.setTick(nTick); m_ladAsk.setTick(nTick); }
+	int  getTick() const					{ return m_ladBid.getTick(); }
+
+	// Check a feed row and make it the current book
+	void apply(const BidAskLevels& bal);
+
+	// Fold in the engine of the rows that follow this one's. The changes the first row of the later
+	// rows makes to this book are counted, so merged checks match a sequential read.
+	void merge(OBBookEngine&& later);
+
+	bool hasBid() const						{ return !m_ladBid.empty(); }
+	bool hasAsk() const						{ return !m_ladAsk.empty(); }
+	OBPrice bestBid() const					{ return m_ladBid.bestPrice(); }
+	OBPrice bestAsk() const					{ return m_ladAsk.bestPrice(); }
+	int  bestBidQty() const					{ return m_ladBid.bestQty(); }
+	int  bestAskQty() const					{ return m_ladAsk.bestQty(); }
+	OBPrice spread() const					{ return bestAsk() - bestBid(); }
+
+	const OBLadder& getBidLadder() const	{ return m_ladBid; }
+	const OBLadder& getAskLadder() const	{ return m_ladAsk; }
+	const BookChecks& getChecks() const		{ return m_bc; }
+
+	// Levels of the last row applied, enough to rebuild the engine with restore()
+	bool isSeeded() const					{ return m_bSeeded; }
+	const vecPriceQty& getBookBid() const	{ return m_vBookBid; }
+	const vecPriceQty& getBookAsk() const	{ return m_vBookAsk; }
+
+	// Rebuild a saved engine from its checks and last levels
+	void restore(const BookChecks& bc, const vecPriceQty& vBookBid, const vecPriceQty& vBookAsk);
+
+private:
+	void checkRow(const BidAskLevels& bal);
+	void updateBook(const BidAskLevels& bal);
+	int  updateSide(OBLadder& lad, vecPriceQty& vBook, const vecPriceQty& vRow);
+	static int sideChanges(const OBLadder& lad, const vecPriceQty& vBook, const vecPriceQty& vRow);
+
+private:
+	OBLadder		m_ladBid;
+	OBLadder		m_ladAsk;
+
+	vecPriceQty		m_vBookBid;		// Levels now in the bid ladder, cleared when a row drops them
+	vecPriceQty		m_vBookAsk;		// Levels now in the ask ladder, cleared when a row drops them
+
+	BidAskLevels	m_balFirst;		// First row applied, checked against the previous rows on merge
+	bool			m_bSeeded;		// A row was applied
+
+	BookChecks		m_bc;
+};
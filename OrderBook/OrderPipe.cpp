@@ -0,0 +1,67 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Pinning the stages of the feed read pipeline to their cores
+//==============================================================
+#include "pch.h"
+#include <string>
+#include <vector>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace std;
+
+#include "OrderPipe.hpp"
+
+bool OBCoreAffinity::pinThread(int nCore) {
+
+	if (nCore < 0)
+		return false;
+
+#ifdef _WIN32
+	if (nCore >= static_cast<int>(sizeof(DWORD_PTR) * 8))
+		return false;
+
+	return ::SetThreadAffinityMask(::GetCurrentThread(), static_cast<DWORD_PTR>(1) << nCore) != 0;
+#elif defined(__linux__)
+	if (nCore >= CPU_SETSIZE)
+		return false;
+
+	cpu_set_t cs;
+	CPU_ZERO(&cs);
+	CPU_SET(nCore, &cs);
+	return ::pthread_setaffinity_np(::pthread_self(), sizeof(cs), &cs) == 0;
+#else
+	// Other systems only take affinity hints, the scheduler places the thread
+	return false;
+#endif
+}
+
+vector<int> OBCoreAffinity::toCores(const string& szCores) {
+
+	vector<int> vCores;
+	vector<string> vszCores;
+	boost::split(vszCores, szCores, boost::is_any_of(", "), boost::token_compress_on);
+
+	// Entries that are not core numbers leave their stage unpinned
+	for (auto& szCore : vszCores) {
+		if (szCore.empty())
+			continue;
+
+		try {
+			vCores.push_back(boost::lexical_cast<int>(szCore));
+		}
+		catch (const boost::bad_lexical_cast&) {
+			vCores.push_back(-1);
+		}
+	}
+
+	return vCores;
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <string>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Bounded queue between exactly one producer thread and one consumer thread. Each side only writes
+// its own index, so a push or a pop is one acquire load and one release store with no lock. A full
+// ring makes the producer wait for the consumer, which is the backpressure of a pipeline stage.
+// A side kept waiting spins briefly, then yields, then sleeps on a condition variable until the
+// other side moves its index, closes or aborts the ring, so an idle stage holds no core. Either side
+// may abort the ring, which releases the other from any wait.
+template <typename T, size_t Capacity>
+class OBSpscRing
+{
+	static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Ring capacity must be a power of 2");
+
+public:
+	OBSpscRing() : m_nHead(0), m_nTail(0), m_bClosed(false), m_bAborted(false), m_nSleepers(0) {}
+
+	OBSpscRing(const OBSpscRing&) = delete;
+	OBSpscRing& operator=(const OBSpscRing&) = delete;
+
+	// Hand an item to the consumer, waiting while the ring is full. False once the ring is aborted.
+	bool push(const T& t) {
+		size_t nTail = m_nTail.load(std::memory_order_relaxed);
+		for (int nSpins = 0; nTail - m_nHead.load(std::memory_order_acquire) == Capacity; ++nSpins) {
+			if (m_bAborted.load(std::memory_order_relaxed))
+				return false;
+			wait(nSpins, [&] { return nTail - m_nHead.load() != Capacity || m_bAborted.load(); });
+		}
+
+		m_items[nTail & (Capacity - 1)] = t;
+		m_nTail.store(nTail + 1, std::memory_order_release);
+		wake();
+		return true;
+	}
+
+	// Take the next item, waiting while the ring is empty. False once the ring is closed and drained, or aborted.
+	bool pop(T& t) {
+		size_t nHead = m_nHead.load(std::memory_order_relaxed);
+		for (int nSpins = 0; m_nTail.load(std::memory_order_acquire) == nHead; ++nSpins) {
+			if (m_bAborted.load(std::memory_order_relaxed))
+				return false;
+
+			// Items pushed before the close are seen once the close is
+			if (m_bClosed.load(std::memory_order_acquire) && m_nTail.load(std::memory_order_acquire) == nHead)
+				return false;
+			wait(nSpins, [&] { return m_nTail.load() != nHead || m_bClosed.load() || m_bAborted.load(); });
+		}
+
+		t = m_items[nHead & (Capacity - 1)];
+		m_nHead.store(nHead + 1, std::memory_order_release);
+		wake();
+		return true;
+	}
+
+	// The producer has no more items
+	void close() {
+		m_bClosed.store(true, std::memory_order_release);
+		wake();
+	}
+
+	// A stage failed, the other side stops waiting
+	void abort() {
+		m_bAborted.store(true, std::memory_order_relaxed);
+		wake();
+	}
+
+private:
+	// Spin briefly on a core of its own, then give the core to the other stages, then sleep until
+	// bReady holds. A sleeper is counted before it checks bReady for the last time, and a side moving
+	// its index checks the count after the move, so one of the two always sees the other.
+	template <typename Ready>
+	void wait(int nSpins, Ready bReady) {
+		if (nSpins < SPIN_WAITS) {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+			_mm_pause();
+#endif
+			return;
+		}
+
+		if (nSpins < SPIN_WAITS + YIELD_WAITS) {
+			std::this_thread::yield();
+			return;
+		}
+
+		boost::unique_lock<boost::mutex> ul(m_mtxSleep);
+		m_nSleepers.fetch_add(1);
+		m_cvSleep.wait(ul, bReady);
+		m_nSleepers.fetch_sub(1);
+	}
+
+	// Wake the other side when it sleeps, which costs a fence when it does not
+	void wake() {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_nSleepers.load(std::memory_order_relaxed) == 0)
+			return;
+
+		boost::lock_guard<boost::mutex> lg(m_mtxSleep);
+		m_cvSleep.notify_all();
+	}
+
+private:
+	static constexpr int SPIN_WAITS = 64;
+	static constexpr int YIELD_WAITS = 1024;
+
+	// The indexes sit on their own cache lines so the two sides do not invalidate each other's
+	alignas(64) std::atomic<size_t>	m_nHead;		// Next item to pop, written by the consumer
+	alignas(64) std::atomic<size_t>	m_nTail;		// Next item to push, written by the producer
+	alignas(64) std::atomic<bool>	m_bClosed;
+	std::atomic<bool>				m_bAborted;
+	T								m_items[Capacity];
+
+	// Where a side waiting longer than its spins and yields sleeps
+	alignas(64) std::atomic<int>	m_nSleepers;
+	boost::mutex					m_mtxSleep;
+	boost::condition_variable		m_cvSleep;
+};
+
+// Affinity of the calling thread, which lets each stage of a pipeline keep a core of its own
+class OBCoreAffinity
+{
+public:
+	OBCoreAffinity() = delete;
+
+	// Run the calling thread on one core only. False when the core does not exist or the platform cannot pin.
+	static bool pinThread(int nCore);
+
+	// Cores listed as "0,1,2" in the xml settings, with an empty list when nothing is to be pinned
+	static std::vector<int> toCores(const std::string& szCores);
+};
@@ -12,15 +12,17 @@
 #include <vector>
 #include <algorithm>
 #include <fstream>
-#include <boost/regex.hpp>
-#include <boost/lexical_cast.hpp>
+#include <memory>
+#include <functional>
+#include <boost/asio/thread_pool.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/thread.hpp>
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/range/adaptors.hpp>
 #include <boost/range/adaptor/reversed.hpp>
 #include <boost/range/irange.hpp>
 #include <boost/range/numeric.hpp>
-#include <boost/multiprecision/cpp_dec_float.hpp>
 #include <boost/format.hpp>
 #include <boost/shared_ptr.hpp>
 
@@ -32,18 +34,41 @@ using namespace boost;
 
 #include "OrderBook.hpp"
 #include "OrderFeeds.hpp"
+#include "OrderReport.hpp"
 #include "OrderPlot.hpp"
 
-using boost::lexical_cast;
-using boost::bad_lexical_cast;
-
 const string szBookPlot("task1.bookplot.");
 
-OrderPlot::OrderPlot(const string& szXml, OBStreamCSV& obsCsv, OBStreamLog& obsLog) {
+// Pairs of a level summary in price then quantity order, sorted into the scratch vector when the summary is not
+static const vecPriceQty& sortedPairs(const LevelSummary& ls, vecPriceQty& vScratch) {
+
+	if (ls.isSorted())
+		return ls.pairs();
+
+	vScratch = ls.pairs();
+	std::sort(vScratch.begin(), vScratch.end());
+	return vScratch;
+}
+
+// Name the file of a report format after the html file, e.g. orderbook.jsonl
+static string makeFormatFile(const string& szFile, const string& szExt) {
+
+	size_t nDot = szFile.find_last_of('.');
+	size_t nSep = szFile.find_last_of("/\\");
+	if (nDot == string::npos || (nSep != string::npos && nDot < nSep))
+		return szFile + szExt;
+
+	return szFile.substr(0, nDot) + szExt;
+}
+
+OrderPlot::OrderPlot(const string& szXml, OBStreamCSV& obsCsv, OBStreamLog& obsLog, const string& szFeed) : OrderPlot(szXml, obsCsv.getOrderBook(), obsLog.getOrderBook(), szFeed) {
+}
+
+OrderPlot::OrderPlot(const string& szXml, boost::shared_ptr<OrderBook> pCsvBook, boost::shared_ptr<OrderBook> pLogBook, const string& szFeed) {
 
 	// Mke sure there is data to work with
-	m_pCsvBook = obsCsv.getOrderBook();
-	m_pLogBook = obsLog.getOrderBook();
+	m_pCsvBook = pCsvBook;
+	m_pLogBook = pLogBook;
 
 	assert(m_pCsvBook);
 	assert(m_pLogBook);
@@ -54,172 +79,275 @@ OrderPlot::OrderPlot(const string& szXml, OBStreamCSV& obsCsv, OBStreamLog& obsL
 	ptree pt;
 	read_xml(szXml, pt, trim_whitespace | no_comments);
 
-	// Gt the name of the html file to generate
-	m_szPlotFile = pt.get<string>(szBookPlot + "file", "orderbook.htm");
+	// Gt the name of the html file to generate. A batch feed gets its own copy of the html file.
+	string szTemplate = pt.get<string>(szBookPlot + "file", "orderbook.htm");
+	m_szPlotFile = szFeed.empty() ? szTemplate : makeFeedFile(szTemplate, szFeed);
 
 	InjectParams ijParams;
 	ijParams.szHtml = m_szPlotFile;
+	ijParams.szTemplate = szTemplate;
 
 	// Plot the csv and log book orders summary results
 	ijParams.szHeader = pt.get<string>(szBookPlot + "summary", "Order Books Summary");
 	ijParams.szMarkerBegin = pt.get<string>(szBookPlot + "markers.begin_summary", "begin summary");
 	ijParams.szMarkerEnd = pt.get<string>(szBookPlot + "markers.end_summary", "end summary");
 	ijParams.nParam = pt.get<int>(szBookPlot + "bestspreads", MAX_BEST_SPREADS);
-	plotBookSummary(ijParams);
+	m_nPlotThreads = pt.get<int>(szBookPlot + "plotThreads", 0);
+
+	// Formats of the report, html unless asked otherwise
+	plotBookSummary(ijParams, pt.get<string>(szBookPlot + "formats", "html"));
+
+	// Run statistics are only written when asked, as json next to the report or printed
+	writeStats(pt.get<string>(szBookPlot + "stats", "none"));
 }
 
-void OrderPlot::plotBookSummary(InjectParams& ijParams) {
+void OrderPlot::plotBookSummary(const InjectParams& ijParams, const string& szFormats) {
 
-	stringstream ss;
+	// Stub to allocate function name at compile time
+	static const string SZ_ORDERPLOT_PLOTBOOKSUMMARY = "plotBookSummary";
 
-	// Build two-column summary to see results side-by-side
+	m_runStats.lap();
 
-	// - Source feeds
-	ss << "\t<div class='container-fluid'>" << endl;
-	ss << "\t<h3 class='linebot'>" << ijParams.szHeader << "</h3>" << endl;
-	ss << "\t\t<div class='row'>" << endl;
+	// Open a file for every format first, so a format that cannot be written fails before any work
+	vector<string> vFormats;
+	boost::split(vFormats, szFormats, boost::is_any_of(", "), boost::token_compress_on);
 
-	plotBookCol(m_pCsvBook, ijParams, ss);
-	plotBookCol(m_pLogBook, ijParams, ss);
+	vector<std::unique_ptr<OBReportEmitter>> vEmitters;
+	for (const auto& szFormat : vFormats) {
+		if (szFormat == "html")
+			vEmitters.emplace_back(new OBHtmlEmitter(ijParams, *m_pCsvBook, *m_pLogBook, m_nPlotThreads));
+		else if (szFormat == "jsonl")
+			vEmitters.emplace_back(new OBJsonEmitter(makeFormatFile(m_szPlotFile, ".jsonl")));
+		else if (szFormat == "bin")
+			vEmitters.emplace_back(new OBBinaryEmitter(makeFormatFile(m_szPlotFile, ".obr")));
+		else if (!szFormat.empty())
+			throw TracedException(SZ_ORDERPLOT_EXCEPTION, "Unknown report format " + szFormat, SZ_ORDERPLOT_PLOTBOOKSUMMARY);
+	}
 
-	ss << "\t\t</div>" << endl;
-	ss << "\t</div>" << endl;
+	if (vEmitters.empty())
+		throw TracedException(SZ_ORDERPLOT_EXCEPTION, "No report format in " + szFormats, SZ_ORDERPLOT_PLOTBOOKSUMMARY);
 
-	// Price-Quantity offers' differences
-	ss << "\t<h3 class='gapsep'>Price-Quantity offers:</h3>" << endl;
-	ss << "\t\t\t\t<h5 class='gapsep'>Bid price offers:</h5>" << endl;
+	// Compare each level of both feeds concurrently, the books are only read
+	vector<LevelDiff> vBidDiffs(max(m_pCsvBook->vecBidLevels.size(), m_pLogBook->vecBidLevels.size()));
+	vector<LevelDiff> vAskDiffs(max(m_pCsvBook->vecAskLevels.size(), m_pLogBook->vecAskLevels.size()));
 
-	// Plot bid results first
-	ijParams.szParam = "Bid";
-	plotBookLevelsDiff(m_pCsvBook->vecBidLevels ,m_pLogBook->vecBidLevels, ijParams, ss);
+	vector<std::function<void()>> vTasks;
+	for (size_t i = 0; i < vBidDiffs.size(); ++i) {
+		vBidDiffs[i].rs = REPORT_BID;
+		vTasks.push_back([this, &vBidDiffs, i]() { diffLevel(m_pCsvBook->vecBidLevels, m_pLogBook->vecBidLevels, i, vBidDiffs[i]); });
+	}
+	for (size_t i = 0; i < vAskDiffs.size(); ++i) {
+		vAskDiffs[i].rs = REPORT_ASK;
+		vTasks.push_back([this, &vAskDiffs, i]() { diffLevel(m_pCsvBook->vecAskLevels, m_pLogBook->vecAskLevels, i, vAskDiffs[i]); });
+	}
 
-	// Then ask results below
-	ss << "\t\t\t\t<h5 class='gapsep'>Ask price offers:</h5>" << endl;
-	ijParams.szParam = "Ask";
-	plotBookLevelsDiff(m_pCsvBook->vecAskLevels, m_pLogBook->vecAskLevels, ijParams, ss);
+	runTasks(vTasks, m_nPlotThreads);
+	m_runStats.mark(RunStats::STATS_RENDER);
 
-	// Update the html file
-	injectHtml(ijParams, ss);
-}
+	// Then write every format on its own thread, each streaming its records in report order; the html
+	// format renders its sections on threads of its own once all are laid out
+	vTasks.clear();
+	for (auto& pEmitter : vEmitters) {
+		OBReportEmitter* pre = pEmitter.get();
+		vTasks.push_back([this, pre, &ijParams, &vBidDiffs, &vAskDiffs]() {
 
-void OrderPlot::plotBookLevelsDiff(vecLevels& vCsvLevels, vecLevels& vLogLevels, InjectParams& ijParams, stringstream& ss) {
+			pre->beginReport(ijParams.szHeader);
+			pre->emitBook(REPORT_CSV, *m_pCsvBook, ijParams.nParam);
+			pre->emitBook(REPORT_LOG, *m_pLogBook, ijParams.nParam);
 
-	// Scan through the union of csv and log levels
-	int nMaxLevels = max(vCsvLevels.size(), vLogLevels.size());
+			pre->beginLevels(REPORT_BID, vBidDiffs.size());
+			for (const auto& ld : vBidDiffs)
+				pre->emitLevelDiff(ld);
 
-	for (size_t i : boost::irange(0, nMaxLevels)) {
+			pre->beginLevels(REPORT_ASK, vAskDiffs.size());
+			for (const auto& ld : vAskDiffs)
+				pre->emitLevelDiff(ld);
 
-		// Container of price quantity difference
-		vecPairInt vpiCsv, vpiLog;
+			pre->endReport();
+		});
+	}
 
-		// Use try-catch block to catch unequal levels between source feeds
-		try {
-			mapPriceQty& m1 = vCsvLevels.at(i);
-			mapPriceQty& m2 = vLogLevels.at(i);
+	runTasks(vTasks, m_nPlotThreads);
+	m_runStats.mark(RunStats::STATS_WRITE);
 
-			setInt keys1, keys2, interKeys, diffKeys1, diffKeys2;
+	// The html file stays the plot file when asked for, else the first format written is
+	m_vReportFiles.clear();
+	for (const auto& pEmitter : vEmitters)
+		m_vReportFiles.push_back(pEmitter->getFile());
 
-			// Extract the keys from each map with a transform
-			std::transform(m1.begin(), m1.end(), std::inserter(keys1, keys1.begin()), [](mapPriceQty::value_type &m) { return m.first; });
-			std::transform(m2.begin(), m2.end(), std::inserter(keys2, keys2.begin()), [](mapPriceQty::value_type &m) { return m.first; });
+	if (find(vFormats.begin(), vFormats.end(), "html") == vFormats.end())
+		m_szPlotFile = m_vReportFiles.front();
 
-			// Filter out keys in keys1 not in keys2
-			std::set_difference(keys1.begin(), keys1.end(), keys2.begin(), keys2.end(), std::inserter(diffKeys1, diffKeys1.begin()));
+	if (RunStats::ENABLED) {
+		m_runStats.nBytes = 0;
+		for (const auto& pEmitter : vEmitters)
+			m_runStats.nBytes += pEmitter->getBytes();
+		m_runStats.nPeakRssKb = RunStats::peakRssKb();
+	}
+}
 
-			// Filter out keys in keys2 not in keys1
-			std::set_difference(keys2.begin(), keys2.end(), keys1.begin(), keys1.end(), std::inserter(diffKeys2, diffKeys2.begin()));
+void OrderPlot::runTasks(const vector<std::function<void()>>& vTasks, int nThreads) {
 
-			// Make pairs of different prices
-			for (auto& k1 : diffKeys1) {
+	if (nThreads <= 0)
+		nThreads = static_cast<int>(std::max(1u, boost::thread::hardware_concurrency()));
 
-				vecPairInt vpi;
+	if (nThreads == 1 || vTasks.size() <= 1) {
+		for (auto& fnTask : vTasks)
+			fnTask();
+		return;
+	}
 
-				// Invert the price in the pair so we know it is a price difference rather than a quantity. It will be deinverted later.
-				std::transform(m1[k1].begin(), m1[k1].end(), std::back_inserter(vpi), [&k1](const int& q) { return std::make_pair(-1 * k1, q); });
+	vector<std::exception_ptr> vErrors(vTasks.size());
+	boost::asio::thread_pool pool(std::min(static_cast<size_t>(nThreads), vTasks.size()));
 
-				// Append price,quantity pairs difference found in csv feeds
-				vpiCsv.insert(std::end(vpiCsv), std::begin(vpi), std::end(vpi));
+	for (size_t i = 0; i < vTasks.size(); ++i) {
+		boost::asio::post(pool, [&vTasks, &vErrors, i]() {
+			try {
+				vTasks[i]();
+			}
+			catch (...) {
+				vErrors[i] = std::current_exception();
 			}
+		});
+	}
+	pool.join();
 
-			// Make pairs of different prices
-			for (auto& k2 : diffKeys2) {
+	// Report the first failure in task order
+	for (auto& ep : vErrors) {
+		if (ep)
+			std::rethrow_exception(ep);
+	}
+}
 
-				vecPairInt vpi;
+void OrderPlot::writeStats(const string& szMode) const {
 
-				// Invert the price in the pair so we know it is a price difference rather than a quantity. It will be deinverted later.
-				std::transform(m2[k2].begin(), m2[k2].end(), std::back_inserter(vpi), [&k2](const int& q) { return std::make_pair(-1 * k2, q); });
+	if (!RunStats::ENABLED || szMode == "none")
+		return;
 
-				// Append price,quantity pairs difference found in log feeds 
-				vpiLog.insert(std::end(vpiLog), std::begin(vpi), std::end(vpi));
-			}
+	if (szMode == "print") {
+		double dTscPerMs = RunStats::tscPerSecond() / 1000;
 
-			// Pick up the intersecting bid prices
-			std::set_intersection(keys1.begin(), keys1.end(), keys2.begin(), keys2.end(), std::inserter(interKeys, interKeys.begin()));
+		const pair<const string*, const RunStats*> vStats[] = {
+			{ &m_pCsvBook->szSourceFeed, &m_pCsvBook->runStats }, { &m_pLogBook->szSourceFeed, &m_pLogBook->runStats }, { &m_szPlotFile, &m_runStats } };
 
-			// And filter out prices with different quantity
-			vecPairInt vpi1, vpi2;
-			for (auto& k : interKeys) {
- 
-				setInt q1Diff, q2Diff;
+		for (const auto& st : vStats) {
+			const RunStats& rs = *st.second;
+			cout << " " << *st.first << ": " << rs.nBytes << " bytes, " << rs.nLines << " lines, " << rs.nRowsAccepted << " rows accepted, "
+				<< rs.nRowsSkipped << " skipped, " << rs.nRowsRejected << " rejected, peak " << rs.nPeakRssKb / 1024 << " MB;";
 
-				// Filter out the difference between the two set of quantities
-				std::set_difference(m1[k].begin(), m1[k].end(), m2[k].begin(), m2[k].end(), std::inserter(q1Diff, q1Diff.begin()));
-				std::set_difference(m2[k].begin(), m2[k].end(), m1[k].begin(), m1[k].end(), std::inserter(q2Diff, q2Diff.begin()));
+			for (int i = 0; i < RunStats::STATS_STAGES; ++i) {
+				if (rs.nCycles[i] > 0)
+					cout << " " << RunStats::getStageName(static_cast<RunStats::STATS_STAGE>(i)) << " " << boost::format("%.1f") % (rs.nCycles[i] / dTscPerMs) << " ms";
+			}
+			cout << endl;
+		}
+		return;
+	}
 
-				vecPairInt vpi1, vpi2;
-				std::transform(q1Diff.begin(), q1Diff.end(), std::back_inserter(vpi1), [&k](const int& q) { return std::make_pair(k, q); });
-				std::transform(q2Diff.begin(), q2Diff.end(), std::back_inserter(vpi2), [&k](const int& q) { return std::make_pair(k, q); });
+	// The statistics file is named after the report
+	string szStatsFile = m_szPlotFile + ".stats.json";
+	ofstream file(szStatsFile, ios::trunc);
+
+	file << "{" << endl;
+	file << "\t\"tsc_per_sec\": " << boost::format("%.0f") % RunStats::tscPerSecond() << "," << endl;
+	file << "\t\"csv\": ";
+	m_pCsvBook->runStats.writeJson(file, m_pCsvBook->szSourceFeed);
+	file << "," << endl << "\t\"log\": ";
+	m_pLogBook->runStats.writeJson(file, m_pLogBook->szSourceFeed);
+	file << "," << endl << "\t\"plot\": ";
+	m_runStats.writeJson(file, m_szPlotFile);
+	file << endl << "}" << endl;
+}
 
-				// Append price,quantity pairs difference between csv and log feeds 
-				vpiCsv.insert(std::end(vpiCsv), std::begin(vpi1), std::end(vpi1));
-				vpiLog.insert(std::end(vpiLog), std::begin(vpi2), std::end(vpi2));
-			}
+void OrderPlot::plotBookLevelsDiff(const vecLevels& vCsvLevels, const vecLevels& vLogLevels, const InjectParams& ijParams, ostream& ss) {
 
-			// Plot the csv and log differences
-			ss << "\t<div class='container-fluid'>" << endl;
-			ss << "\t\t<h5 class='linebot'>Level " << i+1 << "</h5>" << endl;
-			ss << "\t\t<div class='row'>" << endl;
-			plotLevelCol(vpiCsv, ijParams, ss);
-			plotLevelCol(vpiLog, ijParams, ss);
-			ss << "\t\t</div>" << endl;
-			ss << "\t</div>" << endl;
-		}
-		catch (...) {
-			// PLot single side levels either csv or log. One of the two won't plot because its level size is out-of-band compared to the other
-			plotLevels(vCsvLevels, ijParams, ss);
-			plotLevels(vLogLevels, ijParams, ss);
-		}
+	// Scan through the union of csv and log levels
+	size_t nMaxLevels = max(vCsvLevels.size(), vLogLevels.size());
+
+	for (size_t i = 0; i < nMaxLevels; ++i) {
+		LevelDiff ld;
+		diffLevel(vCsvLevels, vLogLevels, i, ld);
+		plotLevelDiff(ld, ijParams, ss);
 	}
 }
 
-void OrderPlot::plotLevels(vecLevels& vl, InjectParams& ijParams, stringstream& ss) {
+void OrderPlot::diffLevel(const vecLevels& vCsvLevels, const vecLevels& vLogLevels, size_t iLevel, LevelDiff& ld) {
 
-	//for (size_t i : boost::irange(0, vl.size()) {
-	int iLevel = 0;
-	for (auto& m : vl) {
+	ld.iLevel = iLevel;
+	ld.bCsvLevel = iLevel < vCsvLevels.size();
+	ld.bLogLevel = iLevel < vLogLevels.size();
+	ld.vpiCsv.clear();
+	ld.vpiLog.clear();
 
-		// Extract the key prices for this level
-		setInt keys;
-		std::transform(m.begin(), m.end(), std::inserter(keys, keys.begin()), [](const mapPriceQty::value_type &m) { return m.first; });
+	// A level only one feed reached is compared with an empty one, every price of it then differs
+	vecPriceQty vCsvSorted, vLogSorted;
+	const vecPriceQty& vCsv = ld.bCsvLevel ? sortedPairs(vCsvLevels[iLevel], vCsvSorted) : vCsvSorted;
+	const vecPriceQty& vLog = ld.bLogLevel ? sortedPairs(vLogLevels[iLevel], vLogSorted) : vLogSorted;
 
-		// Running total of price quantity pairs
-		vecPairInt vpiLevel;
+	// Pairs of a price both feeds showed with other quantities, listed after the price differences
+	vecPriceQty vCsvQtys, vLogQtys;
 
-		// Pair up each kay with associated quantities
-		for (auto& k : keys) {
+	// Walk both levels once in price then quantity order
+	auto itCsv = vCsv.begin(), itCsvEnd = vCsv.end();
+	auto itLog = vLog.begin(), itLogEnd = vLog.end();
+	while (itCsv != itCsvEnd || itLog != itLogEnd) {
 
-			vecPairInt vpi;
-			std::transform(m[k].begin(), m[k].end(), std::inserter(vpi, vpi.begin()), [&k](const int& q) { return std::make_pair(k, q); });
-			vpiLevel.insert(std::end(vpiLevel), std::begin(vpi), std::end(vpi));
+		if (itLog == itLogEnd || (itCsv != itCsvEnd && itCsv->first < itLog->first)) {
+
+			// The price is negated so the plot tells a price difference from a quantity one
+			const OBPrice prPrice = itCsv->first;
+			for (; itCsv != itCsvEnd && itCsv->first == prPrice; ++itCsv)
+				ld.vpiCsv.push_back(std::make_pair(-prPrice, itCsv->second));
+		}
+		else if (itCsv == itCsvEnd || itLog->first < itCsv->first) {
+
+			const OBPrice prPrice = itLog->first;
+			for (; itLog != itLogEnd && itLog->first == prPrice; ++itLog)
+				ld.vpiLog.push_back(std::make_pair(-prPrice, itLog->second));
 		}
+		else {
+			// Both feeds showed the price, keep the quantities only one of them did
+			const OBPrice prPrice = itCsv->first;
+			while (itCsv != itCsvEnd && itCsv->first == prPrice && itLog != itLogEnd && itLog->first == prPrice) {
+				if (itCsv->second < itLog->second)
+					vCsvQtys.push_back(*itCsv++);
+				else if (itLog->second < itCsv->second)
+					vLogQtys.push_back(*itLog++);
+				else {
+					++itCsv;
+					++itLog;
+				}
+			}
 
-		// Plot the csv and log differences
-		ss << "\t\t<h5 class='linebot'>Level " << ++iLevel << "</h5>" << endl;
-		plotLevelCol(vpiLevel, ijParams, ss, false);
+			for (; itCsv != itCsvEnd && itCsv->first == prPrice; ++itCsv)
+				vCsvQtys.push_back(*itCsv);
+			for (; itLog != itLogEnd && itLog->first == prPrice; ++itLog)
+				vLogQtys.push_back(*itLog);
+		}
 	}
+
+	ld.vpiCsv.insert(ld.vpiCsv.end(), vCsvQtys.begin(), vCsvQtys.end());
+	ld.vpiLog.insert(ld.vpiLog.end(), vLogQtys.begin(), vLogQtys.end());
+}
+
+void OrderPlot::plotLevelDiff(const LevelDiff& ld, const InjectParams& ijParams, ostream& ss) {
+
+	// Plot the csv and log differences, naming the feed that did not reach the level
+	ss << "\t<div class='container-fluid'>" << endl;
+	ss << "\t\t<h5 class='linebot'>Level " << ld.iLevel+1;
+	if (!ld.bCsvLevel)
+		ss << " <small>not reached by the csv feed</small>";
+	else if (!ld.bLogLevel)
+		ss << " <small>not reached by the log feed</small>";
+	ss << "</h5>" << endl;
+	ss << "\t\t<div class='row'>" << endl;
+	plotLevelCol(ld.vpiCsv, ijParams, ss);
+	plotLevelCol(ld.vpiLog, ijParams, ss);
+	ss << "\t\t</div>" << endl;
+	ss << "\t</div>" << endl;
 }
 
-void OrderPlot::plotLevelCol(const vecPairInt& vpi, InjectParams& ijParams, stringstream& ss, bool bFluid) {
+void OrderPlot::plotLevelCol(const vecPriceQty& vpi, const InjectParams& ijParams, ostream& ss, bool bFluid) {
 
 	// Plot column for a single row or a fluid row with two columns
 	if (bFluid) {
@@ -236,8 +364,8 @@ void OrderPlot::plotLevelCol(const vecPairInt& vpi, InjectParams& ijParams, stri
 	for (auto& pi : vpi) {
 		ss << "\t\t\t<div class='row'>" << endl;
 		ss << "\t\t\t\t<div class='col-3'></div>" << endl;
-		if (pi.first < 0)
-			ss << "\t\t\t\t<div class='col-2'>{<span class='boldfield'>" << -1 * pi.first << "</span>," << pi.second << "}</div>" << endl;
+		if (pi.first < OBPrice())
+			ss << "\t\t\t\t<div class='col-2'>{<span class='boldfield'>" << -pi.first << "</span>," << pi.second << "}</div>" << endl;
 		else
 			ss << "\t\t\t\t<div class='col-2'>{" << pi.first << "," << "<span class='boldfield'>" << pi.second << "</span>}</div>" << endl;
 		ss << "\t\t\t</div>" << endl;
@@ -248,7 +376,7 @@ void OrderPlot::plotLevelCol(const vecPairInt& vpi, InjectParams& ijParams, stri
 	}
 }
 
-void OrderPlot::plotBookCol(boost::shared_ptr<OrderBook>& pBook, InjectParams& ijParams, stringstream& ss) {
+void OrderPlot::plotBookCol(const OrderBook& ob, int nMaxSpreads, ostream& ss) {
 
 	// Plot the html to create a two-column summary for easy comparison
 	ss << "\t\t\t<div class='col-sm-5'>" << endl;
@@ -256,33 +384,107 @@ void OrderPlot::plotBookCol(boost::shared_ptr<OrderBook>& pBook, InjectParams& i
 	// Source feed name
 	ss << "\t\t\t\t<div class='row'>" << endl;
 	ss << "\t\t\t\t\t<div class='col-3'>Source feeds:</div>" << endl;
-	ss << "\t\t\t\t\t<div class='col-2'>" << pBook->szSourceFeed << "</div>" << endl;
+	ss << "\t\t\t\t\t<div class='col-2'>" << ob.szSourceFeed << "</div>" << endl;
 	ss << "\t\t\t\t</div>" << endl;
 
 	// Total feeds read
 	ss << "\t\t\t\t<div class='row'>" << endl;
 	ss << "\t\t\t\t\t<div class='col-3'>Total feeds:</div>" << endl;
-	ss << "\t\t\t\t\t<div class='col-2'>" << pBook->nBookFeeds << "</div>" << endl;
+	ss << "\t\t\t\t\t<div class='col-2'>" << ob.nBookFeeds << "</div>" << endl;
 	ss << "\t\t\t\t</div>" << endl;
 
 	// - Plot total bid levels
 	ss << "\t\t\t\t<div class='row'>" << endl;
 	ss << "\t\t\t\t\t<div class='col-3'>Bid price levels:</div>" << endl;
-	ss << "\t\t\t\t\t<div class='col-2'>" << pBook->vecBidLevels.size() << "</div>" << endl;
+	ss << "\t\t\t\t\t<div class='col-2'>" << ob.vecBidLevels.size() << "</div>" << endl;
 	ss << "\t\t\t\t</div>" << endl;
 
 	// Plot total ask levels
 	ss << "\t\t\t\t<div class='row'>" << endl;
 	ss << "\t\t\t\t\t<div class='col-3'>Ask price levels:</div>" << endl;
-	ss << "\t\t\t\t\t<div class='col-2'>" << pBook->vecAskLevels.size() << "</div>" << endl;
+	ss << "\t\t\t\t\t<div class='col-2'>" << ob.vecAskLevels.size() << "</div>" << endl;
 	ss << "\t\t\t\t</div>" << endl;
 
 	// Plot totals of bid and ask levels
 	ss << "\t\t\t\t<div class='row'>" << endl;
 	ss << "\t\t\t\t\t<div class='col-3'>Total price levels:</div>" << endl;
-	ss << "\t\t\t\t\t<div class='col-2'>" << pBook->vecBidLevels.size() + pBook->vecAskLevels.size() << "</div>" << endl;
+	ss << "\t\t\t\t\t<div class='col-2'>" << ob.vecBidLevels.size() + ob.vecAskLevels.size() << "</div>" << endl;
 	ss << "\t\t\t\t</div>" << endl;
 
+	// Plot the checks of every feed row against the live book
+	const OBBookEngine& obe = ob.bookEngine;
+	const BookChecks& bc = obe.getChecks();
+
+	auto plotCheck = [&ss](const string& szName, const string& szValue) {
+		ss << "\t\t\t\t<div class='row'>" << endl;
+		ss << "\t\t\t\t\t<div class='col-3'>" << szName << "</div>" << endl;
+		ss << "\t\t\t\t\t<div class='col-2'>" << szValue << "</div>" << endl;
+		ss << "\t\t\t\t</div>" << endl;
+	};
+
+	ss << "\t\t\t\t<h3 class ='linesep'>Book checks:</h3>" << endl;
+
+	plotCheck("Unchanged feeds:", to_string(bc.nUnchanged));
+	plotCheck("Crossed feeds:", to_string(bc.nCrossed));
+	plotCheck("Locked feeds:", to_string(bc.nLocked));
+	plotCheck("One-sided feeds:", to_string(bc.nOneSided));
+	plotCheck("Unordered feeds:", to_string(bc.nUnordered));
+	plotCheck("Off-ladder prices:", to_string(bc.nOffLadder));
+	plotCheck("Bid level changes:", to_string(bc.nBidChanges));
+	plotCheck("Ask level changes:", to_string(bc.nAskChanges));
+
+	// Rows that could not be read were skipped, the first ones are located in the feed
+	const FeedErrors& fe = ob.feedErrors;
+	plotCheck("Skipped rows:", to_string(fe.count()));
+	for (size_t i = 0; i < fe.vLog.size() && i < MAX_PLOTTED_FEED_ERRORS; ++i) {
+		const FeedErrors::FeedError& e = fe.vLog[i];
+		plotCheck("", string(e.fer == FeedErrors::FEED_ERROR_MALFORMED ? "Malformed" : "Bad number") + " at line " + to_string(e.nLine) + ", offset " + to_string(e.nOffset));
+	}
+	plotCheck("Last best bid:", obe.hasBid() ? obe.bestBid().toString() + " x " + to_string(obe.bestBidQty()) : "-");
+	plotCheck("Last best ask:", obe.hasAsk() ? obe.bestAsk().toString() + " x " + to_string(obe.bestAskQty()) : "-");
+
+	// Plot the spread and microstructure statistics, with prices to a hundredth of the quoted decimals
+	const BookAnalytics& ba = ob.analytics;
+	const string szPriceFormat = "%." + to_string(BookAnalytics::PRICE_DECIMALS) + "f";
+	auto plotPrice = [&szPriceFormat](double dUnits) { return str(boost::format(szPriceFormat) % BookAnalytics::toPrice(dUnits)); };
+
+	ss << "\t\t\t\t<h3 class ='linesep'>Spread analytics:</h3>" << endl;
+
+	plotCheck("Two-sided books:", to_string(ba.getBooks()));
+	plotCheck("Crossed books:", to_string(ba.getCrossed()));
+	if (ba.getBooks() > 0) {
+		plotCheck("Mean spread:", plotPrice(ba.getMeanSpread()));
+		plotCheck("Time-weighted spread:", plotPrice(ba.getTimeWeightedSpread()) + " over " + str(boost::format("%.1f") % (ba.getSpreadMs() / 1000.0)) + " s");
+		plotCheck("Spread range:", plotPrice(static_cast<double>(ba.getMinSpread())) + " to " + plotPrice(static_cast<double>(ba.getMaxSpread())));
+		plotCheck("Last mid / microprice:", plotPrice(ba.getLastMid()) + " / " + plotPrice(ba.getLastMicro()));
+	}
+
+	// Spread histogram in ticks, empty bins left out
+	const char* szBinsName = "Books by spread in ticks:";
+	for (int i = 0; i < BookAnalytics::SPREAD_BINS; ++i) {
+		if (ba.getSpreadBins()[i] == 0)
+			continue;
+
+		plotCheck(szBinsName, to_string(i) + (i == BookAnalytics::SPREAD_BINS - 1 ? "+" : "") + ": " + to_string(ba.getSpreadBins()[i]));
+		szBinsName = "";
+	}
+
+	const auto& vImbalance = ba.getImbalance();
+	for (size_t i = 0; i < vImbalance.size(); ++i)
+		plotCheck(i == 0 ? "Depth imbalance:" : "", "Level " + to_string(i + 1) + ": " + str(boost::format("%+.3f") % vImbalance[i].mean()));
+
+	// Mid and microprice series, each point the mean over the books of its span
+	const auto& vSeries = ba.getSeries();
+	if (!vSeries.empty()) {
+		plotCheck("Mid / microprice series:", "every " + str(boost::format("%.1f") % (ba.getSeriesWidthMs() / 1000.0)) + " s");
+		ss << "\t\t\t\t<div class='series'>" << endl;
+		for (const auto& sp : vSeries) {
+			if (sp.nBooks > 0)
+				plotCheck("+" + str(boost::format("%.1f") % ((sp.nTimeMs - vSeries.front().nTimeMs) / 1000.0)) + " s", plotPrice(sp.mid()) + " / " + plotPrice(sp.micro()));
+		}
+		ss << "\t\t\t\t</div>" << endl;
+	}
+
 	// Plot best spread section
 	ss << "\t\t\t\t<h3 class ='linesep'>Top best spreads:</h3>" << endl;
 
@@ -292,9 +494,9 @@ void OrderPlot::plotBookCol(boost::shared_ptr<OrderBook>& pBook, InjectParams& i
 		int nPlotSpreads = 0;
 
 		// Plot best market spread
-		for (const auto& ks : pBook->mapBestSpread) {
+		for (const auto& bs : ob.bestSpreads) {
 
-			if (nPlotSpreads++ == ijParams.nParam)
+			if (nPlotSpreads++ == nMaxSpreads)
 				break;
 
 			ss << "\t\t\t\t<h5>Best " << nPlotSpreads << ":</h5>" << endl;
@@ -302,16 +504,16 @@ void OrderPlot::plotBookCol(boost::shared_ptr<OrderBook>& pBook, InjectParams& i
 			// Plot the spread
 			ss << "\t\t\t\t<div class='row bg-light'>" << endl;
 			ss << "\t\t\t\t\t<div class='col-3'>Spread:</div>" << endl;
-			ss << "\t\t\t\t\t<div class='col-2'>" << ks.first << "</div>" << endl;
+			ss << "\t\t\t\t\t<div class='col-2'>" << bs.prSpread << "</div>" << endl;
 			ss << "\t\t\t\t</div>" << endl;
 
 			// Plot the midpoint
-			// Add the spread to the bid price used as a key to the map of levels
-			double dMidPoint = boost::lexical_cast<double>(ks.second.begin()->first + ks.first + ks.second.begin()->first) / 2.0;
+			// Add the spread to the lowest bid price it was seen at, the mid point takes one more decimal than the prices
+			auto prMidPoint = OBPrice::midpoint(bs.prBidPrice, bs.prBidPrice + bs.prSpread);
 
 			ss << "\t\t\t\t<div class='row bg-light'>" << endl;
 			ss << "\t\t\t\t\t<div class='col-3'>Mid point:</div>" << endl;
-			ss << "\t\t\t\t\t<div class='col-2'>" << dMidPoint << "</div>" << endl;;
+			ss << "\t\t\t\t\t<div class='col-2'>" << prMidPoint << "</div>" << endl;;
 			ss << "\t\t\t\t</div>" << endl;
 
 			ss << "\t\t\t\t<div class='row bg-light gapsep'>" << endl;
@@ -327,7 +529,7 @@ void OrderPlot::plotBookCol(boost::shared_ptr<OrderBook>& pBook, InjectParams& i
 			ss << "\t\t\t\t</div>" << endl;
 
 			// Fetch the ask levels for this spread
-			const BidAskLevels& balCsv = ks.second.begin()->second;
+			const BidAskLevels& balCsv = bs.bal;
 
 			for (const auto& as : boost::adaptors::reverse(balCsv.vAskQty)) {
 
@@ -375,52 +577,190 @@ void OrderPlot::plotBookCol(boost::shared_ptr<OrderBook>& pBook, InjectParams& i
 	ss << "\t\t\t</div>" << endl; 
 }
 
-void OrderPlot::injectHtml(const InjectParams& ijParams, const stringstream& ss) {
+string OrderPlot::makeFeedFile(const string& szFile, const string& szFeed) {
 
-	// Now inject the built columns in the html
-	vector<string> vHtml;
+	// Insert the feed name before the file extension, e.g. orderbook_feed1.htm
+	size_t nDot = szFile.find_last_of('.');
+	size_t nSep = szFile.find_last_of("/\\");
+	if (nDot == string::npos || (nSep != string::npos && nDot < nSep))
+		return szFile + "_" + szFeed;
 
-	ifstream file(ijParams.szHtml);
-	string line;
+	return szFile.substr(0, nDot) + "_" + szFeed + szFile.substr(nDot);
+}
 
-	// First read and parse all the html lines
-	while (getline(file, line)) {
-		vHtml.push_back(line);
+string OrderPlot::plotBatchIndex(const string& szXml, const vector<BatchEntry>& vEntries) {
+
+	// Setup the tree to parse the xml file
+	using namespace boost::property_tree::xml_parser;
+	using boost::property_tree::ptree;
+	ptree pt;
+	read_xml(szXml, pt, trim_whitespace | no_comments);
+
+	InjectParams ijParams;
+	ijParams.szTemplate = pt.get<string>(szBookPlot + "file", "orderbook.htm");
+	ijParams.szHtml = pt.get<string>(szBookPlot + "index", makeFeedFile(ijParams.szTemplate, "index"));
+	ijParams.szMarkerBegin = pt.get<string>(szBookPlot + "markers.begin_summary", "begin summary");
+	ijParams.szMarkerEnd = pt.get<string>(szBookPlot + "markers.end_summary", "end summary");
+
+	vector<OBPlotSection> vSections(1);
+	ostream& ss = vSections[0];
+
+	// One row per session feed with a link to its summary
+	ss << "\t<div class='container-fluid'>" << endl;
+	ss << "\t<h3 class='linebot'>" << pt.get<string>(szBookPlot + "summary", "Order Books Summary") << " - " << vEntries.size() << " session feeds</h3>" << endl;
+
+	ss << "\t\t<div class='row linebot'>" << endl;
+	ss << "\t\t\t<div class='col-2'>Session feed</div>" << endl;
+	ss << "\t\t\t<div class='col-2'>Csv feeds</div>" << endl;
+	ss << "\t\t\t<div class='col-2'>Log feeds</div>" << endl;
+	ss << "\t\t\t<div class='col-4'>Summary</div>" << endl;
+	ss << "\t\t</div>" << endl;
+
+	for (const auto& be : vEntries) {
+		ss << "\t\t<div class='row'>" << endl;
+		ss << "\t\t\t<div class='col-2'>" << be.szFeed << "</div>" << endl;
+		ss << "\t\t\t<div class='col-2'>" << be.szCsvFile << ": " << be.nCsvFeeds << "</div>" << endl;
+		ss << "\t\t\t<div class='col-2'>" << be.szLogFile << ": " << be.nLogFeeds << "</div>" << endl;
+		if (be.szError.empty())
+			ss << "\t\t\t<div class='col-4'><a href='" << be.szPlotFile << "'>" << be.szPlotFile << "</a></div>" << endl;
+		else
+			ss << "\t\t\t<div class='col-4'><span class='boldfield'>" << be.szError << "</span></div>" << endl;
+		ss << "\t\t</div>" << endl;
 	}
 
-	// We are done
-	file.close();
+	ss << "\t</div>" << endl;
+
+	injectHtml(ijParams, vSections);
+	return ijParams.szHtml;
+}
 
-	// Inject the lines between the begin and section
-	ofstream ofs(ijParams.szHtml);
-	regex reBegin(ijParams.szMarkerBegin);
-	regex reEnd(ijParams.szMarkerEnd);
-	smatch m;
+void OrderPlot::injectHtml(const InjectParams& ijParams, const vector<OBPlotSection>& vSections) {
+
+	// Stub to allocate function name at compile time
+	static const string SZ_ORDERPLOT_INJECTHTML = "injectHtml";
+
+	ifstream file(ijParams.szTemplate);
+	if (!file)
+		throw TracedException(SZ_ORDERPLOT_EXCEPTION, "Cannot read plot template " + ijParams.szTemplate, SZ_ORDERPLOT_INJECTHTML);
+
+	// The template may be the report itself, it is read through before the report is replaced
+	OBReportFile rf(ijParams.szHtml);
+	ofstream& ofs = rf.stream();
 
 	bool bSkipNextLines = false;
+	string line;
 
-	// Merge trade bars
-	for (auto& line : vHtml)
-	{
-		if (regex_search(line, m, reEnd) == true) {
+	// Copy the template a line at a time, the markers are plain text found anywhere in their line
+	while (getline(file, line)) {
+
+		if (line.find(ijParams.szMarkerEnd) != string::npos)
 			bSkipNextLines = false;
-		}
 
 		if (bSkipNextLines == true)
 			continue;
 
-		ofs << line << endl;
+		ofs << line << '\n';
 
-		if (regex_search(line, m, reBegin) == true) {
+		if (line.find(ijParams.szMarkerBegin) != string::npos) {
 
 			// Inject summary html
-			ofs << ss.str();
+			for (const auto& os : vSections)
+				ofs << os.str();
 
 			// Skip the lines until the end marker line
 			bSkipNextLines = true;
 		}
 	}
-	ofs.close();
+
+	file.close();
+	rf.commit();
 }
 
+OBHtmlEmitter::OBHtmlEmitter(const InjectParams& ijParams, const OrderBook& obCsv, const OrderBook& obLog, int nThreads) :
+	m_ijParams(ijParams), m_ijBid(ijParams), m_ijAsk(ijParams), m_pijLevels(&m_ijBid), m_nThreads(nThreads), m_iSection(0) {
+
+	m_ijBid.szParam = "Bid";
+	m_ijAsk.szParam = "Ask";
+
+	size_t nBidLevels = max(obCsv.vecBidLevels.size(), obLog.vecBidLevels.size());
+	size_t nAskLevels = max(obCsv.vecAskLevels.size(), obLog.vecAskLevels.size());
+
+	vector<OBPlotSection> vSections(5 + nBidLevels + nAskLevels);
+	m_vSections.swap(vSections);
+	m_vTasks.reserve(2 + nBidLevels + nAskLevels);
 
+	// Size every section before it is rendered, so none is copied as it grows
+	auto getPairs = [](const vecLevels& vl, size_t i) { return (i < vl.size()) ? vl[i].size() : 0; };
+
+	size_t nSpreads = static_cast<size_t>(std::max(ijParams.nParam, 0));
+	m_vSections[1].reserve(4096 + nSpreads * (obCsv.nBookLevels + 1) * 2 * PLOT_SPREAD_LEVEL_BYTES);
+	m_vSections[2].reserve(4096 + nSpreads * (obLog.nBookLevels + 1) * 2 * PLOT_SPREAD_LEVEL_BYTES);
+
+	for (size_t i = 0; i < nBidLevels; ++i)
+		m_vSections[4 + i].reserve(512 + (getPairs(obCsv.vecBidLevels, i) + getPairs(obLog.vecBidLevels, i)) * PLOT_PAIR_BYTES);
+
+	for (size_t i = 0; i < nAskLevels; ++i)
+		m_vSections[5 + nBidLevels + i].reserve(512 + (getPairs(obCsv.vecAskLevels, i) + getPairs(obLog.vecAskLevels, i)) * PLOT_PAIR_BYTES);
+}
+
+void OBHtmlEmitter::beginReport(const string& szHeader) {
+
+	// Build two-column summary to see results side-by-side
+
+	// - Source feeds
+	ostream& ss = m_vSections[m_iSection++];
+	ss << "\t<div class='container-fluid'>" << endl;
+	ss << "\t<h3 class='linebot'>" << szHeader << "</h3>" << endl;
+	ss << "\t\t<div class='row'>" << endl;
+}
+
+void OBHtmlEmitter::emitBook(REPORT_BOOK, const OrderBook& ob, int nMaxSpreads) {
+
+	OBPlotSection& ss = m_vSections[m_iSection++];
+	m_vTasks.push_back([&ob, nMaxSpreads, &ss]() { OrderPlot::plotBookCol(ob, nMaxSpreads, ss); });
+}
+
+void OBHtmlEmitter::beginLevels(REPORT_SIDE rs, size_t) {
+
+	ostream& ss = m_vSections[m_iSection++];
+
+	if (rs == REPORT_BID) {
+		ss << "\t\t</div>" << endl;
+		ss << "\t</div>" << endl;
+
+		// Price-Quantity offers' differences
+		ss << "\t<h3 class='gapsep'>Price-Quantity offers:</h3>" << endl;
+		ss << "\t\t\t\t<h5 class='gapsep'>Bid price offers:</h5>" << endl;
+		m_pijLevels = &m_ijBid;
+	}
+	else {
+		ss << "\t\t\t\t<h5 class='gapsep'>Ask price offers:</h5>" << endl;
+		m_pijLevels = &m_ijAsk;
+	}
+}
+
+void OBHtmlEmitter::emitLevelDiff(const LevelDiff& ld) {
+
+	// The level differences are held by the caller until the report ends
+	OBPlotSection& ss = m_vSections[m_iSection++];
+	const InjectParams* pij = m_pijLevels;
+	m_vTasks.push_back([&ld, pij, &ss]() { OrderPlot::plotLevelDiff(ld, *pij, ss); });
+}
+
+void OBHtmlEmitter::endReport() {
+
+	// Render the sections concurrently, the books and level differences are only read
+	OrderPlot::runTasks(m_vTasks, m_nThreads);
+	m_vTasks.clear();
+
+	// Update the html file
+	OrderPlot::injectHtml(m_ijParams, m_vSections);
+}
+
+uint64_t OBHtmlEmitter::getBytes() const {
+
+	uint64_t nBytes = 0;
+	for (const auto& os : m_vSections)
+		nBytes += os.str().size();
+	return nBytes;
+}
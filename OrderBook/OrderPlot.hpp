@@ -1,10 +1,11 @@
 #pragma once
 
-const int MAX_BEST_SPREADS = 5;
+#include "OrderReport.hpp"
 
 typedef struct InjectParams {
 
 	string		szHtml;
+	string		szTemplate;
 	string		szHeader;
 	string		szTitle;
 	string		szSubTitle;
@@ -18,6 +19,89 @@ typedef struct InjectParams {
 
 } InjectParams;
 
+// Outcome of one session feed of a batch run, listed in the batch index
+typedef struct BatchEntry {
+
+	string		szFeed;
+	string		szCsvFile;
+	string		szLogFile;
+	string		szPlotFile;
+	string		szError;
+
+	int			nCsvFeeds;
+	int			nLogFeeds;
+
+} BatchEntry;
+
+
+// Output stream of one report section, appending to a buffer that can be sized before the section
+// is rendered. Sections are rendered apart from each other and written to the report in order.
+class OBPlotSection : public std::ostream {
+
+	class SectionBuffer : public std::streambuf {
+	public:
+		string	m_szBuffer;
+
+	protected:
+		int_type overflow(int_type ch) override {
+			if (!traits_type::eq_int_type(ch, traits_type::eof()))
+				m_szBuffer.push_back(traits_type::to_char_type(ch));
+			return traits_type::not_eof(ch);
+		}
+
+		std::streamsize xsputn(const char* s, std::streamsize n) override {
+			m_szBuffer.append(s, static_cast<size_t>(n));
+			return n;
+		}
+	};
+
+public:
+	OBPlotSection() : std::ostream(&m_sb) {}
+	OBPlotSection(const OBPlotSection&) = delete;
+	OBPlotSection& operator=(const OBPlotSection&) = delete;
+
+	void reserve(size_t nBytes)		{ m_sb.m_szBuffer.reserve(nBytes); }
+	const string& str() const		{ return m_sb.m_szBuffer; }
+
+private:
+	SectionBuffer	m_sb;
+};
+
+
+// Html format of the report, a Bootstrap page made from the plot template. Each book column and each
+// level difference is its own section, sized from the books up front; the sections are rendered
+// concurrently once the report ends, then injected between the template markers in report order.
+class OBHtmlEmitter : public OBReportEmitter
+{
+public:
+	OBHtmlEmitter(const InjectParams& ijParams, const OrderBook& obCsv, const OrderBook& obLog, int nThreads);
+
+	void beginReport(const string& szHeader) override;
+	void emitBook(REPORT_BOOK rb, const OrderBook& ob, int nMaxSpreads) override;
+	void beginLevels(REPORT_SIDE rs, size_t nLevels) override;
+	void emitLevelDiff(const LevelDiff& ld) override;
+	void endReport() override;
+
+	const string& getFile() const override		{ return m_ijParams.szHtml; }
+	uint64_t getBytes() const override;
+
+private:
+	InjectParams		m_ijParams;
+	InjectParams		m_ijBid;		// Each side of the level differences reads its own parameters, as both sides are rendered at once
+	InjectParams		m_ijAsk;
+	const InjectParams*	m_pijLevels;	// Parameters of the side being laid out
+	int					m_nThreads;
+
+	// Sections in report order: heading, csv and log columns, bid heading, bid levels, ask heading, ask levels
+	vector<OBPlotSection>			m_vSections;
+	size_t							m_iSection;		// Next section laid out
+	vector<std::function<void()>>	m_vTasks;		// Rendering of the sections laid out, run when the report ends
+
+	// Bytes rendered for a price quantity pair of a level and for a level of a best spread, to size the sections up front
+	static constexpr size_t PLOT_PAIR_BYTES = 160;
+	static constexpr size_t PLOT_SPREAD_LEVEL_BYTES = 400;
+};
+
 
 // Base class
 class OrderPlot {
@@ -25,19 +109,60 @@ class OrderPlot {
 public:
 	// Chart plotting interface methds
 	OrderPlot() = delete;
-	explicit OrderPlot(const string& szXmlFile, OBStreamCSV& obsCsv, OBStreamLog& obsLog);
+	explicit OrderPlot(const string& szXmlFile, OBStreamCSV& obsCsv, OBStreamLog& obsLog, const string& szFeed = "");
+
+	// Plot two books read from the csv and log feeds, as the shards of one instrument are
+	OrderPlot(const string& szXmlFile, boost::shared_ptr<OrderBook> pCsvBook, boost::shared_ptr<OrderBook> pLogBook, const string& szFeed);
 	const string& getPlotFile() const { return m_szPlotFile; }
 
+	// Every file of the report, one per format asked for in the order asked
+	const vector<string>& getReportFiles() const { return m_vReportFiles; }
+
+	// Counts and stage times of building and writing the report
+	const RunStats& getRunStats() const { return m_runStats; }
+
+	// Plot the index of all the session feeds of a batch run and return its file name
+	static string plotBatchIndex(const string& szXmlFile, const vector<BatchEntry>& vEntries);
+
+	// Name a file after a session feed or an instrument, e.g. orderbook_feed1.htm
+	static string	makeFeedFile(const string& szFile, const string& szFeed);
+
+	// Price/quantity pairs either feed saw at a book level and the other did not, in one merge of both sorted levels
+	static void	diffLevel(const vecLevels& vCsvLevels, const vecLevels& vLogLevels, size_t iLevel, LevelDiff& ld);
+
 private:
-	void	plotBookSummary(InjectParams& ijParams);
-	void	plotBookCol(boost::shared_ptr<OrderBook>& m_pBook, InjectParams& ijParams, stringstream& ss);
-	void	plotBookLevelsDiff(vecLevels& vCsvLevels, vecLevels& vLogLevels, InjectParams& ijParams, stringstream& ss);
-	void	plotLevels(vecLevels& vl, InjectParams& ijParams, stringstream& ss);
-	void	plotLevelCol(const vecPairInt& vpi, InjectParams& ijParams, stringstream& ss, bool bFluid=true);
-	void	injectHtml(const InjectParams& ijParams, const stringstream& ss);
+	// Compare the levels of both books once, then write the report in each format asked for
+	void	plotBookSummary(const InjectParams& ijParams, const string& szFormats);
+	static void	plotBookCol(const OrderBook& ob, int nMaxSpreads, ostream& ss);
+	static void	plotBookLevelsDiff(const vecLevels& vCsvLevels, const vecLevels& vLogLevels, const InjectParams& ijParams, ostream& ss);
+	static void	plotLevelDiff(const LevelDiff& ld, const InjectParams& ijParams, ostream& ss);
+	static void	plotLevelCol(const vecPriceQty& vpi, const InjectParams& ijParams, ostream& ss, bool bFluid=true);
+
+	// Stream the template to a temporary file with the report between the markers, then rename it over the report
+	static void	injectHtml(const InjectParams& ijParams, const vector<OBPlotSection>& vSections);
+
+	// Run tasks on up to nThreads threads, all the hardware threads when 0, then rethrow the first failure
+	static void	runTasks(const vector<std::function<void()>>& vTasks, int nThreads);
+
+	// Print the run statistics of both feeds and of the report, or write them next to the report
+	void	writeStats(const string& szMode) const;
 
 private:
 	string	m_szPlotFile;
+	vector<string>	m_vReportFiles;
 	boost::shared_ptr<OrderBook> m_pCsvBook;
 	boost::shared_ptr<OrderBook> m_pLogBook;
+	RunStats	m_runStats;
+	int			m_nPlotThreads;		// Threads comparing the levels, writing the formats and rendering the html sections, all the hardware threads when 0
+
+	// Skipped rows located in the plot, the others are only counted
+	static constexpr size_t MAX_PLOTTED_FEED_ERRORS = 10;
+
+	static constexpr auto SZ_ORDERPLOT_EXCEPTION = "OrderPlot Exception";
+
+	// The html format renders with the plot helpers
+	friend class OBHtmlEmitter;
+
+	// The benchmarks time the level diff on its own
+	friend class OBBench;
 };
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <ostream>
+#include <limits>
+
+// Decimal price held as a whole number of units of its last decimal, Scale decimals after the point.
+// Prices compare, add and hash as integers, parse without rounding and print back as quoted, so no
+// floating point or arbitrary precision arithmetic is needed to handle them exactly.
+template <int Scale, typename Units = int32_t>
+class Price
+{
+	static_assert(Scale >= 0 && Scale <= std::numeric_limits<Units>::digits10, "Price decimals must fit its units");
+
+public:
+	constexpr Price() : m_nUnits(0) {}
+
+	static constexpr Price fromUnits(Units nUnits)	{ return Price(nUnits); }
+	constexpr Units units() const					{ return m_nUnits; }
+
+	// Units in a price of one
+	static constexpr int64_t unitsPerOne() {
+		int64_t n = 1;
+		for (int i = 0; i < Scale; ++i)
+			n *= 10;
+		return n;
+	}
+
+	// Read "123" or "123.45". Fails on any other character, on decimals beyond Scale other than
+	// trailing zeros as they cannot be held exactly, and on prices out of range, leaving pr unchanged.
+	static bool parse(const char* pBeg, const char* pEnd, Price& pr) {
+
+		int64_t nUnits = 0;
+		const char* p = pBeg;
+		for (; p != pEnd && isDigit(*p); ++p) {
+			if (!pushDigit(nUnits, *p - '0'))
+				return false;
+		}
+
+		if (p == pBeg)
+			return false;
+
+		int nDecimals = 0;
+		if (p != pEnd) {
+			if (*p != '.')
+				return false;
+
+			const char* pFraction = ++p;
+			for (; p != pEnd && isDigit(*p); ++p) {
+				if (nDecimals == Scale) {
+					if (*p != '0')
+						return false;
+					continue;
+				}
+
+				if (!pushDigit(nUnits, *p - '0'))
+					return false;
+				++nDecimals;
+			}
+
+			if (p == pFraction || p != pEnd)
+				return false;
+		}
+
+		for (; nDecimals < Scale; ++nDecimals) {
+			if (!pushDigit(nUnits, 0))
+				return false;
+		}
+
+		pr.m_nUnits = static_cast<Units>(nUnits);
+		return true;
+	}
+
+	// Mid point of two prices. It takes one more decimal than they do, so it is exact.
+	static Price<Scale + 1, int64_t> midpoint(Price prLow, Price prHigh) {
+		return Price<Scale + 1, int64_t>::fromUnits((static_cast<int64_t>(prLow.m_nUnits) + prHigh.m_nUnits) * 5);
+	}
+
+	// Whole part and decimals as quoted, trailing zero decimals left out so whole prices print as integers
+	string toString() const {
+
+		int64_t nUnits = m_nUnits;
+		string szPrice = (nUnits < 0) ? "-" : "";
+		uint64_t nAbs = (nUnits < 0) ? 0 - static_cast<uint64_t>(nUnits) : static_cast<uint64_t>(nUnits);
+
+		szPrice += std::to_string(nAbs / unitsPerOne());
+
+		uint64_t nFraction = nAbs % unitsPerOne();
+		if (nFraction != 0) {
+			string szFraction = std::to_string(nFraction);
+			szFraction.insert(0, Scale - szFraction.size(), '0');
+			szFraction.erase(szFraction.find_last_not_of('0') + 1);
+			szPrice += '.' + szFraction;
+		}
+
+		return szPrice;
+	}
+
+	friend ostream& operator<<(ostream& os, Price pr)	{ return os << pr.toString(); }
+
+	constexpr Price operator+(Price pr) const	{ return Price(m_nUnits + pr.m_nUnits); }
+	constexpr Price operator-(Price pr) const	{ return Price(m_nUnits - pr.m_nUnits); }
+	constexpr Price operator-() const			{ return Price(-m_nUnits); }
+
+	constexpr bool operator==(Price pr) const	{ return m_nUnits == pr.m_nUnits; }
+	constexpr bool operator!=(Price pr) const	{ return m_nUnits != pr.m_nUnits; }
+	constexpr bool operator<(Price pr) const	{ return m_nUnits < pr.m_nUnits; }
+	constexpr bool operator<=(Price pr) const	{ return m_nUnits <= pr.m_nUnits; }
+	constexpr bool operator>(Price pr) const	{ return m_nUnits > pr.m_nUnits; }
+	constexpr bool operator>=(Price pr) const	{ return m_nUnits >= pr.m_nUnits; }
+
+private:
+	explicit constexpr Price(Units nUnits) : m_nUnits(nUnits) {}
+
+	static bool isDigit(char c)					{ return c >= '0' && c <= '9'; }
+
+	// Append a digit to the units read so far, failing before they go out of range, 64 bit units included
+	static bool pushDigit(int64_t& nUnits, int nDigit) {
+		const int64_t nMax = std::numeric_limits<Units>::max();
+		if (nUnits > nMax / 10 || (nUnits == nMax / 10 && nDigit > nMax % 10))
+			return false;
+
+		nUnits = nUnits * 10 + nDigit;
+		return true;
+	}
+
+private:
+	Units		m_nUnits;
+};
@@ -0,0 +1,390 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Time aligned reconciliation of the csv and log source feeds
+// Added reconciliation of compressed source feeds
+// Added reconciliation of every instrument of interleaved source feeds in one pass
+//==============================================================
+#include "pch.h"
+#include <iostream>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <boost/format.hpp>
+
+using namespace std;
+
+#include "OrderSource.hpp"
+#include "OrderRecon.hpp"
+
+OBReconcile::OBReconcile(const OBStream& obsCsv, const OBStream& obsLog, const string& szDiffFile)
+	: m_rfCsv(obsCsv, true), m_rfLog(obsLog, false), m_nToleranceMs(1000), m_nLogOffsetMs(0), m_nWindowMs(60000), m_nSettledWindow(LLONG_MIN) {
+
+	m_dqEntries.emplace_back(OBPerfectHash::NO_KEY, szDiffFile);
+}
+
+void OBReconcile::setInstruments(const boost::shared_ptr<const OBInstrumentMap>& pInstruments) {
+
+	m_pInstruments = pInstruments;
+	m_viEntries.assign(pInstruments ? pInstruments->size() : 0, OBPerfectHash::NO_KEY);
+	m_dqEntries.clear();
+}
+
+void OBReconcile::addInstrument(int iInstrument, const string& szDiffFile) {
+
+	m_viEntries.at(iInstrument) = static_cast<int>(m_dqEntries.size());
+	m_dqEntries.emplace_back(iInstrument, szDiffFile);
+}
+
+void OBReconcile::reconcile() {
+
+	// Stub to allocate function name at compile time
+	static const string SZ_OBRECONCILE_RECONCILE = "reconcile";
+
+	// Safely walk both feeds so the caller can decide what to do with a failure
+	try {
+		run();
+	}
+	catch (const TracedException& te) {
+		m_eei = te.getExceptionInfo();
+	}
+	catch (const std::bad_alloc&) {
+		TracedException te(SZ_OBRECONCILE_EXCEPTION, TracedException::SZ_EXCEPTION_BADALLOC, SZ_OBRECONCILE_RECONCILE);
+		m_eei = te.getExceptionInfo();
+	}
+	catch (...) {
+		TracedException te(SZ_OBRECONCILE_EXCEPTION, TracedException::SZ_EXCEPTION_UNEXPECTED, SZ_OBRECONCILE_RECONCILE);
+		m_eei = te.getExceptionInfo();
+	}
+}
+
+void OBReconcile::CheckNotifyException() const {
+
+	if (IsCaughtException())
+	{
+		cout << "Exception was caught reconciling feeds in class object OBReconcile" << endl;
+
+		// Rethrow the caught exception up the call stack
+		TracedException te(m_eei);
+		throw te;
+	}
+}
+
+void OBReconcile::run() {
+
+	if (m_dqEntries.empty())
+		return;
+
+	// Both feeds are scanned once front to back through their own mappings, or inflated block by block when compressed
+	std::unique_ptr<OBMappedFile> pmfCsv, pmfLog;
+	std::unique_ptr<OBCompressedFile> pcfCsv, pcfLog;
+	openSource(m_rfCsv, pmfCsv, pcfCsv);
+	openSource(m_rfLog, pmfLog, pcfLog);
+	m_rfLog.nOffsetMs = m_nLogOffsetMs;
+
+	for (auto& re : m_dqEntries) {
+		re.ossDiff << "Reconciliation of " << m_rfCsv.obs.getSourceFeed() << " and " << m_rfLog.obs.getSourceFeed()
+			<< ", tolerance " << m_nToleranceMs << " ms, log offset " << m_nLogOffsetMs << " ms, window " << m_nWindowMs << " ms" << '\n';
+		writeDiff(re, ios::trunc);
+	}
+
+	advance(m_rfCsv);
+	advance(m_rfLog);
+
+	while (m_rfCsv.iNext != OBPerfectHash::NO_KEY || m_rfLog.iNext != OBPerfectHash::NO_KEY) {
+
+		// Take the earlier book, the csv one first on equal time stamps
+		bool bCsv = m_rfLog.iNext == OBPerfectHash::NO_KEY || (m_rfCsv.iNext != OBPerfectHash::NO_KEY && m_rfCsv.nNextMs <= m_rfLog.nNextMs);
+		ReconFeed& rf = bCsv ? m_rfCsv : m_rfLog;
+
+		ReconEntry& re = m_dqEntries[rf.iNext];
+		take(rf);
+		settle(re);
+
+		// The instruments not read from lately are settled each time the feeds enter a new window
+		long long nNextMs = std::min(m_rfCsv.nNextMs, m_rfLog.nNextMs);
+		if (m_dqEntries.size() > 1 && nNextMs != LLONG_MAX && windowOf(nNextMs) > m_nSettledWindow) {
+			for (auto& reSettled : m_dqEntries)
+				settle(reSettled);
+			m_nSettledWindow = windowOf(nNextMs);
+		}
+	}
+
+	for (auto& re : m_dqEntries)
+		finish(re);
+}
+
+void OBReconcile::openSource(ReconFeed& rf, std::unique_ptr<OBMappedFile>& pmf, std::unique_ptr<OBCompressedFile>& pcf) {
+
+	const string& szFile = rf.obs.getSourceFeed();
+	if (OBCompressedFile::codecOf(szFile) != OBCompressedFile::FEED_CODEC_NONE) {
+		pcf.reset(new OBCompressedFile(szFile));
+		rf.pCur = rf.pEnd = nullptr;
+	}
+	else {
+		pmf.reset(new OBMappedFile(szFile));
+		rf.pCur = pmf->data();
+		rf.pEnd = pmf->data() + pmf->size();
+	}
+
+	rf.pInflated = pcf.get();
+	rf.nHeaderLines = rf.obs.getHeaderLines();
+}
+
+void OBReconcile::advance(ReconFeed& rf) {
+
+	rf.iNext = OBPerfectHash::NO_KEY;
+	rf.nNextMs = LLONG_MAX;
+
+	for (;;) {
+
+		// A compressed feed is read a block of whole rows at a time, its books are copied out of the block
+		if (rf.pCur == rf.pEnd) {
+			size_t nBytes;
+			if (rf.pInflated == nullptr || !rf.pInflated->next(rf.pCur, nBytes))
+				break;
+			rf.pEnd = rf.pCur + nBytes;
+		}
+
+		// Slice the next row in place
+		const char* pEol = static_cast<const char*>(memchr(rf.pCur, '\n', rf.pEnd - rf.pCur));
+		const char* pRowEnd = (pEol != nullptr) ? pEol : rf.pEnd;
+
+		string_view svLine(rf.pCur, pRowEnd - rf.pCur);
+		if (!svLine.empty() && svLine.back() == '\r')
+			svLine.remove_suffix(1);
+
+		rf.pCur = (pEol != nullptr) ? pEol + 1 : rf.pEnd;
+
+		if (rf.nHeaderLines > 0) {
+			--rf.nHeaderLines;
+			continue;
+		}
+
+		if (svLine.empty())
+			continue;
+
+		// Rows are routed to their instrument by key, the rows of instruments not reconciled are passed over
+		int iEntry = 0;
+		if (m_pInstruments) {
+			string_view svKey;
+			OBStream::FEED_ROW_STATUS frs = rf.obs.tokenizeInstrument(svLine, svKey);
+			if (frs != OBStream::FEED_ROW_BOOK) {
+				if (frs != OBStream::FEED_ROW_SKIP)
+					rf.nMalformed++;
+				continue;
+			}
+
+			int iInstrument = rf.obs.findInstrument(*m_pInstruments, svKey);
+			iEntry = (iInstrument != OBPerfectHash::NO_KEY) ? m_viEntries[iInstrument] : OBPerfectHash::NO_KEY;
+			if (iEntry == OBPerfectHash::NO_KEY)
+				continue;
+		}
+
+		ReconSide& rs = m_dqEntries[iEntry].side(rf.bCsv);
+
+		OBStream::FEED_ROW_STATUS frs = rf.obs.readSnapshot(svLine, rf.fsRow);
+		if (frs == OBStream::FEED_ROW_SKIP)
+			continue;
+
+		if (frs != OBStream::FEED_ROW_BOOK) {
+			rs.nMalformed++;
+			continue;
+		}
+
+		// Repeats of the last book of the instrument carry nothing to reconcile
+		if (rs.bSeen && rf.fsRow.bal.vBidQty == rs.fsLast.bal.vBidQty && rf.fsRow.bal.vAskQty == rs.fsLast.bal.vAskQty)
+			continue;
+
+		// Bring the row to the csv clock and keep the feed in time order
+		rf.fsRow.nTimeMs = std::max(rf.fsRow.nTimeMs + rf.nOffsetMs, rf.nLastMs);
+		rf.nLastMs = rf.fsRow.nTimeMs;
+
+		std::swap(rs.fsLast, rf.fsRow);
+		rs.bSeen = true;
+
+		rf.iNext = iEntry;
+		rf.nNextMs = rs.fsLast.nTimeMs;
+		return;
+	}
+}
+
+void OBReconcile::take(ReconFeed& rf) {
+
+	ReconEntry& re = m_dqEntries[rf.iNext];
+	ReconSide& rs = re.side(rf.bCsv);
+	ReconSide& rsOther = re.side(!rf.bCsv);
+
+	const long long nTimeMs = rs.fsLast.nTimeMs;
+	const BidAskLevels& bal = rs.fsLast.bal;
+
+	ReconCounts& rc = re.mapWindows[windowOf(nTimeMs)];
+	if (rf.bCsv)
+		rc.nCsvBooks++;
+	else
+		rc.nLogBooks++;
+
+	// Match the oldest equal book the other feed showed within the tolerance
+	auto it = std::find_if(rsOther.dqPending.begin(), rsOther.dqPending.end(), [&](const PendingBook& pb) {
+		return nTimeMs - pb.nTimeMs <= m_nToleranceMs && pb.bal.vBidQty == bal.vBidQty && pb.bal.vAskQty == bal.vAskQty;
+	});
+
+	if (it != rsOther.dqPending.end()) {
+		rc.nMatched++;
+		rsOther.dqPending.erase(it);
+	}
+	else {
+		// Keep the pending books bounded when the other feed stalls
+		if (rs.dqPending.size() == MAX_PENDING_BOOKS) {
+			diverge(re, rf.bCsv, rs.dqPending.front());
+			rs.dqPending.pop_front();
+		}
+		rs.dqPending.push_back(PendingBook{ nTimeMs, bal });
+	}
+
+	advance(rf);
+}
+
+void OBReconcile::settle(ReconEntry& re) {
+
+	// Books the other feed has moved past can no longer be matched
+	expire(re, true, m_rfLog.nNextMs, false);
+	expire(re, false, m_rfCsv.nNextMs, false);
+
+	// No book of the instrument is counted ahead of the oldest one still unread or pending
+	long long nFrontierMs = std::min(m_rfCsv.nNextMs, m_rfLog.nNextMs);
+	if (!re.rsCsv.dqPending.empty())
+		nFrontierMs = std::min(nFrontierMs, re.rsCsv.dqPending.front().nTimeMs);
+	if (!re.rsLog.dqPending.empty())
+		nFrontierMs = std::min(nFrontierMs, re.rsLog.dqPending.front().nTimeMs);
+
+	closeWindows(re, nFrontierMs);
+
+	if (re.ossDiff.tellp() >= DIFF_FLUSH_BYTES)
+		writeDiff(re, ios::app);
+}
+
+void OBReconcile::expire(ReconEntry& re, bool bCsv, long long nFrontierMs, bool bAll) {
+
+	ReconSide& rs = re.side(bCsv);
+	while (!rs.dqPending.empty() && (bAll || rs.dqPending.front().nTimeMs + m_nToleranceMs < nFrontierMs)) {
+		diverge(re, bCsv, rs.dqPending.front());
+		rs.dqPending.pop_front();
+	}
+}
+
+void OBReconcile::diverge(ReconEntry& re, bool bCsv, const PendingBook& pb) {
+
+	ReconCounts& rc = re.mapWindows[windowOf(pb.nTimeMs)];
+	if (bCsv)
+		rc.nCsvOnly++;
+	else
+		rc.nLogOnly++;
+
+	re.ossDiff << formatTime(pb.nTimeMs) << (bCsv ? " csv only" : " log only");
+	formatBook(re.ossDiff, pb.bal);
+	re.ossDiff << '\n';
+}
+
+void OBReconcile::closeWindows(ReconEntry& re, long long nFrontierMs) {
+
+	while (!re.mapWindows.empty()) {
+
+		auto it = re.mapWindows.begin();
+		long long nBegMs = it->first * m_nWindowMs;
+		if (nBegMs + m_nWindowMs > nFrontierMs)
+			break;
+
+		// Summarise the windows whose books did not all match
+		const ReconCounts& rc = it->second;
+		if (rc.diverged()) {
+			re.ossDiff << "Window " << formatTime(nBegMs) << " to " << formatTime(nBegMs + m_nWindowMs) << ": csv " << rc.nCsvBooks << ", log " << rc.nLogBooks
+				<< ", matched " << rc.nMatched << ", csv only " << rc.nCsvOnly << ", log only " << rc.nLogOnly << '\n';
+		}
+
+		re.rcTotals.nCsvBooks += rc.nCsvBooks;
+		re.rcTotals.nLogBooks += rc.nLogBooks;
+		re.rcTotals.nMatched += rc.nMatched;
+		re.rcTotals.nCsvOnly += rc.nCsvOnly;
+		re.rcTotals.nLogOnly += rc.nLogOnly;
+
+		re.mapWindows.erase(it);
+	}
+}
+
+void OBReconcile::finish(ReconEntry& re) {
+
+	expire(re, true, LLONG_MAX, true);
+	expire(re, false, LLONG_MAX, true);
+	closeWindows(re, LLONG_MAX);
+
+	re.ossDiff << "Total: csv " << re.rcTotals.nCsvBooks << ", log " << re.rcTotals.nLogBooks << ", matched " << re.rcTotals.nMatched
+		<< ", csv only " << re.rcTotals.nCsvOnly << ", log only " << re.rcTotals.nLogOnly
+		<< ", malformed csv " << re.rsCsv.nMalformed + m_rfCsv.nMalformed << ", malformed log " << re.rsLog.nMalformed + m_rfLog.nMalformed << '\n';
+
+	writeDiff(re, ios::app);
+}
+
+void OBReconcile::writeDiff(ReconEntry& re, ios::openmode om) {
+
+	// Stub to allocate function name at compile time
+	static const string SZ_OBRECONCILE_WRITEDIFF = "writeDiff";
+
+	// The file is only open while its buffered lines are appended
+	ofstream ofs(re.szDiffFile, ios::out | om);
+	ofs << re.ossDiff.str();
+	if (!ofs) {
+		TracedException te(SZ_OBRECONCILE_EXCEPTION, SZ_EXCEPTION_NODIFF, SZ_OBRECONCILE_WRITEDIFF);
+		throw te;
+	}
+
+	re.ossDiff.str(string());
+}
+
+long long OBReconcile::windowOf(long long nTimeMs) const {
+
+	// Floor the window index so times before the epoch fall in their own windows
+	long long nWindow = nTimeMs / m_nWindowMs;
+	if (nTimeMs % m_nWindowMs < 0)
+		--nWindow;
+
+	return nWindow;
+}
+
+string OBReconcile::formatTime(long long nTimeMs) {
+
+	const long long nDayMs = 86400000LL;
+
+	long long nDays = nTimeMs / nDayMs;
+	if (nTimeMs % nDayMs < 0)
+		--nDays;
+	long long nMsOfDay = nTimeMs - nDays * nDayMs;
+
+	// Calendar date of a day count since 1970-01-01, the inverse of the feed time stamp conversion
+	nDays += 719468;
+	long long nEra = (nDays >= 0 ? nDays : nDays - 146096) / 146097;
+	long long nDayOfEra = nDays - nEra * 146097;
+	long long nYearOfEra = (nDayOfEra - nDayOfEra / 1460 + nDayOfEra / 36524 - nDayOfEra / 146096) / 365;
+	long long nDayOfYear = nDayOfEra - (365 * nYearOfEra + nYearOfEra / 4 - nYearOfEra / 100);
+	long long nMarchMonth = (5 * nDayOfYear + 2) / 153;
+
+	int nDay = static_cast<int>(nDayOfYear - (153 * nMarchMonth + 2) / 5 + 1);
+	int nMonth = static_cast<int>(nMarchMonth < 10 ? nMarchMonth + 3 : nMarchMonth - 9);
+	long long nYear = nYearOfEra + nEra * 400 + (nMonth <= 2 ? 1 : 0);
+
+	return (boost::format("%04d-%02d-%02d %02d:%02d:%02d.%03d") % nYear % nMonth % nDay
+		% (nMsOfDay / 3600000) % (nMsOfDay / 60000 % 60) % (nMsOfDay / 1000 % 60) % (nMsOfDay % 1000)).str();
+}
+
+void OBReconcile::formatBook(ostream& os, const BidAskLevels& bal) {
+
+	os << " bid";
+	for (const auto& pi : bal.vBidQty)
+		os << ' ' << pi.first << 'x' << pi.second;
+
+	os << " ask";
+	for (const auto& pi : bal.vAskQty)
+		os << ' ' << pi.first << 'x' << pi.second;
+}
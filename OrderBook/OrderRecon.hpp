@@ -0,0 +1,170 @@
+#pragma once
+
+#include <string>
+#include <deque>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <climits>
+#include <memory>
+#include <boost/shared_ptr.hpp>
+
+#include "TracedException.hpp"
+#include "OrderFeeds.hpp"
+
+class OBMappedFile;
+class OBCompressedFile;
+
+// Counts of the books reconciled over a time window or over the whole session feed
+struct ReconCounts
+{
+	int		nCsvBooks;		// Distinct books read from the csv feed
+	int		nLogBooks;		// Distinct books read from the log feed
+	int		nMatched;		// Books shown by both feeds within the tolerance
+	int		nCsvOnly;		// Csv books the log feed did not show within the tolerance
+	int		nLogOnly;		// Log books the csv feed did not show within the tolerance
+
+	ReconCounts() : nCsvBooks(0), nLogBooks(0), nMatched(0), nCsvOnly(0), nLogOnly(0) {}
+
+	bool diverged() const	{ return nCsvOnly != 0 || nLogOnly != 0; }
+};
+
+// Streaming merge join of the csv and log source feeds on their time stamps. Both feeds are read once in
+// time order; each distinct book is matched by an equal book of the other feed within the tolerance, and
+// reported as a divergence once the other feed has moved past it. Only the books inside the tolerance
+// are held, so memory does not grow with the length of the feed files.
+//
+// Feeds interleaving several instruments are reconciled in the same single pass: each row is routed by
+// its key to the instrument it shows, which holds its own pending books, windows and diff file, so the
+// cost does not grow with the number of instruments.
+class OBReconcile
+{
+public:
+	OBReconcile() = delete;
+	OBReconcile(const OBStream& obsCsv, const OBStream& obsLog, const string& szDiffFile);
+
+	// Largest time difference between matching books
+	void setTolerance(int nToleranceMs)			{ m_nToleranceMs = (nToleranceMs > 0) ? nToleranceMs : 0; }
+
+	// Shift added to log time stamps to bring them to the csv clock
+	void setLogOffset(int nOffsetMs)			{ m_nLogOffsetMs = nOffsetMs; }
+
+	// Length of the time windows divergences are summarised over
+	void setWindow(int nWindowMs)				{ m_nWindowMs = (nWindowMs > 0) ? nWindowMs : 1000; }
+
+	// Reconcile the configured instruments of feeds interleaving several instead of the whole feeds. Csv
+	// rows are routed by their RIC and log rows by their InstrumentId; rows of instruments not added
+	// are passed over.
+	void setInstruments(const boost::shared_ptr<const OBInstrumentMap>& pInstruments);
+
+	// Reconcile the rows of one configured instrument into its own diff file
+	void addInstrument(int iInstrument, const string& szDiffFile);
+
+	// Read both feeds and write the divergences of each time window to the diff files. Exceptions
+	// are caught and kept for CheckNotifyException.
+	void reconcile();
+
+	// Diff files written, the one of the whole feeds unless instruments are set
+	size_t size() const									{ return m_dqEntries.size(); }
+	const string& getDiffFile(size_t i = 0) const		{ return m_dqEntries[i].szDiffFile; }
+	const ReconCounts& getTotals(size_t i = 0) const	{ return m_dqEntries[i].rcTotals; }
+
+	bool IsCaughtException() const				{ return !m_eei.szDesc.empty(); }
+	void CheckNotifyException() const;
+
+private:
+	// A book waiting for its match in the other feed
+	struct PendingBook {
+		long long		nTimeMs;
+		BidAskLevels	bal;
+	};
+
+	// Books of one feed shown for one instrument
+	struct ReconSide {
+		OBStream::FeedSnapshot		fsLast;			// Last distinct book, the next one to take while its feed points at it
+		bool						bSeen;			// A book was read into fsLast
+		int							nMalformed;		// Rows of the instrument without a readable time stamp or book
+
+		deque<PendingBook>			dqPending;		// Books not matched yet, oldest first
+
+		ReconSide() : bSeen(false), nMalformed(0) {}
+	};
+
+	// Instrument reconciled into its own diff file, or the whole feeds
+	struct ReconEntry {
+		int							iInstrument;	// Configured instrument, NO_KEY for the whole feeds
+		string						szDiffFile;
+		ostringstream				ossDiff;		// Lines not appended to the diff file yet
+
+		ReconSide					rsCsv;
+		ReconSide					rsLog;
+
+		map<long long, ReconCounts>	mapWindows;		// Windows that may still count books, by window index
+		ReconCounts					rcTotals;
+
+		ReconEntry(int i, const string& sz) : iInstrument(i), szDiffFile(sz) {}
+
+		ReconSide& side(bool bCsv)					{ return bCsv ? rsCsv : rsLog; }
+	};
+
+	// Read position in one feed, holding its next distinct book
+	struct ReconFeed {
+		const OBStream&				obs;
+		const char*					pCur;
+		const char*					pEnd;
+		OBCompressedFile*			pInflated;		// Next blocks of a compressed feed, null when mapped
+		int							nHeaderLines;
+		int							nOffsetMs;
+		bool						bCsv;
+
+		OBStream::FeedSnapshot		fsRow;			// Row being read, swapped into its entry when its book differs
+		int							iNext;			// Entry of the next distinct book, NO_KEY at the end of the feed
+		long long					nNextMs;
+		long long					nLastMs;		// Time stamps never go back from this one
+		int							nMalformed;		// Rows naming no instrument, counted against every one
+
+		ReconFeed(const OBStream& o, bool b) : obs(o), pCur(nullptr), pEnd(nullptr), pInflated(nullptr), nHeaderLines(0), nOffsetMs(0), bCsv(b),
+			iNext(OBPerfectHash::NO_KEY), nNextMs(LLONG_MAX), nLastMs(LLONG_MIN), nMalformed(0) {}
+	};
+
+	void run();
+	static void openSource(ReconFeed& rf, std::unique_ptr<OBMappedFile>& pmf, std::unique_ptr<OBCompressedFile>& pcf);
+	void advance(ReconFeed& rf);
+	void take(ReconFeed& rf);
+	void settle(ReconEntry& re);
+	void expire(ReconEntry& re, bool bCsv, long long nFrontierMs, bool bAll);
+	void diverge(ReconEntry& re, bool bCsv, const PendingBook& pb);
+	void closeWindows(ReconEntry& re, long long nFrontierMs);
+	void finish(ReconEntry& re);
+	void writeDiff(ReconEntry& re, ios::openmode om);
+
+	long long windowOf(long long nTimeMs) const;
+	static string formatTime(long long nTimeMs);
+	static void formatBook(ostream& os, const BidAskLevels& bal);
+
+private:
+	ReconFeed				m_rfCsv;
+	ReconFeed				m_rfLog;
+
+	deque<ReconEntry>		m_dqEntries;	// Diff files written, in the order they were added
+	boost::shared_ptr<const OBInstrumentMap>	m_pInstruments;
+	vector<int>				m_viEntries;	// Entry of each configured instrument, NO_KEY when not added
+
+	int						m_nToleranceMs;
+	int						m_nLogOffsetMs;
+	int						m_nWindowMs;
+
+	long long				m_nSettledWindow;	// Window of the feeds when every entry was last settled
+
+	ErrorExceptionInfo		m_eei;
+
+	// Books held per feed and instrument once the other feed stalls, older ones are reported unmatched
+	static constexpr size_t MAX_PENDING_BOOKS = 1 << 16;
+
+	// Diff lines buffered per instrument before they are appended to its file, so no file stays open
+	static constexpr std::streamoff DIFF_FLUSH_BYTES = 1 << 16;
+
+	static constexpr auto SZ_OBRECONCILE_EXCEPTION = "OBReconcile Exception";
+	static constexpr auto SZ_EXCEPTION_NODIFF = "Cannot write the source feeds diff file";
+};
@@ -0,0 +1,360 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Machine readable formats of the order books report
+//==============================================================
+#include "pch.h"
+#include <iostream>
+#include <string>
+#include <fstream>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+using namespace std;
+
+#include "OrderReport.hpp"
+
+OBReportFile::OBReportFile(const string& szFile, bool bBinary) : m_szFile(szFile), m_szTempFile(szFile + ".tmp"), m_bCommitted(false) {
+
+	// Stub to allocate function name at compile time
+	static const string SZ_OBREPORTFILE_OBREPORTFILE = "OBReportFile";
+
+	m_ofs.open(m_szTempFile, bBinary ? (ios::out | ios::binary | ios::trunc) : (ios::out | ios::trunc));
+	if (!m_ofs)
+		throw TracedException(SZ_OBREPORTFILE_EXCEPTION, "Cannot create report file " + m_szTempFile, SZ_OBREPORTFILE_OBREPORTFILE);
+}
+
+OBReportFile::~OBReportFile() {
+
+	// A report that was not completed leaves no trace
+	if (!m_bCommitted) {
+		m_ofs.close();
+		std::remove(m_szTempFile.c_str());
+	}
+}
+
+void OBReportFile::commit() {
+
+	// Stub to allocate function name at compile time
+	static const string SZ_OBREPORTFILE_COMMIT = "commit";
+
+	m_ofs.close();
+	if (!m_ofs) {
+		std::remove(m_szTempFile.c_str());
+		m_bCommitted = true;
+		throw TracedException(SZ_OBREPORTFILE_EXCEPTION, "Cannot write report file " + m_szTempFile, SZ_OBREPORTFILE_COMMIT);
+	}
+
+#ifdef _WIN32
+	// Windows only replaces an existing file atomically when asked to
+	bool bRenamed = ::MoveFileExA(m_szTempFile.c_str(), m_szFile.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	bool bRenamed = std::rename(m_szTempFile.c_str(), m_szFile.c_str()) == 0;
+#endif
+	m_bCommitted = true;
+
+	if (!bRenamed) {
+		std::remove(m_szTempFile.c_str());
+		throw TracedException(SZ_OBREPORTFILE_EXCEPTION, "Cannot replace report file " + m_szFile, SZ_OBREPORTFILE_COMMIT);
+	}
+}
+
+//--------------------------------------------------------------
+// Json lines
+//--------------------------------------------------------------
+
+void OBJsonEmitter::writeString(ostream& os, const string& sz) {
+
+	os << '"';
+	for (char ch : sz) {
+		if (ch == '"' || ch == '\\')
+			os << '\\' << ch;
+		else if (static_cast<unsigned char>(ch) < 0x20)
+			os << ' ';
+		else
+			os << ch;
+	}
+	os << '"';
+}
+
+void OBJsonEmitter::writePairs(ostream& os, const vecPriceQty& vpi) {
+
+	os << '[';
+	for (size_t i = 0; i < vpi.size(); ++i)
+		os << (i > 0 ? ",[" : "[") << vpi[i].first << ',' << vpi[i].second << ']';
+	os << ']';
+}
+
+void OBJsonEmitter::writeDiffs(ostream& os, const vecPriceQty& vpi, bool bPriceDiffs) {
+
+	// Price differences carry a negated price, quantity differences the price as is
+	os << '[';
+	bool bFirst = true;
+	for (const auto& pi : vpi) {
+		if ((pi.first < OBPrice()) != bPriceDiffs)
+			continue;
+
+		os << (bFirst ? "[" : ",[") << (bPriceDiffs ? -pi.first : pi.first) << ',' << pi.second << ']';
+		bFirst = false;
+	}
+	os << ']';
+}
+
+void OBJsonEmitter::beginReport(const string& szHeader) {
+
+	ostream& os = m_rf.stream();
+	os << "{\"type\":\"report\",\"header\":";
+	writeString(os, szHeader);
+	os << ",\"price_decimals\":" << OB_PRICE_DECIMALS << "}\n";
+}
+
+void OBJsonEmitter::emitBook(REPORT_BOOK rb, const OrderBook& ob, int nMaxSpreads) {
+
+	ostream& os = m_rf.stream();
+	const OBBookEngine& obe = ob.bookEngine;
+	const BookChecks& bc = obe.getChecks();
+
+	os << "{\"type\":\"book\",\"feed\":\"" << getBookName(rb) << "\",\"source\":";
+	writeString(os, ob.szSourceFeed);
+	os << ",\"feeds\":" << ob.nBookFeeds << ",\"bid_levels\":" << ob.vecBidLevels.size() << ",\"ask_levels\":" << ob.vecAskLevels.size()
+		<< ",\"checks\":{\"unchanged\":" << bc.nUnchanged << ",\"crossed\":" << bc.nCrossed << ",\"locked\":" << bc.nLocked << ",\"one_sided\":" << bc.nOneSided
+		<< ",\"unordered\":" << bc.nUnordered << ",\"off_ladder\":" << bc.nOffLadder << ",\"bid_changes\":" << bc.nBidChanges << ",\"ask_changes\":" << bc.nAskChanges
+		<< "},\"skipped_rows\":" << ob.feedErrors.count() << ",\"best_bid\":";
+
+	if (obe.hasBid())
+		os << '[' << obe.bestBid() << ',' << obe.bestBidQty() << ']';
+	else
+		os << "null";
+
+	os << ",\"best_ask\":";
+	if (obe.hasAsk())
+		os << '[' << obe.bestAsk() << ',' << obe.bestAskQty() << ']';
+	else
+		os << "null";
+	os << "}\n";
+
+	// The analytics follow their book, spreads and prices in units of the last price decimal
+	const BookAnalytics& ba = ob.analytics;
+	os << "{\"type\":\"analytics\",\"feed\":\"" << getBookName(rb) << "\",\"tick\":" << ba.getTick() << ",\"books\":" << ba.getBooks()
+		<< ",\"crossed\":" << ba.getCrossed() << ",\"min_spread\":" << ba.getMinSpread() << ",\"max_spread\":" << ba.getMaxSpread()
+		<< ",\"mean_spread\":" << ba.getMeanSpread() << ",\"time_weighted_spread\":" << ba.getTimeWeightedSpread() << ",\"spread_ms\":" << ba.getSpreadMs()
+		<< ",\"last_mid\":" << ba.getLastMid() << ",\"last_micro\":" << ba.getLastMicro() << ",\"spread_bins\":[";
+	for (int i = 0; i < BookAnalytics::SPREAD_BINS; ++i)
+		os << (i > 0 ? "," : "") << ba.getSpreadBins()[i];
+
+	os << "],\"imbalance\":[";
+	for (size_t i = 0; i < ba.getImbalance().size(); ++i)
+		os << (i > 0 ? "," : "") << ba.getImbalance()[i].mean();
+
+	// Series points as time stamp, books, mean mid and mean microprice, empty spans left out
+	os << "],\"series_ms\":" << ba.getSeriesWidthMs() << ",\"series\":[";
+	bool bFirst = true;
+	for (const auto& sp : ba.getSeries()) {
+		if (sp.nBooks == 0)
+			continue;
+
+		os << (bFirst ? "[" : ",[") << sp.nTimeMs << ',' << sp.nBooks << ',' << sp.mid() << ',' << sp.micro() << ']';
+		bFirst = false;
+	}
+	os << "]}\n";
+
+	// The best spreads follow their book, tightest first
+	int nRank = 0;
+	for (const auto& bs : ob.bestSpreads) {
+
+		if (nRank++ == nMaxSpreads)
+			break;
+
+		os << "{\"type\":\"spread\",\"feed\":\"" << getBookName(rb) << "\",\"rank\":" << nRank << ",\"spread\":" << bs.prSpread
+			<< ",\"bid_price\":" << bs.prBidPrice << ",\"mid\":" << OBPrice::midpoint(bs.prBidPrice, bs.prBidPrice + bs.prSpread) << ",\"bids\":";
+		writePairs(os, bs.bal.vBidQty);
+		os << ",\"asks\":";
+		writePairs(os, bs.bal.vAskQty);
+		os << "}\n";
+	}
+}
+
+void OBJsonEmitter::beginLevels(REPORT_SIDE rs, size_t nLevels) {
+
+	m_rf.stream() << "{\"type\":\"levels\",\"side\":\"" << getSideName(rs) << "\",\"levels\":" << nLevels << "}\n";
+}
+
+void OBJsonEmitter::emitLevelDiff(const LevelDiff& ld) {
+
+	ostream& os = m_rf.stream();
+	os << "{\"type\":\"level\",\"side\":\"" << getSideName(ld.rs) << "\",\"level\":" << ld.iLevel + 1
+		<< ",\"csv\":" << (ld.bCsvLevel ? "true" : "false") << ",\"log\":" << (ld.bLogLevel ? "true" : "false") << ",\"csv_prices\":";
+	writeDiffs(os, ld.vpiCsv, true);
+	os << ",\"csv_qtys\":";
+	writeDiffs(os, ld.vpiCsv, false);
+	os << ",\"log_prices\":";
+	writeDiffs(os, ld.vpiLog, true);
+	os << ",\"log_qtys\":";
+	writeDiffs(os, ld.vpiLog, false);
+	os << "}\n";
+}
+
+void OBJsonEmitter::endReport() {
+
+	m_nBytes = static_cast<uint64_t>(m_rf.stream().tellp());
+	m_rf.commit();
+}
+
+//--------------------------------------------------------------
+// Binary
+//--------------------------------------------------------------
+
+void OBBinaryEmitter::putName(const string& sz) {
+
+	put(static_cast<uint32_t>(sz.size()));
+	m_szRecord.append(sz);
+}
+
+void OBBinaryEmitter::putPairs(const vecPriceQty& vpi) {
+
+	put(static_cast<uint32_t>(vpi.size()));
+	for (const auto& pi : vpi) {
+		put(static_cast<int32_t>(pi.first.units()));
+		put(static_cast<int32_t>(pi.second));
+	}
+}
+
+void OBBinaryEmitter::putDiffs(const vecPriceQty& vpi, bool bPriceDiffs) {
+
+	// Price differences carry a negated price, quantity differences the price as is
+	size_t nCountPos = m_szRecord.size();
+	put(static_cast<uint32_t>(0));
+
+	uint32_t nPairs = 0;
+	for (const auto& pi : vpi) {
+		if ((pi.first < OBPrice()) != bPriceDiffs)
+			continue;
+
+		put(static_cast<int32_t>(bPriceDiffs ? -pi.first.units() : pi.first.units()));
+		put(static_cast<int32_t>(pi.second));
+		nPairs++;
+	}
+	m_szRecord.replace(nCountPos, sizeof(nPairs), reinterpret_cast<const char*>(&nPairs), sizeof(nPairs));
+}
+
+void OBBinaryEmitter::flush(RECORD_TYPE rt) {
+
+	ofstream& ofs = m_rf.stream();
+	uint32_t nBody = static_cast<uint32_t>(m_szRecord.size());
+
+	ofs.put(static_cast<char>(rt));
+	ofs.write(reinterpret_cast<const char*>(&nBody), sizeof(nBody));
+	ofs.write(m_szRecord.data(), m_szRecord.size());
+
+	m_nBytes += 1 + sizeof(nBody) + m_szRecord.size();
+	m_szRecord.clear();
+}
+
+void OBBinaryEmitter::beginReport(const string& szHeader) {
+
+	m_szRecord.append("OBRP", 4);
+	put(FORMAT_VERSION);
+	put(BYTE_ORDER_MARK);
+	put(static_cast<int32_t>(OB_PRICE_DECIMALS));
+	putName(szHeader);
+
+	m_rf.stream().write(m_szRecord.data(), m_szRecord.size());
+	m_nBytes += m_szRecord.size();
+	m_szRecord.clear();
+}
+
+void OBBinaryEmitter::emitBook(REPORT_BOOK rb, const OrderBook& ob, int nMaxSpreads) {
+
+	const OBBookEngine& obe = ob.bookEngine;
+	const BookChecks& bc = obe.getChecks();
+
+	put(static_cast<uint8_t>(rb));
+	putName(ob.szSourceFeed);
+	put(static_cast<uint64_t>(ob.nBookFeeds));
+	put(static_cast<uint32_t>(ob.vecBidLevels.size()));
+	put(static_cast<uint32_t>(ob.vecAskLevels.size()));
+
+	for (int n : { bc.nUnchanged, bc.nCrossed, bc.nLocked, bc.nOneSided, bc.nUnordered, bc.nOffLadder, bc.nBidChanges, bc.nAskChanges })
+		put(static_cast<uint64_t>(n));
+
+	put(static_cast<uint64_t>(ob.feedErrors.count()));
+	put(static_cast<int32_t>(obe.hasBid() ? obe.bestBid().units() : 0));
+	put(static_cast<int32_t>(obe.hasBid() ? obe.bestBidQty() : 0));
+	put(static_cast<int32_t>(obe.hasAsk() ? obe.bestAsk().units() : 0));
+	put(static_cast<int32_t>(obe.hasAsk() ? obe.bestAskQty() : 0));
+	put(static_cast<uint8_t>((obe.hasBid() ? 1 : 0) | (obe.hasAsk() ? 2 : 0)));
+	flush(RECORD_BOOK);
+
+	const BookAnalytics& ba = ob.analytics;
+	put(static_cast<uint8_t>(rb));
+	put(static_cast<int32_t>(ba.getTick()));
+	put(ba.getBooks());
+	put(ba.getCrossed());
+	put(ba.getMinSpread());
+	put(ba.getMaxSpread());
+	put(ba.getMeanSpread());
+	put(ba.getTimeWeightedSpread());
+	put(static_cast<int64_t>(ba.getSpreadMs()));
+	put(ba.getLastMid());
+	put(ba.getLastMicro());
+	for (int i = 0; i < BookAnalytics::SPREAD_BINS; ++i)
+		put(ba.getSpreadBins()[i]);
+
+	put(static_cast<uint32_t>(ba.getImbalance().size()));
+	for (const auto& li : ba.getImbalance())
+		put(li.mean());
+
+	size_t nCountPos = m_szRecord.size();
+	put(static_cast<int64_t>(ba.getSeriesWidthMs()));
+	put(static_cast<uint32_t>(0));
+
+	uint32_t nPoints = 0;
+	for (const auto& sp : ba.getSeries()) {
+		if (sp.nBooks == 0)
+			continue;
+
+		put(static_cast<int64_t>(sp.nTimeMs));
+		put(sp.nBooks);
+		put(sp.mid());
+		put(sp.micro());
+		nPoints++;
+	}
+	m_szRecord.replace(nCountPos + sizeof(int64_t), sizeof(nPoints), reinterpret_cast<const char*>(&nPoints), sizeof(nPoints));
+	flush(RECORD_ANALYTICS);
+
+	// The best spreads follow their book, tightest first
+	uint32_t nRank = 0;
+	for (const auto& bs : ob.bestSpreads) {
+
+		if (static_cast<int>(nRank++) == nMaxSpreads)
+			break;
+
+		put(static_cast<uint8_t>(rb));
+		put(nRank);
+		put(static_cast<int32_t>(bs.prSpread.units()));
+		put(static_cast<int32_t>(bs.prBidPrice.units()));
+		putPairs(bs.bal.vBidQty);
+		putPairs(bs.bal.vAskQty);
+		flush(RECORD_SPREAD);
+	}
+}
+
+void OBBinaryEmitter::emitLevelDiff(const LevelDiff& ld) {
+
+	put(static_cast<uint8_t>(ld.rs));
+	put(static_cast<uint32_t>(ld.iLevel + 1));
+	put(static_cast<uint8_t>((ld.bCsvLevel ? 1 : 0) | (ld.bLogLevel ? 2 : 0)));
+	putDiffs(ld.vpiCsv, true);
+	putDiffs(ld.vpiCsv, false);
+	putDiffs(ld.vpiLog, true);
+	putDiffs(ld.vpiLog, false);
+	flush(RECORD_LEVEL);
+}
+
+void OBBinaryEmitter::endReport() {
+
+	m_rf.commit();
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <cstdint>
+
+#include "TracedException.hpp"
+#include "OrderBook.hpp"
+
+// Feeds and book sides of the report records
+enum REPORT_BOOK { REPORT_CSV = 0, REPORT_LOG };
+enum REPORT_SIDE { REPORT_BID = 0, REPORT_ASK };
+
+// Price/quantity pairs one feed saw at a book level and the other did not. A pair whose price the
+// other feed never showed at that level is kept with its price negated, the others differ by quantity.
+// A level only one feed reached is compared with an empty one, so all its pairs differ by price.
+struct LevelDiff
+{
+	REPORT_SIDE		rs;
+	size_t			iLevel;
+	bool			bCsvLevel;		// Whether each feed reached this level
+	bool			bLogLevel;
+	vecPriceQty		vpiCsv;
+	vecPriceQty		vpiLog;
+
+	LevelDiff() : rs(REPORT_BID), iLevel(0), bCsvLevel(false), bLogLevel(false) {}
+};
+
+// Report file written under a temporary name and renamed over the report once complete, so a failed
+// run leaves the previous report in place rather than a half written one.
+class OBReportFile
+{
+public:
+	OBReportFile() = delete;
+	explicit OBReportFile(const string& szFile, bool bBinary = false);
+	~OBReportFile();
+
+	ofstream& stream()						{ return m_ofs; }
+	const string& getFile() const			{ return m_szFile; }
+
+	// Close the temporary file and rename it over the report
+	void commit();
+
+private:
+	string		m_szFile;
+	string		m_szTempFile;
+	ofstream	m_ofs;
+	bool		m_bCommitted;
+
+	static constexpr auto SZ_OBREPORTFILE_EXCEPTION = "OBReportFile Exception";
+};
+
+// Receives the report a record at a time in report order: the heading, the book of each feed with its
+// best spreads, then the level differences of the bid side and of the ask side. Every format of the
+// report is an emitter, the books are read and the levels compared once whatever the formats asked for.
+class OBReportEmitter
+{
+public:
+	virtual ~OBReportEmitter() {}
+
+	virtual void beginReport(const string& szHeader) = 0;
+	virtual void emitBook(REPORT_BOOK rb, const OrderBook& ob, int nMaxSpreads) = 0;
+	virtual void beginLevels(REPORT_SIDE rs, size_t nLevels) = 0;
+	virtual void emitLevelDiff(const LevelDiff& ld) = 0;
+	virtual void endReport() = 0;
+
+	virtual const string& getFile() const = 0;
+	virtual uint64_t getBytes() const = 0;
+
+	static const char* getBookName(REPORT_BOOK rb)		{ return (rb == REPORT_CSV) ? "csv" : "log"; }
+	static const char* getSideName(REPORT_SIDE rs)		{ return (rs == REPORT_BID) ? "bid" : "ask"; }
+};
+
+// One json object per line, each with a "type" of report, book, analytics, spread or level. Prices are
+// json numbers with the decimals of the feeds, the analytics count them in units of the last decimal. A level lists, for each feed, the pairs whose price the other
+// feed never showed at that level and the pairs at a shared price whose quantity it never showed.
+class OBJsonEmitter : public OBReportEmitter
+{
+public:
+	explicit OBJsonEmitter(const string& szFile) : m_rf(szFile), m_nBytes(0) {}
+
+	void beginReport(const string& szHeader) override;
+	void emitBook(REPORT_BOOK rb, const OrderBook& ob, int nMaxSpreads) override;
+	void beginLevels(REPORT_SIDE rs, size_t nLevels) override;
+	void emitLevelDiff(const LevelDiff& ld) override;
+	void endReport() override;
+
+	const string& getFile() const override		{ return m_rf.getFile(); }
+	uint64_t getBytes() const override			{ return m_nBytes; }
+
+private:
+	static void writeString(ostream& os, const string& sz);
+	static void writePairs(ostream& os, const vecPriceQty& vpi);
+	static void writeDiffs(ostream& os, const vecPriceQty& vpi, bool bPriceDiffs);
+
+private:
+	OBReportFile	m_rf;
+	uint64_t		m_nBytes;
+};
+
+// Fixed width records in native layout, read back with plain copies. The file starts with the magic
+// "OBRP", the format version, a byte order marker, the decimals of the prices and the report heading as
+// a name, as the html and json reports head theirs. Each record is a type byte and the byte count of its
+// body, so a reader can skip the records it does not know:
+//   book:   feed byte, name, feeds, bid and ask levels, the 8 book checks, skipped rows, last best bid
+//           and ask as price units and quantity, and a byte flagging which of the two are set
+//   analytics: feed byte, tick, two-sided and crossed books, min and max spread units, mean and time
+//           weighted spread, the milliseconds the spreads held, last mid and microprice, the 32 spread
+//           bins, a 32 bit count of mean level imbalances then each, the series width in milliseconds and a 32 bit
+//           count of series points, each a time stamp, its books, mean mid and mean microprice
+//   spread: feed byte, rank, spread and bid price units, then the bid and ask pairs
+//   level:  side byte, level, a byte flagging the feeds that reached the level, then the csv price,
+//           csv quantity, log price and log quantity differences
+// Names are a 32 bit length and the bytes, pairs a 32 bit count and the price units and quantity of
+// each as 32 bit integers. The analytics counts are 64 bit integers and their means doubles in price units.
+class OBBinaryEmitter : public OBReportEmitter
+{
+public:
+	enum RECORD_TYPE : uint8_t { RECORD_BOOK = 1, RECORD_SPREAD, RECORD_LEVEL, RECORD_ANALYTICS };
+
+	static constexpr uint32_t FORMAT_VERSION = 2;
+	static constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+	explicit OBBinaryEmitter(const string& szFile) : m_rf(szFile, true), m_nBytes(0) {}
+
+	void beginReport(const string& szHeader) override;
+	void emitBook(REPORT_BOOK rb, const OrderBook& ob, int nMaxSpreads) override;
+	void beginLevels(REPORT_SIDE, size_t) override {}
+	void emitLevelDiff(const LevelDiff& ld) override;
+	void endReport() override;
+
+	const string& getFile() const override		{ return m_rf.getFile(); }
+	uint64_t getBytes() const override			{ return m_nBytes; }
+
+private:
+	template <typename T> void put(T t)			{ m_szRecord.append(reinterpret_cast<const char*>(&t), sizeof(T)); }
+	void putName(const string& sz);
+	void putPairs(const vecPriceQty& vpi);
+	void putDiffs(const vecPriceQty& vpi, bool bPriceDiffs);
+
+	// Write the record built so far behind its type and length
+	void flush(RECORD_TYPE rt);
+
+private:
+	OBReportFile	m_rf;
+	string			m_szRecord;
+	uint64_t		m_nBytes;
+};
@@ -0,0 +1,138 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Vectorized delimiter scanning of the source feed rows
+//==============================================================
+#include "pch.h"
+#include <cstring>
+
+// SSE2 is always there on x64, and on 32 bit x86 builds of Visual C++ or of gcc asked for it
+#if defined(__x86_64__) || defined(_M_X64) || defined(_M_IX86) || (defined(__i386__) && defined(__SSE2__))
+#define OBSCAN_X86
+#include <immintrin.h>
+#endif
+
+// Gcc and clang only emit AVX2 code in functions asking for it, Visual C++ emits it anywhere
+#if defined(OBSCAN_X86) && !defined(_MSC_VER)
+#define OBSCAN_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define OBSCAN_TARGET_AVX2
+#endif
+
+using namespace std;
+
+#include "OrderScan.hpp"
+
+OBDelimScan::SCAN_ISA OBDelimScan::s_si = OBDelimScan::detectIsa();
+
+namespace {
+
+	uint64_t indexScalar(const char* p, size_t nBytes, const DelimSet& ds) {
+
+		uint64_t nBits = 0;
+		for (size_t i = 0; i < nBytes; ++i) {
+			char ch = p[i];
+			if (ch == ds.chDelims[0] || ch == ds.chDelims[1] || ch == ds.chDelims[2] || ch == ds.chDelims[3])
+				nBits |= static_cast<uint64_t>(1) << i;
+		}
+
+		return nBits;
+	}
+
+#ifdef OBSCAN_X86
+	// Matching all four slots of the set matches any number of delimiters
+	uint32_t matchSSE2(const char* p, const DelimSet& ds) {
+
+		__m128i vBytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		__m128i vMatch = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(vBytes, _mm_set1_epi8(ds.chDelims[0])), _mm_cmpeq_epi8(vBytes, _mm_set1_epi8(ds.chDelims[1]))),
+			_mm_or_si128(_mm_cmpeq_epi8(vBytes, _mm_set1_epi8(ds.chDelims[2])), _mm_cmpeq_epi8(vBytes, _mm_set1_epi8(ds.chDelims[3]))));
+
+		return static_cast<uint32_t>(_mm_movemask_epi8(vMatch)) & 0xFFFF;
+	}
+
+	uint64_t indexSSE2(const char* p, const DelimSet& ds) {
+		return static_cast<uint64_t>(matchSSE2(p, ds)) | (static_cast<uint64_t>(matchSSE2(p + 16, ds)) << 16) |
+			(static_cast<uint64_t>(matchSSE2(p + 32, ds)) << 32) | (static_cast<uint64_t>(matchSSE2(p + 48, ds)) << 48);
+	}
+
+	OBSCAN_TARGET_AVX2 uint32_t matchAVX2(const char* p, const DelimSet& ds) {
+
+		__m256i vBytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+		__m256i vMatch = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(vBytes, _mm256_set1_epi8(ds.chDelims[0])), _mm256_cmpeq_epi8(vBytes, _mm256_set1_epi8(ds.chDelims[1]))),
+			_mm256_or_si256(_mm256_cmpeq_epi8(vBytes, _mm256_set1_epi8(ds.chDelims[2])), _mm256_cmpeq_epi8(vBytes, _mm256_set1_epi8(ds.chDelims[3]))));
+
+		return static_cast<uint32_t>(_mm256_movemask_epi8(vMatch));
+	}
+
+	OBSCAN_TARGET_AVX2 uint64_t indexAVX2(const char* p, const DelimSet& ds) {
+		return static_cast<uint64_t>(matchAVX2(p, ds)) | (static_cast<uint64_t>(matchAVX2(p + 32, ds)) << 32);
+	}
+#endif
+}
+
+uint64_t OBDelimScan::indexBytes(const char* p, size_t nBytes, const DelimSet& ds, SCAN_ISA si) {
+
+#ifdef OBSCAN_X86
+	if (si != SCAN_SCALAR) {
+
+		// The last block of a row is copied out so the vector loads never read past the row,
+		// which may end on the last page of a mapped file. Bits of the padding are dropped.
+		const char* pBlock = p;
+		char chPadded[BLOCK_BYTES];
+		if (nBytes < BLOCK_BYTES) {
+			memset(chPadded, 0, BLOCK_BYTES);
+			memcpy(chPadded, p, nBytes);
+			pBlock = chPadded;
+		}
+
+		uint64_t nBits = (si == SCAN_AVX2) ? indexAVX2(pBlock, ds) : indexSSE2(pBlock, ds);
+		return (nBytes < BLOCK_BYTES) ? nBits & ((static_cast<uint64_t>(1) << nBytes) - 1) : nBits;
+	}
+#endif
+
+	return indexScalar(p, nBytes, ds);
+}
+
+OBDelimScan::SCAN_ISA OBDelimScan::detectIsa() {
+
+#ifdef OBSCAN_X86
+#ifdef _MSC_VER
+	// AVX2 needs the processor feature and the OS saving the wide registers on context switches
+	int nInfo[4];
+	__cpuid(nInfo, 0);
+	if (nInfo[0] >= 7) {
+		__cpuid(nInfo, 1);
+		bool bOsSaves = (nInfo[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+
+		__cpuidex(nInfo, 7, 0);
+		if (bOsSaves && (nInfo[1] & (1 << 5)) != 0)
+			return SCAN_AVX2;
+	}
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return SCAN_AVX2;
+#endif
+	return SCAN_SSE2;
+#else
+	return SCAN_SCALAR;
+#endif
+}
+
+OBDelimScan::SCAN_ISA OBDelimScan::selectIsa(SCAN_ISA si) {
+
+	SCAN_ISA siBest = detectIsa();
+	s_si = (si < siBest) ? si : siBest;
+	return s_si;
+}
+
+const char* OBDelimScan::getIsaName(SCAN_ISA si) {
+
+	switch (si) {
+	case SCAN_AVX2:	return "avx2";
+	case SCAN_SSE2:	return "sse2";
+	default:		return "scalar";
+	}
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Delimiter bytes looked for by a scan, at most four of them
+struct DelimSet
+{
+	char	chDelims[4];	// Unused slots repeat a delimiter
+
+	explicit DelimSet(char ch0)					: chDelims{ ch0, ch0, ch0, ch0 } {}
+	DelimSet(char ch0, char ch1)				: chDelims{ ch0, ch1, ch1, ch1 } {}
+	DelimSet(char ch0, char ch1, char ch2)		: chDelims{ ch0, ch1, ch2, ch2 } {}
+};
+
+// Forward scan over the delimiters of a feed row. The row is indexed 64 bytes at a time into a bitmap
+// with one bit per delimiter byte, and delimiters are then handed out from the bitmap, so the bytes
+// between them are never looked at one by one. The bitmap is built with the widest vector instructions
+// the processor supports, picked once at start up; every kind gives the same bitmap.
+class OBDelimScan
+{
+public:
+	// Instruction sets a block can be indexed with
+	enum SCAN_ISA {
+		SCAN_SCALAR = 0,	// Portable byte loop
+		SCAN_SSE2,			// 16 byte compares
+		SCAN_AVX2			// 32 byte compares
+	};
+
+	OBDelimScan(const char* pBeg, const char* pEnd, const DelimSet& ds) : m_pBlock(pBeg), m_pEnd(pEnd), m_nBits(0), m_ds(ds) {
+		if (m_pBlock != m_pEnd)
+			m_nBits = indexBlock(m_pBlock);
+	}
+
+	// Next delimiter of the row, nullptr past the last one
+	const char* next() {
+		while (m_nBits == 0) {
+			m_pBlock += BLOCK_BYTES;
+			if (m_pBlock >= m_pEnd)
+				return nullptr;
+			m_nBits = indexBlock(m_pBlock);
+		}
+
+		const char* p = m_pBlock + countTrailingZeros(m_nBits);
+		m_nBits &= m_nBits - 1;
+		return p;
+	}
+
+	// Next delimiter equal to ch, passing over the other delimiters of the set
+	const char* next(char ch) {
+		const char* p;
+		while ((p = next()) != nullptr && *p != ch) {}
+		return p;
+	}
+
+	// Bitmap of the delimiters among the nBytes at p, bit i standing for p[i]
+	static uint64_t indexBytes(const char* p, size_t nBytes, const DelimSet& ds, SCAN_ISA si);
+
+	// Use another instruction set than the detected one, falling back to the best supported one below it
+	static SCAN_ISA selectIsa(SCAN_ISA si);
+	static SCAN_ISA getIsa()					{ return s_si; }
+	static SCAN_ISA detectIsa();
+	static const char* getIsaName(SCAN_ISA si);
+
+	static constexpr size_t BLOCK_BYTES = 64;
+
+private:
+	uint64_t indexBlock(const char* p) const {
+		return indexBytes(p, static_cast<size_t>(m_pEnd - p) < BLOCK_BYTES ? static_cast<size_t>(m_pEnd - p) : BLOCK_BYTES, m_ds, s_si);
+	}
+
+	static int countTrailingZeros(uint64_t n) {
+#if defined(_MSC_VER) && defined(_M_X64)
+		unsigned long nIndex;
+		_BitScanForward64(&nIndex, n);
+		return static_cast<int>(nIndex);
+#elif defined(_MSC_VER)
+		unsigned long nIndex;
+		if (_BitScanForward(&nIndex, static_cast<unsigned long>(n)))
+			return static_cast<int>(nIndex);
+		_BitScanForward(&nIndex, static_cast<unsigned long>(n >> 32));
+		return static_cast<int>(nIndex) + 32;
+#else
+		return __builtin_ctzll(n);
+#endif
+	}
+
+private:
+	const char*		m_pBlock;		// First byte of the block being walked
+	const char*		m_pEnd;
+	uint64_t		m_nBits;		// Delimiters of the block not handed out yet
+	const DelimSet&	m_ds;
+
+	static SCAN_ISA	s_si;
+};
@@ -0,0 +1,103 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Instruments of the source feeds and their perfect hash lookup
+//==============================================================
+#include "pch.h"
+#include <string>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+#include "OrderShard.hpp"
+
+void OBPerfectHash::build(const vector<string>& vKeys) {
+
+	// Stub to allocate function name at compile time
+	static const string SZ_OBPERFECTHASH_BUILD = "build";
+
+	m_vKeys = vKeys;
+	m_vSeeds.clear();
+	m_vSlots.clear();
+	m_nMask = 0;
+
+	if (m_vKeys.empty())
+		return;
+
+	// Equal keys would fight over one slot forever
+	vector<string> vSorted(m_vKeys);
+	std::sort(vSorted.begin(), vSorted.end());
+	auto itDup = std::adjacent_find(vSorted.begin(), vSorted.end(), [](const string& a, const string& b) { return a == b && !a.empty(); });
+	if (itDup != vSorted.end())
+		throw TracedException(SZ_OBPERFECTHASH_EXCEPTION, "Key " + *itDup + " is given twice", SZ_OBPERFECTHASH_BUILD);
+
+	// Slots are kept at most half full, so the last buckets still find free slots quickly
+	size_t nSlots = 1;
+	while (nSlots < m_vKeys.size() * 2)
+		nSlots *= 2;
+
+	m_nMask = nSlots - 1;
+	m_vSlots.assign(nSlots, NO_KEY);
+	m_vSeeds.assign((m_vKeys.size() + 3) / 4, 0);
+
+	vector<uint64_t> vHashes(m_vKeys.size());
+	vector<vector<int>> vBuckets(m_vSeeds.size());
+	for (size_t i = 0; i < m_vKeys.size(); ++i) {
+
+		// An empty key is not indexed and never found
+		if (m_vKeys[i].empty())
+			continue;
+
+		vHashes[i] = BookSideMemo::hashField(m_vKeys[i]);
+		vBuckets[vHashes[i] % vBuckets.size()].push_back(static_cast<int>(i));
+	}
+
+	// Place the largest buckets first, while most slots are free
+	vector<size_t> vOrder(vBuckets.size());
+	for (size_t i = 0; i < vOrder.size(); ++i)
+		vOrder[i] = i;
+	std::stable_sort(vOrder.begin(), vOrder.end(), [&vBuckets](size_t a, size_t b) { return vBuckets[a].size() > vBuckets[b].size(); });
+
+	vector<size_t> vPlaced;
+	for (size_t iBucket : vOrder) {
+
+		const vector<int>& vBucket = vBuckets[iBucket];
+		if (vBucket.empty())
+			continue;
+
+		uint32_t nSeed = 0;
+		for (;; ++nSeed) {
+			if (nSeed == MAX_SEEDS)
+				throw TracedException(SZ_OBPERFECTHASH_EXCEPTION, "Cannot place key " + m_vKeys[vBucket.front()], SZ_OBPERFECTHASH_BUILD);
+
+			// Every key of the bucket needs a free slot of its own
+			vPlaced.clear();
+			for (int iKey : vBucket) {
+				size_t nSlot = slotOf(vHashes[iKey], nSeed);
+				if (m_vSlots[nSlot] != NO_KEY || std::find(vPlaced.begin(), vPlaced.end(), nSlot) != vPlaced.end())
+					break;
+				vPlaced.push_back(nSlot);
+			}
+
+			if (vPlaced.size() == vBucket.size())
+				break;
+		}
+
+		m_vSeeds[iBucket] = nSeed;
+		for (size_t i = 0; i < vBucket.size(); ++i)
+			m_vSlots[vPlaced[i]] = vBucket[i];
+	}
+}
+
+void OBInstrumentMap::build() {
+
+	vector<string> vRics, vIds;
+	for (const auto& in : m_vInstruments) {
+		vRics.push_back(in.szRic);
+		vIds.push_back(in.szId);
+	}
+
+	m_phRic.build(vRics);
+	m_phId.build(vIds);
+}
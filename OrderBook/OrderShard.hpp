@@ -0,0 +1,94 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <boost/shared_ptr.hpp>
+
+#include "TracedException.hpp"
+#include "OrderBook.hpp"
+
+// Perfect hash of a set of keys fixed once built, by hash and displace: keys are grouped in buckets by
+// a first hash, then each bucket, largest first, is given the seed that sends all its keys to free
+// slots. A lookup hashes its key once and compares it with the one key its slot can hold.
+class OBPerfectHash
+{
+public:
+	static constexpr int NO_KEY = -1;
+
+	OBPerfectHash() : m_nMask(0) {}
+
+	// Index the keys by their position in the vector, which must not hold a key twice. Empty keys are left out.
+	void build(const vector<string>& vKeys);
+
+	// Position of a key in the vector it was built from, or NO_KEY
+	int find(const string_view& svKey) const {
+		if (m_vKeys.empty())
+			return NO_KEY;
+
+		uint64_t nHash = BookSideMemo::hashField(svKey);
+		int iKey = m_vSlots[slotOf(nHash, m_vSeeds[nHash % m_vSeeds.size()])];
+		return (iKey != NO_KEY && m_vKeys[iKey] == svKey) ? iKey : NO_KEY;
+	}
+
+	size_t size() const					{ return m_vKeys.size(); }
+
+private:
+	size_t slotOf(uint64_t nHash, uint32_t nSeed) const {
+		uint64_t n = nHash ^ (nSeed * 0x9e3779b97f4a7c15ULL);
+		n ^= n >> 33;
+		n *= 0xff51afd7ed558ccdULL;
+		n ^= n >> 33;
+		return static_cast<size_t>(n) & m_nMask;
+	}
+
+private:
+	vector<string>		m_vKeys;
+	vector<uint32_t>	m_vSeeds;		// Displacement seed of each bucket
+	vector<int>			m_vSlots;		// Key held by each slot, NO_KEY when free
+	size_t				m_nMask;
+
+	// Seeds tried for a bucket before the keys are deemed impossible to place
+	static constexpr uint32_t MAX_SEEDS = 1 << 20;
+
+	static constexpr auto SZ_OBPERFECTHASH_EXCEPTION = "OBPerfectHash Exception";
+};
+
+// Instruments interleaved in the source feeds. The csv feed names an instrument by its RIC and the log
+// feed by its InstrumentId, so both keys are configured to pair the books of the two feeds.
+class OBInstrumentMap
+{
+public:
+	struct Instrument {
+		string	szName;		// Name given to the reports of the instrument
+		string	szRic;		// Key of the csv rows
+		string	szId;		// Key of the log rows
+	};
+
+	void add(const Instrument& in)		{ m_vInstruments.push_back(in); }
+
+	// Index both keys once every instrument is added
+	void build();
+
+	// Instrument of a csv or log row key, or OBPerfectHash::NO_KEY
+	int findRic(const string_view& svRic) const		{ return m_phRic.find(svRic); }
+	int findId(const string_view& svId) const		{ return m_phId.find(svId); }
+
+	const Instrument& at(int i) const				{ return m_vInstruments[i]; }
+	size_t size() const								{ return m_vInstruments.size(); }
+
+private:
+	vector<Instrument>	m_vInstruments;
+	OBPerfectHash		m_phRic;
+	OBPerfectHash		m_phId;
+};
+
+// Order book of the rows of one instrument of a source feed
+struct FeedShard
+{
+	string							szKey;			// RIC or InstrumentId of the rows
+	int								iInstrument;	// Configured instrument, NO_KEY when not configured
+	int								iWorker;		// Thread applying the rows of the shard
+	boost::shared_ptr<OrderBook>	pBook;
+};
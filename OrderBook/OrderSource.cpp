@@ -0,0 +1,632 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Memory mapped access to the source feed files
+// Added tailing of source feed files still being written
+// Added file modification times for the order book cache
+// Added streaming inflation of compressed source feed files
+//==============================================================
+#include "pch.h"
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <boost/thread.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+#ifdef OB_GZIP
+#include <zlib.h>
+#endif
+
+#ifdef OB_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace std;
+
+#include "OrderSource.hpp"
+
+OBMappedFile::OBMappedFile(const string& szFile) : m_pData(nullptr), m_nSize(0), m_nModified(0) {
+
+	// Stub to allocate function name at compile time
+	static const string SZ_OBMAPPEDFILE_CONSTRUCTOR = "OBMappedFile::OBMappedFile";
+
+#ifdef _WIN32
+	m_hMapping = nullptr;
+
+	// Sequential scan is the Windows equivalent of the madvise hint below
+	m_hFile = ::CreateFileA(szFile.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (m_hFile == INVALID_HANDLE_VALUE) {
+		TracedException te(SZ_OBMAPPEDFILE_EXCEPTION, SZ_EXCEPTION_NOMAPPING, SZ_OBMAPPEDFILE_CONSTRUCTOR);
+		throw te;
+	}
+
+	LARGE_INTEGER liSize;
+	if (!::GetFileSizeEx(m_hFile, &liSize)) {
+		unmap();
+		TracedException te(SZ_OBMAPPEDFILE_EXCEPTION, SZ_EXCEPTION_NOMAPPING, SZ_OBMAPPEDFILE_CONSTRUCTOR);
+		throw te;
+	}
+	m_nSize = static_cast<size_t>(liSize.QuadPart);
+
+	// File times count 100ns intervals
+	FILETIME ftWrite;
+	if (::GetFileTime(m_hFile, nullptr, nullptr, &ftWrite))
+		m_nModified = static_cast<int64_t>((static_cast<uint64_t>(ftWrite.dwHighDateTime) << 32) | ftWrite.dwLowDateTime) * 100;
+
+	// An empty file cannot be mapped and simply has no rows
+	if (m_nSize == 0)
+		return;
+
+	m_hMapping = ::CreateFileMappingA(m_hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_hMapping != nullptr)
+		m_pData = static_cast<const char*>(::MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0));
+#else
+	m_fd = ::open(szFile.c_str(), O_RDONLY);
+	if (m_fd < 0) {
+		TracedException te(SZ_OBMAPPEDFILE_EXCEPTION, SZ_EXCEPTION_NOMAPPING, SZ_OBMAPPEDFILE_CONSTRUCTOR);
+		throw te;
+	}
+
+	struct stat st;
+	if (::fstat(m_fd, &st) != 0) {
+		unmap();
+		TracedException te(SZ_OBMAPPEDFILE_EXCEPTION, SZ_EXCEPTION_NOMAPPING, SZ_OBMAPPEDFILE_CONSTRUCTOR);
+		throw te;
+	}
+	m_nSize = static_cast<size_t>(st.st_size);
+
+#ifdef __linux__
+	m_nModified = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#else
+	m_nModified = static_cast<int64_t>(st.st_mtime) * 1000000000;
+#endif
+
+	// An empty file cannot be mapped and simply has no rows
+	if (m_nSize == 0)
+		return;
+
+	void* pMap = ::mmap(nullptr, m_nSize, PROT_READ, MAP_PRIVATE, m_fd, 0);
+	if (pMap != MAP_FAILED) {
+		m_pData = static_cast<const char*>(pMap);
+
+		// Feeds are read once front to back: read ahead aggressively and drop pages behind the scan
+		::madvise(pMap, m_nSize, MADV_SEQUENTIAL);
+	}
+#endif
+
+	if (m_pData == nullptr) {
+		unmap();
+		TracedException te(SZ_OBMAPPEDFILE_EXCEPTION, SZ_EXCEPTION_NOMAPPING, SZ_OBMAPPEDFILE_CONSTRUCTOR);
+		throw te;
+	}
+}
+
+OBMappedFile::~OBMappedFile() {
+	unmap();
+}
+
+void OBMappedFile::unmap() noexcept {
+
+#ifdef _WIN32
+	if (m_pData != nullptr)
+		::UnmapViewOfFile(m_pData);
+	if (m_hMapping != nullptr)
+		::CloseHandle(m_hMapping);
+	if (m_hFile != INVALID_HANDLE_VALUE)
+		::CloseHandle(m_hFile);
+
+	m_hMapping = nullptr;
+	m_hFile = INVALID_HANDLE_VALUE;
+#else
+	if (m_pData != nullptr)
+		::munmap(const_cast<char*>(m_pData), m_nSize);
+	if (m_fd >= 0)
+		::close(m_fd);
+
+	m_fd = -1;
+#endif
+
+	m_pData = nullptr;
+	m_nSize = 0;
+}
+
+OBFollowedFile::OBFollowedFile(const string& szFile) : m_szFile(szFile), m_nOffset(0) {
+
+#ifdef __linux__
+	m_nNotifyFd = -1;
+#endif
+
+	open();
+}
+
+OBFollowedFile::~OBFollowedFile() {
+
+	close();
+}
+
+void OBFollowedFile::open() {
+
+	// Stub to allocate function name at compile time
+	static const string SZ_OBFOLLOWEDFILE_OPEN = "OBFollowedFile::open";
+
+#ifdef _WIN32
+	// Let the capture process keep writing, and rename the file aside, while it is read
+	m_hFile = ::CreateFileA(m_szFile.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (m_hFile == INVALID_HANDLE_VALUE) {
+		TracedException te(SZ_OBFOLLOWEDFILE_EXCEPTION, SZ_EXCEPTION_NOFOLLOW, SZ_OBFOLLOWEDFILE_OPEN);
+		throw te;
+	}
+#else
+	m_fd = ::open(m_szFile.c_str(), O_RDONLY);
+	if (m_fd < 0) {
+		TracedException te(SZ_OBFOLLOWEDFILE_EXCEPTION, SZ_EXCEPTION_NOFOLLOW, SZ_OBFOLLOWEDFILE_OPEN);
+		throw te;
+	}
+#endif
+
+#ifdef __linux__
+	// Without a watch the follower falls back to polling the file size. A rename or delete of the file
+	// wakes the follower too, so it finds the file that replaces it without waiting for the poll.
+	m_nNotifyFd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (m_nNotifyFd >= 0 && ::inotify_add_watch(m_nNotifyFd, m_szFile.c_str(), IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF) < 0) {
+		::close(m_nNotifyFd);
+		m_nNotifyFd = -1;
+	}
+#endif
+}
+
+void OBFollowedFile::close() {
+
+#ifdef _WIN32
+	::CloseHandle(m_hFile);
+#else
+	::close(m_fd);
+#endif
+
+#ifdef __linux__
+	if (m_nNotifyFd >= 0)
+		::close(m_nNotifyFd);
+	m_nNotifyFd = -1;
+#endif
+}
+
+bool OBFollowedFile::isReplaced() const {
+
+	// A path naming no file yet is still being rotated, the open file keeps being read meanwhile
+#ifdef _WIN32
+	BY_HANDLE_FILE_INFORMATION fiOpen, fiPath;
+	if (!::GetFileInformationByHandle(m_hFile, &fiOpen))
+		return false;
+
+	HANDLE hPath = ::CreateFileA(m_szFile.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, 0, nullptr);
+	if (hPath == INVALID_HANDLE_VALUE)
+		return false;
+
+	bool bPath = ::GetFileInformationByHandle(hPath, &fiPath) != 0;
+	::CloseHandle(hPath);
+
+	return bPath && (fiPath.dwVolumeSerialNumber != fiOpen.dwVolumeSerialNumber || fiPath.nFileIndexHigh != fiOpen.nFileIndexHigh || fiPath.nFileIndexLow != fiOpen.nFileIndexLow);
+#else
+	struct stat stOpen, stPath;
+	if (::fstat(m_fd, &stOpen) != 0 || ::stat(m_szFile.c_str(), &stPath) != 0)
+		return false;
+
+	return stPath.st_ino != stOpen.st_ino || stPath.st_dev != stOpen.st_dev;
+#endif
+}
+
+long long OBFollowedFile::readAt(char* pBuf, size_t nBytes, uint64_t nOffset) const {
+
+#ifdef _WIN32
+	OVERLAPPED ov = {};
+	ov.Offset = static_cast<DWORD>(nOffset);
+	ov.OffsetHigh = static_cast<DWORD>(nOffset >> 32);
+	DWORD dwRead = 0;
+	return ::ReadFile(m_hFile, pBuf, static_cast<DWORD>(nBytes), &dwRead, &ov) ? static_cast<long long>(dwRead) : -1;
+#else
+	return ::pread(m_fd, pBuf, nBytes, static_cast<off_t>(nOffset));
+#endif
+}
+
+size_t OBFollowedFile::readAppended(string& szBuf, FOLLOW_EVENT& fe) {
+
+	// Stub to allocate function name at compile time
+	static const string SZ_OBFOLLOWEDFILE_READAPPENDED = "readAppended";
+
+	fe = FOLLOW_APPENDED;
+
+	// Look for a replaced file before sizing the open one, so no byte written to it before the rename is missed
+	bool bReplaced = isReplaced();
+
+	// Compare the current file size with what was read so far
+#ifdef _WIN32
+	LARGE_INTEGER liSize;
+	bool bSized = ::GetFileSizeEx(m_hFile, &liSize) != 0;
+	uint64_t nSize = bSized ? static_cast<uint64_t>(liSize.QuadPart) : 0;
+#else
+	struct stat st;
+	bool bSized = ::fstat(m_fd, &st) == 0;
+	uint64_t nSize = bSized ? static_cast<uint64_t>(st.st_size) : 0;
+#endif
+
+	if (!bSized) {
+		TracedException te(SZ_OBFOLLOWEDFILE_EXCEPTION, SZ_EXCEPTION_NOFOLLOW, SZ_OBFOLLOWEDFILE_READAPPENDED);
+		throw te;
+	}
+
+	// A truncated capture starts over, and so does one rewritten past the read offset between two reads.
+	// A file replaced at its path is only read to its end.
+	bool bTruncated = !bReplaced && nSize < m_nOffset;
+	if (!bReplaced && !bTruncated && !m_szTail.empty()) {
+		char szTail[TAIL_BYTES];
+		bTruncated = readAt(szTail, m_szTail.size(), m_nOffset - m_szTail.size()) != static_cast<long long>(m_szTail.size()) || m_szTail.compare(0, m_szTail.size(), szTail, m_szTail.size()) != 0;
+	}
+
+	if (bTruncated) {
+		m_nOffset = 0;
+		m_szTail.clear();
+		fe = FOLLOW_TRUNCATED;
+	}
+
+	size_t nTotal = 0;
+	while (m_nOffset < nSize) {
+
+		size_t nWant = static_cast<size_t>(std::min<uint64_t>(nSize - m_nOffset, READ_BLOCK_BYTES));
+		size_t nUsed = szBuf.size();
+		szBuf.resize(nUsed + nWant);
+
+		long long nRead = readAt(&szBuf[nUsed], nWant, m_nOffset);
+		if (nRead < 0) {
+			szBuf.resize(nUsed);
+			TracedException te(SZ_OBFOLLOWEDFILE_EXCEPTION, SZ_EXCEPTION_NOFOLLOW, SZ_OBFOLLOWEDFILE_READAPPENDED);
+			throw te;
+		}
+
+		szBuf.resize(nUsed + static_cast<size_t>(nRead));
+		m_nOffset += static_cast<uint64_t>(nRead);
+		nTotal += static_cast<size_t>(nRead);
+
+		// The file shrank while being read, pick it up on the next read
+		if (nRead == 0)
+			break;
+	}
+
+	// Keep the last bytes read to compare them again on the next read
+	size_t nKeep = std::min(nTotal, TAIL_BYTES);
+	m_szTail.append(szBuf, szBuf.size() - nKeep, nKeep);
+	if (m_szTail.size() > TAIL_BYTES)
+		m_szTail.erase(0, m_szTail.size() - TAIL_BYTES);
+
+	// The old file is read to its end, the next read starts the new one
+	if (bReplaced) {
+		close();
+		open();
+		m_nOffset = 0;
+		m_szTail.clear();
+		fe = FOLLOW_ROTATED;
+	}
+
+	return nTotal;
+}
+
+void OBFollowedFile::waitForWrite(int nTimeoutMs) {
+
+#ifdef __linux__
+	if (m_nNotifyFd >= 0) {
+		struct pollfd pfd = { m_nNotifyFd, POLLIN, 0 };
+		if (::poll(&pfd, 1, nTimeoutMs) > 0) {
+
+			// Drain the events, the next read picks up whatever was written
+			char buf[4096];
+			while (::read(m_nNotifyFd, buf, sizeof(buf)) > 0) {}
+		}
+		return;
+	}
+#endif
+
+	boost::this_thread::sleep_for(boost::chrono::milliseconds(nTimeoutMs));
+}
+
+// Codec of a compressed feed, inflating what input it is given into what output room it is given
+class OBFeedDecoder
+{
+public:
+	virtual ~OBFeedDecoder() {}
+
+	// Inflate from the input into the output and advance both past the bytes used
+	virtual void decode(const char*& pIn, const char* pInEnd, char*& pOut, char* pOutEnd) = 0;
+
+	// No member or frame is partly inflated, so the compressed file may end here
+	virtual bool atFrameEnd() const = 0;
+
+protected:
+	static constexpr auto SZ_OBFEEDDECODER_EXCEPTION = "OBFeedDecoder Exception";
+};
+
+#ifdef OB_GZIP
+class OBGzipDecoder : public OBFeedDecoder
+{
+public:
+	OBGzipDecoder() : m_bEnd(true) {
+
+		// Stub to allocate function name at compile time
+		static const string SZ_OBGZIPDECODER_CONSTRUCTOR = "OBGzipDecoder::OBGzipDecoder";
+
+		memset(&m_zs, 0, sizeof(m_zs));
+
+		// Window bits plus 32 reads a gzip or a zlib header alike
+		if (inflateInit2(&m_zs, 15 + 32) != Z_OK)
+			throw TracedException(SZ_OBFEEDDECODER_EXCEPTION, "Cannot start gzip inflation", SZ_OBGZIPDECODER_CONSTRUCTOR);
+	}
+
+	~OBGzipDecoder() {
+		inflateEnd(&m_zs);
+	}
+
+	void decode(const char*& pIn, const char* pInEnd, char*& pOut, char* pOutEnd) override {
+
+		// Stub to allocate function name at compile time
+		static const string SZ_OBGZIPDECODER_DECODE = "decode";
+
+		if (m_bEnd) {
+			if (pIn == pInEnd)
+				return;
+
+			// Bytes past the end of a member start the next one, as gzip -d reads concatenated members
+			inflateReset(&m_zs);
+			m_bEnd = false;
+		}
+
+		m_zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(pIn));
+		m_zs.avail_in = static_cast<uInt>(pInEnd - pIn);
+		m_zs.next_out = reinterpret_cast<Bytef*>(pOut);
+		m_zs.avail_out = static_cast<uInt>(pOutEnd - pOut);
+
+		int nStatus = inflate(&m_zs, Z_NO_FLUSH);
+		if (nStatus == Z_STREAM_END)
+			m_bEnd = true;
+		else if (nStatus != Z_OK && nStatus != Z_BUF_ERROR)
+			throw TracedException(SZ_OBFEEDDECODER_EXCEPTION, string("Corrupt gzip data: ") + (m_zs.msg ? m_zs.msg : "unknown error"), SZ_OBGZIPDECODER_DECODE);
+
+		pIn = reinterpret_cast<const char*>(m_zs.next_in);
+		pOut = reinterpret_cast<char*>(m_zs.next_out);
+	}
+
+	bool atFrameEnd() const override	{ return m_bEnd; }
+
+private:
+	z_stream	m_zs;
+	bool		m_bEnd;
+};
+#endif
+
+#ifdef OB_ZSTD
+class OBZstdDecoder : public OBFeedDecoder
+{
+public:
+	OBZstdDecoder() : m_pds(ZSTD_createDStream()), m_bEnd(true) {
+
+		// Stub to allocate function name at compile time
+		static const string SZ_OBZSTDDECODER_CONSTRUCTOR = "OBZstdDecoder::OBZstdDecoder";
+
+		if (m_pds == nullptr || ZSTD_isError(ZSTD_initDStream(m_pds))) {
+			ZSTD_freeDStream(m_pds);
+			throw TracedException(SZ_OBFEEDDECODER_EXCEPTION, "Cannot start zstd inflation", SZ_OBZSTDDECODER_CONSTRUCTOR);
+		}
+	}
+
+	~OBZstdDecoder() {
+		ZSTD_freeDStream(m_pds);
+	}
+
+	void decode(const char*& pIn, const char* pInEnd, char*& pOut, char* pOutEnd) override {
+
+		// Stub to allocate function name at compile time
+		static const string SZ_OBZSTDDECODER_DECODE = "decode";
+
+		// Concatenated frames are read by the same stream, a frame only ends once flushed
+		if (m_bEnd && pIn == pInEnd)
+			return;
+
+		ZSTD_inBuffer zin = { pIn, static_cast<size_t>(pInEnd - pIn), 0 };
+		ZSTD_outBuffer zout = { pOut, static_cast<size_t>(pOutEnd - pOut), 0 };
+
+		size_t nHint = ZSTD_decompressStream(m_pds, &zout, &zin);
+		if (ZSTD_isError(nHint))
+			throw TracedException(SZ_OBFEEDDECODER_EXCEPTION, string("Corrupt zstd data: ") + ZSTD_getErrorName(nHint), SZ_OBZSTDDECODER_DECODE);
+
+		m_bEnd = (nHint == 0);
+		pIn += zin.pos;
+		pOut += zout.pos;
+	}
+
+	bool atFrameEnd() const override	{ return m_bEnd; }
+
+private:
+	ZSTD_DStream*	m_pds;
+	bool			m_bEnd;
+};
+#endif
+
+OBCompressedFile::OBCompressedFile(const string& szFile) : m_szFile(szFile), m_nInput(0), m_nInputPos(0), m_bInputEnd(false), m_iBlock(NO_BLOCK), m_nOffset(0) {
+
+	// Stub to allocate function name at compile time
+	static const string SZ_OBCOMPRESSEDFILE_CONSTRUCTOR = "OBCompressedFile::OBCompressedFile";
+
+	switch (codecOf(szFile)) {
+	case FEED_CODEC_GZIP:
+#ifdef OB_GZIP
+		m_pDecoder.reset(new OBGzipDecoder());
+#else
+		throw TracedException(SZ_OBCOMPRESSEDFILE_EXCEPTION, "Source feed " + szFile + " is gzip compressed and the build has no OB_GZIP", SZ_OBCOMPRESSEDFILE_CONSTRUCTOR);
+#endif
+		break;
+
+	case FEED_CODEC_ZSTD:
+#ifdef OB_ZSTD
+		m_pDecoder.reset(new OBZstdDecoder());
+#else
+		throw TracedException(SZ_OBCOMPRESSEDFILE_EXCEPTION, "Source feed " + szFile + " is zstd compressed and the build has no OB_ZSTD", SZ_OBCOMPRESSEDFILE_CONSTRUCTOR);
+#endif
+		break;
+
+	default:
+		throw TracedException(SZ_OBCOMPRESSEDFILE_EXCEPTION, "Source feed " + szFile + " is not compressed", SZ_OBCOMPRESSEDFILE_CONSTRUCTOR);
+	}
+
+	m_ifs.open(szFile, ios::in | ios::binary);
+	if (!m_ifs)
+		throw TracedException(SZ_OBCOMPRESSEDFILE_EXCEPTION, SZ_EXCEPTION_NOCOMPRESSED, SZ_OBCOMPRESSEDFILE_CONSTRUCTOR);
+
+	m_vInput.resize(INFLATE_INPUT_BYTES);
+	for (uint32_t iBlock = 0; iBlock < INFLATE_BLOCKS; ++iBlock)
+		m_brFree.push(iBlock);
+
+	m_thInflate = boost::thread(&OBCompressedFile::inflateFile, this);
+}
+
+OBCompressedFile::~OBCompressedFile() {
+
+	// A reader stopping early releases the inflating thread from any wait
+	m_brInflated.abort();
+	m_brFree.abort();
+
+	if (m_thInflate.joinable())
+		m_thInflate.join();
+}
+
+OBCompressedFile::FEED_CODEC OBCompressedFile::codecOf(const string& szFile) {
+
+	if (boost::iends_with(szFile, ".gz"))
+		return FEED_CODEC_GZIP;
+	if (boost::iends_with(szFile, ".zst"))
+		return FEED_CODEC_ZSTD;
+
+	return FEED_CODEC_NONE;
+}
+
+bool OBCompressedFile::next(const char*& pData, size_t& nBytes) {
+
+	// The block handed out last is parsed
+	if (m_iBlock != NO_BLOCK) {
+		m_brFree.push(m_iBlock);
+		m_iBlock = NO_BLOCK;
+	}
+
+	uint32_t iBlock;
+	if (!m_brInflated.pop(iBlock)) {
+
+		// The thread has stopped, its failure is seen once joined
+		if (m_thInflate.joinable())
+			m_thInflate.join();
+		if (m_ep)
+			std::rethrow_exception(m_ep);
+		return false;
+	}
+
+	m_iBlock = iBlock;
+	m_nOffset = m_vBlocks[iBlock].nOffset;
+	pData = m_vBlocks[iBlock].vBytes.data();
+	nBytes = m_vBlocks[iBlock].nBytes;
+	return true;
+}
+
+void OBCompressedFile::inflateFile() {
+
+	try {
+		vector<char> vCarry;
+		uint64_t nOffset = 0;
+		bool bEnd = false;
+
+		uint32_t iBlock;
+		while (!bEnd && m_brFree.pop(iBlock)) {
+
+			InflatedBlock& ib = m_vBlocks[iBlock];
+			ib.vBytes.assign(vCarry.begin(), vCarry.end());
+			ib.nOffset = nOffset;
+
+			// Inflate until the block holds a newline, so a row longer than a block grows the block
+			size_t nData = ib.vBytes.size();
+			size_t nCut = 0;
+			while (nCut == 0) {
+				ib.vBytes.resize(nData + INFLATE_BLOCK_BYTES);
+				size_t nInflated = inflateSome(ib.vBytes.data() + nData, INFLATE_BLOCK_BYTES);
+
+				for (size_t i = nData + nInflated; i > nData; --i) {
+					if (ib.vBytes[i - 1] == '\n') {
+						nCut = i;
+						break;
+					}
+				}
+
+				nData += nInflated;
+				if (nInflated == 0) {
+					// A last row without newline ends the feed
+					bEnd = true;
+					nCut = nData;
+					break;
+				}
+			}
+
+			ib.nBytes = nCut;
+			vCarry.assign(ib.vBytes.begin() + nCut, ib.vBytes.begin() + nData);
+			nOffset += nCut;
+
+			if (nCut == 0)
+				m_brFree.push(iBlock);
+			else if (!m_brInflated.push(iBlock))
+				return;
+		}
+		m_brInflated.close();
+	}
+	catch (...) {
+		m_ep = std::current_exception();
+		m_brInflated.abort();
+		m_brFree.abort();
+	}
+}
+
+size_t OBCompressedFile::inflateSome(char* pOut, size_t nMax) {
+
+	// Stub to allocate function name at compile time
+	static const string SZ_OBCOMPRESSEDFILE_INFLATESOME = "inflateSome";
+
+	char* pCur = pOut;
+	char* pEnd = pOut + nMax;
+	while (pCur != pEnd) {
+
+		if (m_nInputPos == m_nInput && !m_bInputEnd) {
+			m_nInput = static_cast<size_t>(m_ifs.rdbuf()->sgetn(m_vInput.data(), m_vInput.size()));
+			m_nInputPos = 0;
+			m_bInputEnd = (m_nInput == 0);
+		}
+
+		// The decoder may still hold output of input it has already taken
+		const char* pIn = m_vInput.data() + m_nInputPos;
+		char* pBefore = pCur;
+		m_pDecoder->decode(pIn, m_vInput.data() + m_nInput, pCur, pEnd);
+		m_nInputPos = pIn - m_vInput.data();
+
+		if (m_bInputEnd && pCur == pBefore) {
+			if (!m_pDecoder->atFrameEnd())
+				throw TracedException(SZ_OBCOMPRESSEDFILE_EXCEPTION, "Compressed source feed " + m_szFile + " is truncated", SZ_OBCOMPRESSEDFILE_INFLATESOME);
+			break;
+		}
+	}
+
+	return pCur - pOut;
+}
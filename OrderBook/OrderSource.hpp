@@ -0,0 +1,184 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <memory>
+#include <exception>
+#include <cstdint>
+#include <boost/thread.hpp>
+
+#include "TracedException.hpp"
+#include "OrderPipe.hpp"
+
+// Read-only mapping of a whole feed file. Rows are handed out as slices of the mapped pages
+// so nothing is copied from the page cache into heap strings.
+class OBMappedFile
+{
+public:
+	OBMappedFile() = delete;
+	explicit OBMappedFile(const string& szFile);
+	~OBMappedFile();
+
+	OBMappedFile(const OBMappedFile&) = delete;
+	OBMappedFile& operator=(const OBMappedFile&) = delete;
+
+	const char* data() const	{ return m_pData; }
+	size_t size() const			{ return m_nSize; }
+
+	// Last write time of the file in nanoseconds, as precise as the platform records it
+	int64_t getModifiedTime() const	{ return m_nModified; }
+
+private:
+	void unmap() noexcept;
+
+private:
+	const char*		m_pData;
+	size_t			m_nSize;
+	int64_t			m_nModified;
+
+#ifdef _WIN32
+	void*			m_hFile;
+	void*			m_hMapping;
+#else
+	int				m_fd;
+#endif
+
+	static constexpr auto SZ_OBMAPPEDFILE_EXCEPTION = "OBMappedFile Exception";
+	static constexpr auto SZ_EXCEPTION_NOMAPPING = "Cannot open or map source feed file";
+};
+
+// Tail of a feed file that is still being written. Each read returns the bytes appended since
+// the previous one; waiting for more blocks on inotify on Linux and polls the size elsewhere.
+class OBFollowedFile
+{
+public:
+	OBFollowedFile() = delete;
+	explicit OBFollowedFile(const string& szFile);
+	~OBFollowedFile();
+
+	OBFollowedFile(const OBFollowedFile&) = delete;
+	OBFollowedFile& operator=(const OBFollowedFile&) = delete;
+
+	// What happened to the file since the last read
+	enum FOLLOW_EVENT {
+		FOLLOW_APPENDED = 0,	// Bytes were appended, or nothing changed
+		FOLLOW_TRUNCATED,		// File was truncated or rewritten, its bytes are read again from its start
+		FOLLOW_ROTATED			// File was renamed aside and replaced, the bytes read are its last ones
+	};
+
+	// Append the bytes written since the last read to the buffer and return their count. A file shorter
+	// than the read offset, or whose last bytes read changed, was truncated or rewritten and is read again
+	// from its start. A new file at the path of the followed one is opened once the old one is read to its
+	// end, and read from its start by the next call.
+	size_t readAppended(string& szBuf, FOLLOW_EVENT& fe);
+
+	// Block until the file is written to or the timeout expires
+	void waitForWrite(int nTimeoutMs);
+
+	uint64_t getOffset() const	{ return m_nOffset; }
+
+private:
+	void open();
+	void close();
+
+	// Whether the path of the followed file now names another file
+	bool isReplaced() const;
+
+	// Read at an offset of the open file, returning the bytes read or -1
+	long long readAt(char* pBuf, size_t nBytes, uint64_t nOffset) const;
+
+private:
+	string			m_szFile;
+	uint64_t		m_nOffset;
+	string			m_szTail;		// Last bytes read, compared again on every read to catch a rewritten file
+
+#ifdef _WIN32
+	void*			m_hFile;
+#else
+	int				m_fd;
+#endif
+
+#ifdef __linux__
+	int				m_nNotifyFd;
+#endif
+
+	static constexpr size_t READ_BLOCK_BYTES = 1 << 20;
+	static constexpr size_t TAIL_BYTES = 64;
+
+	static constexpr auto SZ_OBFOLLOWEDFILE_EXCEPTION = "OBFollowedFile Exception";
+	static constexpr auto SZ_EXCEPTION_NOFOLLOW = "Cannot open or read followed source feed file";
+};
+
+// Inflates one codec of compressed source feeds, defined with the codecs built in
+class OBFeedDecoder;
+
+// Compressed feed file read without inflating it to disk. A thread of its own inflates the file into a
+// few blocks of whole rows, which the reader takes in file order and hands back once parsed, so the
+// memory held does not grow with the feed. The codec follows the file name, .gz or .zst, and is read
+// when the build defines OB_GZIP or OB_ZSTD.
+class OBCompressedFile
+{
+public:
+	enum FEED_CODEC {
+		FEED_CODEC_NONE = 0,	// Plain text feed
+		FEED_CODEC_GZIP,		// .gz, one or more gzip members
+		FEED_CODEC_ZSTD			// .zst, one or more zstd frames
+	};
+
+	OBCompressedFile() = delete;
+	explicit OBCompressedFile(const string& szFile);
+	~OBCompressedFile();
+
+	OBCompressedFile(const OBCompressedFile&) = delete;
+	OBCompressedFile& operator=(const OBCompressedFile&) = delete;
+
+	// Codec of a feed file from its name
+	static FEED_CODEC codecOf(const string& szFile);
+
+	// Next block of whole rows, valid until the following call. False at the end of the feed, and
+	// throws what stopped the inflating thread.
+	bool next(const char*& pData, size_t& nBytes);
+
+	// Offset of the last block in the inflated feed
+	uint64_t getOffset() const	{ return m_nOffset; }
+
+private:
+	void	inflateFile();
+	size_t	inflateSome(char* pOut, size_t nMax);
+
+	// Whole rows inflated from the file, passed to the reader by index and reused once parsed
+	struct InflatedBlock {
+		vector<char>	vBytes;
+		size_t			nBytes;			// Bytes of whole rows at the front of the buffer
+		uint64_t		nOffset;		// Byte offset of the block in the inflated feed
+	};
+
+	static constexpr uint32_t INFLATE_BLOCKS = 4;
+	static constexpr size_t INFLATE_BLOCK_BYTES = 1 << 20;
+	static constexpr size_t INFLATE_INPUT_BYTES = 1 << 18;
+	static constexpr uint32_t NO_BLOCK = ~0u;
+
+	typedef OBSpscRing<uint32_t, INFLATE_BLOCKS> BlockRing;
+
+	string							m_szFile;
+	std::ifstream					m_ifs;
+	std::unique_ptr<OBFeedDecoder>	m_pDecoder;
+
+	// Compressed bytes read and not yet inflated, owned by the inflating thread
+	vector<char>					m_vInput;
+	size_t							m_nInput;
+	size_t							m_nInputPos;
+	bool							m_bInputEnd;
+
+	InflatedBlock					m_vBlocks[INFLATE_BLOCKS];
+	BlockRing						m_brInflated;
+	BlockRing						m_brFree;
+	uint32_t						m_iBlock;		// Block handed to the reader, NO_BLOCK before the first
+	uint64_t						m_nOffset;
+	std::exception_ptr				m_ep;
+	boost::thread					m_thInflate;
+
+	static constexpr auto SZ_OBCOMPRESSEDFILE_EXCEPTION = "OBCompressedFile Exception";
+	static constexpr auto SZ_EXCEPTION_NOCOMPRESSED = "Cannot open compressed source feed file";
+};
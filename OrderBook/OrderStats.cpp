@@ -0,0 +1,98 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Run statistics of the source feeds and of the report
+//==============================================================
+#include "pch.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace std;
+
+#include "OrderStats.hpp"
+
+namespace {
+
+	// Counter and clock at start up, the time stamp rate is measured against them
+	struct TscOrigin {
+		uint64_t	nTsc;
+		uint64_t	nNs;
+	};
+
+	const TscOrigin s_toStart = { RunStats::readTsc(), static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count()) };
+}
+
+uint64_t RunStats::steadyNs() {
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+double RunStats::tscPerSecond() {
+
+	uint64_t nNs = steadyNs() - s_toStart.nNs;
+	return (nNs > 0) ? (readTsc() - s_toStart.nTsc) * 1e9 / nNs : 0;
+}
+
+uint64_t RunStats::peakRssKb() {
+
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (::GetProcessMemoryInfo(::GetCurrentProcess(), &pmc, sizeof(pmc)))
+		return pmc.PeakWorkingSetSize / 1024;
+	return 0;
+#else
+	// Linux counts the peak in kilobytes
+	struct rusage ru;
+	if (getrusage(RUSAGE_SELF, &ru) == 0)
+		return static_cast<uint64_t>(ru.ru_maxrss);
+	return 0;
+#endif
+}
+
+const char* RunStats::getStageName(STATS_STAGE ss) {
+
+	switch (ss) {
+	case STATS_READ:		return "read";
+	case STATS_TOKENIZE:	return "tokenize";
+	case STATS_PARSE:		return "parse";
+	case STATS_INSERT:		return "insert";
+	case STATS_RENDER:		return "render";
+	case STATS_WRITE:		return "write";
+	default:				return "";
+	}
+}
+
+void RunStats::writeJson(ostream& os, const string& szSource) const {
+
+	double dTscPerMs = tscPerSecond() / 1000;
+
+	// Windows paths carry backslashes
+	string szEscaped;
+	for (char ch : szSource) {
+		if (ch == '\\' || ch == '"')
+			szEscaped += '\\';
+		szEscaped += ch;
+	}
+
+	os << "{ \"source\": \"" << szEscaped << "\", \"bytes\": " << nBytes << ", \"lines\": " << nLines
+		<< ", \"rows_accepted\": " << nRowsAccepted << ", \"rows_skipped\": " << nRowsSkipped << ", \"rows_rejected\": " << nRowsRejected
+		<< ", \"new_pairs\": " << nNewPairs << ", \"sides_reused\": " << nSidesReused << ", \"level_bytes\": " << nLevelBytes << ", \"peak_rss_kb\": " << nPeakRssKb;
+
+	os << ", \"cycles\": {";
+	for (int i = 0; i < STATS_STAGES; ++i)
+		os << (i > 0 ? ", \"" : " \"") << getStageName(static_cast<STATS_STAGE>(i)) << "\": " << nCycles[i];
+
+	os << " }, \"ms\": {" << std::fixed << std::setprecision(3);
+	for (int i = 0; i < STATS_STAGES; ++i)
+		os << (i > 0 ? ", \"" : " \"") << getStageName(static_cast<STATS_STAGE>(i)) << "\": " << (dTscPerMs > 0 ? nCycles[i] / dTscPerMs : 0.0);
+
+	os << std::defaultfloat << " } }";
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <ostream>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Run statistics are counted unless built with OB_STATS=0, which compiles every count away
+#ifndef OB_STATS
+#define OB_STATS 1
+#endif
+
+// Counters of a run, each set kept by the one thread filling it with no synchronization and merged
+// once that thread is done. Stage times are processor time stamp cycles: every mark reads the counter
+// once and charges the cycles since the previous mark to the stage just ended. Reading the counter
+// costs about as much as tokenizing a short row on some virtual machines, so feed rows are timed one
+// in STATS_SAMPLE_ROWS and their cycles weighted up, while the row and byte counts stay exact.
+struct RunStats
+{
+	enum STATS_STAGE {
+		STATS_READ = 0,		// Slicing rows out of the feed, disk waits included
+		STATS_TOKENIZE,		// Locating the book fields of a row
+		STATS_PARSE,		// Reading the prices and quantities of the book fields
+		STATS_INSERT,		// Recording levels, live book and spreads, then sorting the levels
+		STATS_RENDER,		// Building the report
+		STATS_WRITE,		// Writing the report
+		STATS_STAGES
+	};
+
+	static constexpr bool ENABLED = OB_STATS != 0;
+	static constexpr uint64_t STATS_SAMPLE_ROWS = 16;		// Power of 2
+
+	uint64_t	nBytes;				// Bytes read, or rendered for a report
+	uint64_t	nLines;				// Lines read, header lines included
+	uint64_t	nRowsAccepted;		// Rows carrying a book
+	uint64_t	nRowsSkipped;		// Rows carrying no book
+	uint64_t	nRowsRejected;		// Rows that could not be read
+	uint64_t	nNewPairs;			// Price/quantity pairs the level summaries grew by
+	uint64_t	nSidesReused;		// Book fields found already read and not read again
+	uint64_t	nLevelBytes;		// Memory held by the level summaries once read
+	uint64_t	nPeakRssKb;			// Peak memory of the process once read
+	uint64_t	nCycles[STATS_STAGES];
+
+	RunStats() : nBytes(0), nLines(0), nRowsAccepted(0), nRowsSkipped(0), nRowsRejected(0), nNewPairs(0), nSidesReused(0), nLevelBytes(0), nPeakRssKb(0), nCycles{}, m_nLastTsc(0), m_nWeight(0) {}
+
+	// Start charging every cycle from now
+	void lap() {
+		if (ENABLED) {
+			m_nWeight = 1;
+			m_nLastTsc = readTsc();
+		}
+	}
+
+	// Start a feed row, timed only if it is one of the sampled rows
+	void beginRow()						{ beginRow(nLines); }
+
+	// Start a feed row counted by another stage, sampled by its line
+	void beginRow(uint64_t nLine) {
+		if (ENABLED) {
+			m_nWeight = ((nLine & (STATS_SAMPLE_ROWS - 1)) == 0) ? STATS_SAMPLE_ROWS : 0;
+			if (m_nWeight > 0)
+				m_nLastTsc = readTsc();
+		}
+	}
+
+	// Charge the cycles since the last lap, row or mark to a stage
+	void mark(STATS_STAGE ss) {
+		if (ENABLED && m_nWeight > 0) {
+			uint64_t nTsc = readTsc();
+			nCycles[ss] += (nTsc - m_nLastTsc) * m_nWeight;
+			m_nLastTsc = nTsc;
+		}
+	}
+
+	void addLine(uint64_t nLineBytes)	{ if (ENABLED) { nLines++; nBytes += nLineBytes; } }
+	void addAccepted()					{ if (ENABLED) nRowsAccepted++; }
+	void addSkipped()					{ if (ENABLED) nRowsSkipped++; }
+	void addRejected()					{ if (ENABLED) nRowsRejected++; }
+	void addNewPairs(size_t nPairs)		{ if (ENABLED) nNewPairs += nPairs; }
+	void addReused(size_t nSides)		{ if (ENABLED) nSidesReused += nSides; }
+
+	// Fold in the counts of another thread, which is done with them
+	void merge(const RunStats& rs) {
+		nBytes += rs.nBytes;
+		nLines += rs.nLines;
+		nRowsAccepted += rs.nRowsAccepted;
+		nRowsSkipped += rs.nRowsSkipped;
+		nRowsRejected += rs.nRowsRejected;
+		nNewPairs += rs.nNewPairs;
+		nSidesReused += rs.nSidesReused;
+		nLevelBytes += rs.nLevelBytes;
+		nPeakRssKb = (rs.nPeakRssKb > nPeakRssKb) ? rs.nPeakRssKb : nPeakRssKb;
+
+		for (int i = 0; i < STATS_STAGES; ++i)
+			nCycles[i] += rs.nCycles[i];
+	}
+
+	// Write the counts as a json object, stage times both in cycles and in milliseconds
+	void writeJson(std::ostream& os, const std::string& szSource) const;
+
+	static const char* getStageName(STATS_STAGE ss);
+
+	// Time stamp cycles per second, measured over the run so far
+	static double tscPerSecond();
+
+	// Peak resident memory of the process so far
+	static uint64_t peakRssKb();
+
+	static uint64_t readTsc() {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		return steadyNs();
+#endif
+	}
+
+private:
+	static uint64_t steadyNs();
+
+private:
+	uint64_t	m_nLastTsc;
+	uint64_t	m_nWeight;		// Rows the cycles being timed stand for, none when not timing
+};
@@ -60,4 +60,6 @@ private:
 public:
 	static constexpr auto SZ_EXCEPTION_BADALLOC = "Allocation failed(bad_alloc)";
 	static constexpr auto SZ_EXCEPTION_UNEXPECTED = "Caught unexpected exception";
+	static constexpr auto SZ_EXCEPTION_BADROW = "Malformed feed row";
+	static constexpr auto SZ_EXCEPTION_BADNUMBER = "Invalid price or quantity";
 };
\ No newline at end of file